@@ -0,0 +1,101 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Counts the program's heap allocations, so code that is meant
+not to allocate (e.g. CityMesh writing the meshes of a whole city) can
+show that it doesn't. Everything made with new goes through the
+replacement operator new here, which counts the allocations and the
+bytes in use and keeps the most that were ever in use at once.
+
+Like stb_image.h, exactly one .cpp file defines
+ALLOCATION_COUNT_IMPLEMENTATION before including this, which puts the
+replacement operators in it. Without that the counts stay at 0.
+*/
+
+#ifndef _ALLOCATIONCOUNT_H_
+#define _ALLOCATIONCOUNT_H_
+
+#include <cstddef>
+#include <atomic>
+
+struct AllocationCounts{
+  std::atomic<size_t> allocations;//Ever made
+  std::atomic<size_t> bytes;//In use now
+  std::atomic<size_t> peak;//Most bytes in use at once since resetPeak()
+
+  //Starts the peak over from what is in use now
+  void resetPeak(){
+	peak = bytes.load();
+  }
+};
+
+inline AllocationCounts& allocationCounts(){
+	static AllocationCounts counts;//Zeroed before anything runs, so new can use it from the start
+	return counts;
+}
+
+#ifdef ALLOCATION_COUNT_IMPLEMENTATION
+#include <cstdlib>
+#include <new>
+
+/*Each block starts with its size, kept far enough ahead of what the
+caller gets that alignment is unchanged*/
+void* operator new(size_t size){
+	AllocationCounts& counts = allocationCounts();
+	void* block = malloc(size + alignof(std::max_align_t));
+	if(!block){
+		throw std::bad_alloc();
+	}
+	*(size_t*)block = size;
+	counts.allocations++;
+	size_t bytes = counts.bytes += size;
+	for(size_t peak = counts.peak; bytes > peak && !counts.peak.compare_exchange_weak(peak, bytes); ){}
+	return (char*)block + alignof(std::max_align_t);
+}
+
+void operator delete(void* p) noexcept{
+	if(p){
+		void* block = (char*)p - alignof(std::max_align_t);
+		allocationCounts().bytes -= *(size_t*)block;
+		free(block);
+	}
+}
+
+//The other forms only have to go through the two above
+void* operator new[](size_t size){
+	return operator new(size);
+}
+
+void operator delete[](void* p) noexcept{
+	operator delete(p);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+	try{
+		return operator new(size);
+	}catch(...){
+		return NULL;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+	try{
+		return operator new(size);
+	}catch(...){
+		return NULL;
+	}
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept{
+	operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept{
+	operator delete(p);
+}
+#endif
+
+#endif
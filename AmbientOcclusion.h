@@ -0,0 +1,114 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Bakes ambient occlusion into the buildings when a city is
+generated, and again for the buildings around an edit. The result is
+stored per corner in each Building and drawing it costs nothing extra.
+
+From every corner of every face, rays are cast over the hemisphere
+around the face's normal. The fraction that escapes without hitting
+a neighbouring building or the ground within _distance is the corner's
+openness. Rays are traced through a SpatialGrid of the building boxes.
+Blocks are handed out to all hardware threads; each building belongs
+to exactly one block so the threads never write to the same building.
+*/
+
+class AmbientOcclusionBaker{
+public:
+  AmbientOcclusionBaker(int rays = 32, float distance = 8.0f):
+	_distance(distance),
+	_bakeMs(0.0),
+	_buildings(0){
+	/*The same cosine weighted directions (a Hammersley set) are used
+	for every corner so the result doesn't change between runs*/
+	for(int i = 0; i < rays; i++){
+		float u = (i + 0.5f) / rays;
+		float v = radicalInverse(i);
+		float r = sqrt(u);
+		float phi = 2.0f * glm::pi<float>() * v;
+		_hemisphere.push_back(glm::vec3(r * cos(phi), r * sin(phi), sqrt(std::max(0.0f, 1.0f - u))));
+	}
+  }
+
+  virtual ~AmbientOcclusionBaker(){}
+
+  //blocks lists the buildings of each block; grid holds every building by its index in buildings
+  void bake(std::vector<Building*>& buildings, const std::vector<std::vector<unsigned int> >& blocks,
+	const SpatialGrid& grid){
+	double start = glfwGetTime();
+	std::atomic<unsigned int> next(0);
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for(unsigned int t = 0; t < threads; t++){
+		workers.push_back(std::thread([&](){
+			for(unsigned int b = next++; b < blocks.size(); b = next++){
+				for(unsigned int i = 0; i < blocks[b].size(); i++){
+					bakeBuilding(buildings[blocks[b][i]], blocks[b][i], grid);
+				}
+			}
+		}));
+	}
+	for(unsigned int t = 0; t < threads; t++){
+		workers[t].join();
+	}
+	_bakeMs = 1000.0 * (glfwGetTime() - start);
+	_buildings = buildings.size();
+	printf("Ambient occlusion: %zu buildings baked in %.1f ms on %u threads (%.1f ms per 10k buildings)\n",
+		_buildings, _bakeMs, threads, _buildings ? _bakeMs * 10000.0 / _buildings : 0.0);
+  }
+
+  /*Bakes one building again, e.g. after it or a neighbour was edited.
+  id is its number in grid*/
+  void bakeBuilding(Building* building, unsigned int id, const SpatialGrid& grid){
+	for(int f = 0; f < Building::FACES; f++){
+		glm::vec3 n = building->normal(f);
+		//Any two axes perpendicular to the normal
+		glm::vec3 tangent = fabs(n.y) > 0.5f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::vec3 bitangent = glm::cross(n, tangent);
+		glm::vec3 center = 0.25f * (building->position(f, 0) + building->position(f, 1)
+			+ building->position(f, 2) + building->position(f, 3));
+		for(int c = 0; c < 4; c++){
+			//Step in from the exact corner so rays along an edge don't graze the ground or a neighbour's wall
+			glm::vec3 p = building->position(f, c);
+			glm::vec3 origin = p + 0.05f * glm::normalize(center - p + n * 0.001f) + 0.01f * n;
+			int open = 0;
+			for(unsigned int r = 0; r < _hemisphere.size(); r++){
+				const glm::vec3& h = _hemisphere[r];
+				glm::vec3 direction = h.x * tangent + h.y * bitangent + h.z * n;
+				if(!hitsGround(origin, direction) && !grid.occluded(origin, direction, _distance, id)){
+					open++;
+				}
+			}
+			building->setOcclusion(f, c, float(open) / _hemisphere.size());
+		}
+	}
+  }
+
+  //Buildings further apart than this don't change each other's occlusion
+  float distance(){
+	return _distance;
+  }
+
+private:
+  float _distance;//Buildings further than this don't darken a corner
+  std::vector<glm::vec3> _hemisphere;//Around +z
+  double _bakeMs;
+  size_t _buildings;
+
+  bool hitsGround(const glm::vec3& origin, const glm::vec3& direction){
+	return direction.y < 0.0f && origin.y < -direction.y * _distance;
+  }
+
+  //Van der Corput sequence in base 2
+  static float radicalInverse(unsigned int bits){
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return float(bits) * 2.3283064365386963e-10f;
+  }
+};
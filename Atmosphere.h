@@ -0,0 +1,260 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Procedural sky lit by the SpinningLight's sun, replacing the
+static cubemap while the day/night cycle runs.
+
+Single Rayleigh and Mie scattering of a spherical atmosphere is
+integrated once at startup into lookup tables, spread over all hardware
+threads:
+  transmittance  how much sunlight survives from the top of the
+                 atmosphere down to a height, per height and sun angle.
+                 Kept on the CPU; it also gives the sunlight its colour
+  scattering     light scattered towards the camera along every view
+                 ray, per view angle, sun angle and the angle between
+                 them around the vertical. Rayleigh and Mie are kept in
+                 two 3D textures without their phase functions
+The sky shader (shaders/atmosphere.frag.glsl) makes two lookups and
+applies the phase functions, so a frame costs no ray marching.
+Distances are in kilometres.
+*/
+
+class Atmosphere{
+public:
+  enum{VIEW_SIZE = 64, SUN_SIZE = 64, AZIMUTH_SIZE = 16};//Scattering table
+  enum{HEIGHT_SIZE = 64, ANGLE_SIZE = 256};//Transmittance table
+
+  Atmosphere():
+	_groundRadius(6360.0f),
+	_topRadius(6420.0f),
+	_cameraHeight(0.1f),
+	_rayleighScattering(5.8e-3f, 13.5e-3f, 33.1e-3f),
+	_rayleighHeight(8.0f),
+	_mieScattering(21e-3f),
+	_mieHeight(1.2f),
+	_sunIntensity(20.0f){
+	double start = glfwGetTime();
+	_transmittance.resize(HEIGHT_SIZE * ANGLE_SIZE);
+	parallelRows(HEIGHT_SIZE, &Atmosphere::transmittanceRow);
+	_rayleigh.resize(VIEW_SIZE * SUN_SIZE * AZIMUTH_SIZE);
+	_mie.resize(VIEW_SIZE * SUN_SIZE * AZIMUTH_SIZE);
+	parallelRows(SUN_SIZE, &Atmosphere::scatteringRow);
+	_bakeMs = 1000.0 * (glfwGetTime() - start);
+	printf("Atmosphere: scattering tables computed in %.1f ms\n", _bakeMs);
+
+	glGenTextures(2, _textures);
+	upload(_textures[0], _rayleigh);
+	upload(_textures[1], _mie);
+	glGenVertexArrays(1, &_emptyVAO);
+	if(!loadShaderProgram(_program, "shaders/skybox.vert.glsl", "shaders/atmosphere.frag.glsl")){
+		exit(1);
+	}
+	_uInverseViewProjection = glGetUniformLocation(_program.id(), "inverseViewProjection_B");
+	_uSunDirection = glGetUniformLocation(_program.id(), "sunDirection");
+	_uSunColor = glGetUniformLocation(_program.id(), "sunColor");
+	_uSunIntensity = glGetUniformLocation(_program.id(), "sunIntensity");
+	glUniform1i(glGetUniformLocation(_program.id(), "rayleighTable"), 0);
+	glUniform1i(glGetUniformLocation(_program.id(), "mieTable"), 1);
+	_program.deactivate();
+  }
+
+  virtual ~Atmosphere(){
+	glDeleteVertexArrays(1, &_emptyVAO);
+	glDeleteTextures(2, _textures);
+  }
+
+  /*Colour of direct sunlight at the camera for a sun this far above the
+  horizon (cosine of its zenith angle), scaled so the noon sun is 1*/
+  glm::vec3 sunlight(float cosZenith){
+	return transmittance(_cameraHeight, cosZenith) / transmittance(_cameraHeight, 1.0f);
+  }
+
+  /*Draws the sky where nothing else was drawn, like World::drawSkybox().
+  sunDirection points from the ground towards the sun*/
+  void draw(const glm::mat4& inverseViewProjection, const glm::vec3& sunDirection){
+	glm::vec3 sun = glm::normalize(sunDirection);
+	_program.activate();
+	glUniformMatrix4fv(_uInverseViewProjection, 1, false, glm::value_ptr(inverseViewProjection));
+	glUniform3fv(_uSunDirection, 1, glm::value_ptr(sun));
+	glUniform3fv(_uSunColor, 1, glm::value_ptr(transmittance(_cameraHeight, sun.y)));
+	glUniform1f(_uSunIntensity, _sunIntensity);
+	for(int i = 0; i < 2; i++){
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_3D, _textures[i]);
+	}
+	glBindVertexArray(_emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	_program.deactivate();
+  }
+
+private:
+  float _groundRadius;
+  float _topRadius;
+  float _cameraHeight;//The city is at sea level; the camera is a little above it
+  glm::vec3 _rayleighScattering;//Per km at sea level
+  float _rayleighHeight;//Density falls by e every this many km
+  float _mieScattering;
+  float _mieHeight;
+  float _sunIntensity;
+  std::vector<glm::vec3> _transmittance;//[height][angle]
+  std::vector<glm::vec3> _rayleigh;//[sun][view][azimuth], without the phase function
+  std::vector<glm::vec3> _mie;
+  double _bakeMs;
+  GLuint _textures[2];//Rayleigh and Mie scattering
+  GLuint _emptyVAO;
+  GLSLProgram _program;
+  GLint _uInverseViewProjection;
+  GLint _uSunDirection;
+  GLint _uSunColor;
+  GLint _uSunIntensity;
+
+  //Runs (this->*row)(i) for every i below rows on all hardware threads
+  void parallelRows(int rows, void (Atmosphere::*row)(int)){
+	std::atomic<int> next(0);
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for(unsigned int t = 0; t < threads; t++){
+		workers.push_back(std::thread([&](){
+			for(int i = next++; i < rows; i = next++){
+				(this->*row)(i);
+			}
+		}));
+	}
+	for(unsigned int t = 0; t < threads; t++){
+		workers[t].join();
+	}
+  }
+
+  glm::vec3 extinction(float height){
+	return _rayleighScattering * exp(-height / _rayleighHeight)
+		+ glm::vec3(_mieScattering / 0.9f) * exp(-height / _mieHeight);
+  }
+
+  //Distance along a ray from radius r with zenith cosine mu to a sphere; negative if it misses
+  static float sphereDistance(float r, float mu, float radius){
+	float discriminant = r * r * (mu * mu - 1.0f) + radius * radius;
+	if(discriminant < 0.0f){
+		return -1.0f;
+	}
+	float root = sqrt(discriminant);
+	float t = -r * mu - root;
+	return t > 0.0f ? t : -r * mu + root;
+  }
+
+  bool hitsGround(float r, float mu){
+	return mu < 0.0f && r * r * (mu * mu - 1.0f) + _groundRadius * _groundRadius >= 0.0f;
+  }
+
+  //Heights are stored on a square root scale so the thick bottom gets the most rows
+  float tableHeight(int i){
+	float x = float(i) / (HEIGHT_SIZE - 1);
+	return x * x * (_topRadius - _groundRadius);
+  }
+
+  void transmittanceRow(int i){
+	float r = _groundRadius + tableHeight(i);
+	for(int j = 0; j < ANGLE_SIZE; j++){
+		float mu = -1.0f + 2.0f * j / (ANGLE_SIZE - 1);
+		if(hitsGround(r, mu)){
+			_transmittance[i * ANGLE_SIZE + j] = glm::vec3(0.0f);
+			continue;
+		}
+		float length = sphereDistance(r, mu, _topRadius);
+		const int STEPS = 40;
+		float ds = length / STEPS;
+		glm::vec3 depth(0.0f);
+		for(int s = 0; s < STEPS; s++){
+			float t = (s + 0.5f) * ds;
+			float height = sqrt(r * r + t * t + 2.0f * r * mu * t) - _groundRadius;
+			depth += extinction(height) * ds;
+		}
+		_transmittance[i * ANGLE_SIZE + j] = glm::exp(-depth);
+	}
+  }
+
+  //Bilinear lookup in the transmittance table
+  glm::vec3 transmittance(float height, float mu){
+	float x = sqrt(glm::clamp(height / (_topRadius - _groundRadius), 0.0f, 1.0f)) * (HEIGHT_SIZE - 1);
+	float y = glm::clamp((mu + 1.0f) * 0.5f, 0.0f, 1.0f) * (ANGLE_SIZE - 1);
+	int x0 = std::min(int(x), HEIGHT_SIZE - 2);
+	int y0 = std::min(int(y), ANGLE_SIZE - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+	const glm::vec3* t = &_transmittance[x0 * ANGLE_SIZE + y0];
+	return glm::mix(glm::mix(t[0], t[1], fy), glm::mix(t[ANGLE_SIZE], t[ANGLE_SIZE + 1], fy), fx);
+  }
+
+  /*Table coordinates, also used by atmosphere.frag.glsl. View angles are
+  packed around the horizon, where the sky changes fastest*/
+  static float viewCosine(int i){
+	float x = 2.0f * i / (VIEW_SIZE - 1) - 1.0f;
+	return x < 0.0f ? -x * x : x * x;
+  }
+
+  static float sunCosine(int i){
+	return -0.3f + 1.3f * i / (SUN_SIZE - 1);
+  }
+
+  static float azimuthCosine(int i){
+	return -1.0f + 2.0f * i / (AZIMUTH_SIZE - 1);
+  }
+
+  //Every view angle and azimuth for one sun angle
+  void scatteringRow(int s){
+	float muSun = sunCosine(s);
+	glm::vec3 sun(sqrt(std::max(0.0f, 1.0f - muSun * muSun)), muSun, 0.0f);
+	glm::vec3 origin(0.0f, _groundRadius + _cameraHeight, 0.0f);
+	for(int v = 0; v < VIEW_SIZE; v++){
+		float mu = viewCosine(v);
+		float horizontal = sqrt(std::max(0.0f, 1.0f - mu * mu));
+		for(int a = 0; a < AZIMUTH_SIZE; a++){
+			float azimuth = azimuthCosine(a);
+			glm::vec3 view(horizontal * azimuth, mu, horizontal * sqrt(std::max(0.0f, 1.0f - azimuth * azimuth)));
+			//March to the top of the atmosphere, or to the ground
+			float length = hitsGround(origin.y, mu) ? sphereDistance(origin.y, mu, _groundRadius)
+				: sphereDistance(origin.y, mu, _topRadius);
+			const int STEPS = 32;
+			float ds = length / STEPS;
+			glm::vec3 depth(0.0f);
+			glm::vec3 rayleigh(0.0f);
+			glm::vec3 mie(0.0f);
+			for(int i = 0; i < STEPS; i++){
+				glm::vec3 p = origin + view * ((i + 0.5f) * ds);
+				float r = glm::length(p);
+				float height = r - _groundRadius;
+				depth += extinction(height) * (ds * 0.5f);
+				glm::vec3 light = transmittance(height, glm::dot(p / r, sun)) * glm::exp(-depth);
+				depth += extinction(height) * (ds * 0.5f);
+				rayleigh += light * exp(-height / _rayleighHeight) * ds;
+				mie += light * exp(-height / _mieHeight) * ds;
+			}
+			int index = (s * VIEW_SIZE + v) * AZIMUTH_SIZE + a;
+			_rayleigh[index] = rayleigh * _rayleighScattering;
+			_mie[index] = mie * _mieScattering;
+		}
+	}
+  }
+
+  void upload(GLuint texture, const std::vector<glm::vec3>& table){
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, AZIMUTH_SIZE, VIEW_SIZE, SUN_SIZE, 0,
+		GL_RGB, GL_FLOAT, glm::value_ptr(table[0]));
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+  }
+
+  Atmosphere(const Atmosphere&);//Owns GL objects, not copyable
+  Atmosphere& operator=(const Atmosphere&);
+};
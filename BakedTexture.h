@@ -0,0 +1,85 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: On-disk layout of a baked (pre-compressed) texture.
+Shared by bake_textures.cpp, which writes the files, and Texture.h, which
+maps them and hands the blocks straight to glCompressedTexImage2D.
+*/
+
+#ifndef _BAKEDTEXTURE_H_
+#define _BAKEDTEXTURE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/*A baked file is laid out as:
+	BakedTextureHeader
+	BakedTextureLevel[levels]
+	block data for every level (each level starts on a 16 byte boundary)
+Everything is little endian and naturally aligned, so the header and the
+level table can be read in place from a memory mapping*/
+#define BAKED_TEXTURE_MAGIC "CTEX"
+#define BAKED_TEXTURE_VERSION 1
+#define BAKED_TEXTURE_EXTENSION ".ctex"
+
+//Same value as GL_COMPRESSED_RGB_S3TC_DXT1_EXT so the baker doesn't need GL
+#define BAKED_FORMAT_BC1 0x83F0
+
+struct BakedTextureHeader{
+  char magic[4];//"CTEX"
+  uint32_t version;
+  uint32_t format;//GL internal format of the blocks
+  uint32_t width;//Width and height of level 0
+  uint32_t height;
+  uint32_t levels;//Number of mipmap levels stored
+  uint32_t blockBytes;//Bytes per 4x4 block (8 for BC1)
+  uint32_t reserved;
+};
+
+struct BakedTextureLevel{
+  uint32_t offset;//From the start of the file
+  uint32_t size;//In bytes
+  uint32_t width;
+  uint32_t height;
+};
+
+//Where the baked version of an image lives: textures/building.jpg -> textures/building.ctex
+inline std::string bakedTexturePath(const std::string& path){
+	std::string::size_type dot = path.find_last_of('.');
+	std::string::size_type slash = path.find_last_of('/');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)){
+		return path + BAKED_TEXTURE_EXTENSION;
+	}
+	return path.substr(0, dot) + BAKED_TEXTURE_EXTENSION;
+}
+
+/*Checks that a mapped file really is a baked texture we understand
+and that every level lies inside the file*/
+inline bool validBakedTexture(const unsigned char* data, size_t length){
+	if(length < sizeof(BakedTextureHeader)){
+		return false;
+	}
+	const BakedTextureHeader* header = (const BakedTextureHeader*)data;
+	if(memcmp(header->magic, BAKED_TEXTURE_MAGIC, 4) != 0 ||
+		header->version != BAKED_TEXTURE_VERSION ||
+		header->levels == 0 || header->levels > 32){
+		return false;
+	}
+	size_t tableEnd = sizeof(BakedTextureHeader) + header->levels * sizeof(BakedTextureLevel);
+	if(length < tableEnd){
+		return false;
+	}
+	const BakedTextureLevel* level = (const BakedTextureLevel*)(data + sizeof(BakedTextureHeader));
+	for(uint32_t i = 0; i < header->levels; i++){
+		if(level[i].offset < tableEnd || (size_t)level[i].offset + level[i].size > length){
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Hands out ranges of one big buffer, so meshes can be placed
+into it, moved and freed one at a time instead of uploading everything
+again. It only does the bookkeeping; sizes and offsets are in whatever
+unit the caller counts in (vertices, indices).
+
+Free ranges are kept twice: by offset, to merge a freed range with the
+free neighbours on either side, and by size, to find the smallest one
+that fits (best fit). Both stay sorted, so allocating and freeing
+cost O(log ranges) however full or broken up the buffer is.
+*/
+
+#ifndef _BUFFERALLOCATOR_H_
+#define _BUFFERALLOCATOR_H_
+
+#include <map>
+#include <set>
+#include <utility>
+#include <cstddef>
+
+class BufferAllocator{
+public:
+  BufferAllocator(): _capacity(0), _used(0){}
+
+  explicit BufferAllocator(size_t capacity): _capacity(0), _used(0){
+	grow(capacity);
+  }
+
+  /*Best fit. Returns false, changing nothing, if no free range is big
+  enough (the caller can grow() and try again)*/
+  bool allocate(size_t size, size_t& offset){
+	if(size == 0){
+		offset = 0;
+		return true;
+	}
+	std::set<std::pair<size_t, size_t> >::iterator fit = _bySize.lower_bound(std::make_pair(size, size_t(0)));
+	if(fit == _bySize.end()){
+		return false;
+	}
+	size_t rangeSize = fit->first;
+	offset = fit->second;
+	_bySize.erase(fit);
+	_byOffset.erase(offset);
+	if(rangeSize > size){
+		insert(offset + size, rangeSize - size);
+	}
+	_used += size;
+	return true;
+  }
+
+  /*First fit from the start of the buffer, only into ranges that start
+  before limit. For compacting: moves the mesh at limit further down*/
+  bool allocateBelow(size_t size, size_t limit, size_t& offset){
+	for(std::map<size_t, size_t>::iterator it = _byOffset.begin(); it != _byOffset.end() && it->first < limit; ++it){
+		if(it->second >= size){
+			offset = it->first;
+			size_t rangeSize = it->second;
+			remove(it);
+			if(rangeSize > size){
+				insert(offset + size, rangeSize - size);
+			}
+			_used += size;
+			return true;
+		}
+	}
+	return false;
+  }
+
+  //Gives back a range from allocate(), merged with any free range it touches
+  void free(size_t offset, size_t size){
+	if(size == 0){
+		return;
+	}
+	_used -= size;
+	std::map<size_t, size_t>::iterator next = _byOffset.lower_bound(offset);
+	if(next != _byOffset.begin()){
+		std::map<size_t, size_t>::iterator previous = next;
+		--previous;
+		if(previous->first + previous->second == offset){
+			offset = previous->first;
+			size += previous->second;
+			remove(previous);
+		}
+	}
+	if(next != _byOffset.end() && offset + size == next->first){
+		size += next->second;
+		remove(next);
+	}
+	insert(offset, size);
+  }
+
+  //Adds room at the end; the buffer itself must be grown to match
+  void grow(size_t capacity){
+	if(capacity <= _capacity){
+		return;
+	}
+	size_t added = capacity - _capacity;
+	size_t start = _capacity;
+	_capacity = capacity;
+	_used += added;//free() takes it back off
+	free(start, added);
+  }
+
+  size_t capacity() const{
+	return _capacity;
+  }
+
+  size_t used() const{
+	return _used;
+  }
+
+  //Free ranges; 1 when everything free is in one piece
+  size_t ranges() const{
+	return _byOffset.size();
+  }
+
+  size_t largestFree() const{
+	return _bySize.empty() ? 0 : _bySize.rbegin()->first;
+  }
+
+  //Offset of the end of the last allocation; everything after it is free
+  size_t end() const{
+	if(_byOffset.empty()){
+		return _capacity;
+	}
+	std::map<size_t, size_t>::const_reverse_iterator last = _byOffset.rbegin();
+	return last->first + last->second == _capacity ? last->first : _capacity;
+  }
+
+private:
+  size_t _capacity;
+  size_t _used;
+  std::map<size_t, size_t> _byOffset;//Free ranges, offset to size
+  std::set<std::pair<size_t, size_t> > _bySize;//The same ranges as size and offset, smallest first
+
+  void insert(size_t offset, size_t size){
+	_byOffset[offset] = size;
+	_bySize.insert(std::make_pair(size, offset));
+  }
+
+  void remove(std::map<size_t, size_t>::iterator range){
+	_bySize.erase(std::make_pair(range->second, range->first));
+	_byOffset.erase(range);
+  }
+};
+
+#endif
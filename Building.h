@@ -1,108 +1,426 @@
 class Building{
 public:
-  Building(float x, float z, float size, float height, unsigned int texture):
+  Building(float x, float z, float size, float height, unsigned int layer, unsigned int shape = 0):
 	_x(x),
-	_z(z), 
+	_z(z),
 	_size(size),
-	_height(height), 
-	_texture(texture), 
-	_noWindowsPerRow(1){}
-        
-  virtual ~Building(){
-	printf("Calling Building destructor.\n");
-  }
-        
+	_height(height),
+	_layer(layer){
+	setShape(shape);
+	for(int f = 0; f < FACES; f++){
+		for(int c = 0; c < 4; c++){
+			_occlusion[f][c] = 1.0f;
+		}
+	}
+  }
+
+  virtual ~Building(){}
+
+  enum{FACES = 5};//Four walls and the roof of the box. The bottom is never drawn
+  enum{MAX_CORNERS = 6, MAX_TIERS = 4};//Of a footprint (an L), and footprints stacked on each other
+  //Most a mesh from writeMesh() can have: every tier an L, with four vertices a wall and a roof
+  enum{MAX_VERTICES = MAX_TIERS * MAX_CORNERS * 5, MAX_INDICES = MAX_TIERS * (MAX_CORNERS * 6 + (MAX_CORNERS - 2) * 3)};
+  enum{WINDOWS_PER_UNIT = 3};//Columns of procedural windows a unit of wall, see shaders/facade.glsl
+
+  //Vertex of the city mesh, with the same inputs draw() gives the fixed attributes
+  struct Vertex{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat texCoord[4];//Facade s, t and layer, then the procedural window column
+	GLubyte color[4];//Procedural facade seed in rgb, baked ambient occlusion in alpha
+  };
+
+  /*The same vertex in 24 bytes instead of 44, as the city mesh stores it.
+  The shaders turn it back (shaders/packed_vertex.glsl):
+	position	steps of packOrigin().w up from packOrigin()
+	normal	  times 127, which the fixed attribute normalizes back
+	texCoord	s and t in TEXCOORD_STEPS, the layer and window column as they are
+  Positions come out exact wherever they are on a grid of the step, which
+  all but turned buildings are*/
+  struct PackedVertex{
+	GLshort position[4];//w is padding
+	GLbyte normal[4];//w is padding
+	GLshort texCoord[4];
+	GLubyte color[4];
+  };
+  enum{POSITION_STEPS = 32767, TEXCOORD_STEPS = 4096};
+  /*Generic attribute the city shaders read packOrigin() from, bound before
+  linking. Some drivers share 0, 2 to 5 and 8 up with the fixed
+  attributes, but not 7*/
+  enum{ORIGIN_ATTRIBUTE = 7};
+
+  /*A footprint other than the plain square, packed into an unsigned int
+  (0 is the plain square box):
+	bits 0-9	turn about the centre, in 1024ths of a full turn
+	bit 10		L shaped, with a square notch cut out of one corner
+	bits 11-12	setbacks: tiers above the first, each narrower than the one below
+	bits 13-15	width of the notch, in (2 + n) / 16ths of the building's
+  Everything is made from this when the mesh is written, so a building's
+  shape costs one number to store*/
+  static unsigned int makeShape(unsigned int turn, bool l, unsigned int setbacks, unsigned int notch){
+	return (turn & 1023) | (l ? 1 << 10 : 0) | ((setbacks & 3) << 11) | ((notch & 7) << 13);
+  }
+
+  /*The facade texture array is bound once by the Plane;
+  the third texture coordinate selects this building's layer.
+  The baked ambient occlusion of each corner goes in the colour's alpha,
+  the procedural facade's seed in its rgb. It is drawn packed, like the
+  city mesh, so the shaders read both the same way*/
   void draw(){
-	glEnable(GL_TEXTURE_2D);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-
-	glBegin(GL_QUADS);
-
-	//Facing towards me -> Front facing
-	glNormal3f(0.0, 0.0, 1.0);
-	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-	//Top left
-	glTexCoord2f(0, 0);
-	glVertex3f(-_size + _x, _height,  _size + _z);
-	//Bottom left
-	glTexCoord2f(0, _noWindowsPerRow);
-	glVertex3f(-_size + _x, 0,  _size + _z);
-	//Bottom right
-	glTexCoord2f(_noWindowsPerRow, _noWindowsPerRow);
-	glVertex3f(_size + _x, 0,  _size + _z);
-	//Top right
-	glTexCoord2f(_noWindowsPerRow, 0);
-	glVertex3f(_size + _x, _height,  _size + _z);
-
-	//Right facing
-	glNormal3f(1.0, 0.0, 0.0);
-	//Top left
-	glTexCoord2f(0, 0);
-	glVertex3f(_size + _x, _height,  _size + _z);
-	//Bottom left
-	glTexCoord2f(0, _noWindowsPerRow);
-	glVertex3f(_size + _x, 0,  _size + _z);
-	//Bottom right
-	glTexCoord2f(_noWindowsPerRow, _noWindowsPerRow);
-	glVertex3f(_size + _x, 0,  -_size + _z);
-	//Top right
-	glTexCoord2f(_noWindowsPerRow, 0);
-	glVertex3f(_size + _x, _height,  -_size + _z);
-
-	//Left facing
-	glNormal3f(-1.0, 0.0, 0.0);
-	//Top left
-	glTexCoord2f(0, 0);
-	glVertex3f(-_size + _x, _height,  -_size + _z);
-	//Bottom left
-	glTexCoord2f(0, _noWindowsPerRow);
-	glVertex3f(-_size + _x, 0,  -_size + _z);
-	//Bottom right
-	glTexCoord2f(_noWindowsPerRow, _noWindowsPerRow);
-	glVertex3f(-_size + _x, 0,  _size + _z);
-	//Top right
-	glTexCoord2f(_noWindowsPerRow, 0);
-	glVertex3f(-_size + _x, _height,  _size + _z);
-
-	//Facing away from me -> Rear facing
-	glNormal3f(0.0, 0.0, -1.0);
-	//Bottom left
-	glTexCoord2f(0, 0);
-	glVertex3f(-_size + _x, 0,  -_size + _z);
-	//Top left
-	glTexCoord2f(0, _noWindowsPerRow);
-	glVertex3f(-_size + _x, _height,  -_size + _z);
-	//Top right
-	glTexCoord2f(_noWindowsPerRow, _noWindowsPerRow);
-	glVertex3f(_size + _x, _height,  -_size + _z);
-	//Bottom right
-	glTexCoord2f(_noWindowsPerRow, 0);
-	glVertex3f(_size + _x, 0,  -_size + _z);
-
-	//Facing straight up -> Top facing
-	glNormal3f(0.0, 1.0, 0.0);
-	glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
-	//Top left
-	glVertex3f(-_size + _x, _height,  -_size + _z);
-	//Bottom left
-	glVertex3f(-_size + _x, _height,  _size + _z);
-	//Bottom right
-	glVertex3f(_size + _x, _height,  _size + _z);
-	//Top right
-	glVertex3f(_size + _x, _height,  -_size + _z);
-
-	glEnd();//Not going to draw the bottom of the building
-
-	glDisable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	PackedVertex vertices[MAX_VERTICES];
+	GLuint indices[MAX_INDICES];
+	writeMesh(vertices, indices);
+	glm::vec4 origin = packOrigin();
+	glVertexAttrib4fv(ORIGIN_ATTRIBUTE, &origin[0]);
+	glBegin(GL_TRIANGLES);
+	for(int i = 0; i < indexCount(); i++){
+		const PackedVertex& v = vertices[indices[i]];
+		glNormal3bv(v.normal);
+		glColor4ubv(v.color);
+		glTexCoord4sv(v.texCoord);
+		glVertex3sv(v.position);
+	}
+	glEnd();
+  }
+
+  //Size of the mesh from writeMesh(), at most MAX_VERTICES and MAX_INDICES
+  int vertexCount(){
+	return boxed() ? FACES * 4 : tiers() * footprintCorners() * 5;
+  }
+
+  int indexCount(){
+	int n = footprintCorners();
+	return boxed() ? FACES * 6 : tiers() * (n * 6 + (n - 2) * 3);
+  }
+
+  /*Writes vertexCount() vertices and indexCount() indices (triangles),
+  numbered from this building's first vertex. A plain or turned box is
+  the five faces of the box. Otherwise every tier is its footprint
+  extruded: a quad for each edge's wall and a fan for its roof. Walls
+  keep the box's window size, and the occlusion baked at the box's
+  corners is blended across each wall and roof from the box face that
+  faces the same way. Every wall fits a whole number of procedural
+  window columns across; roofs get column -1*/
+  void writeMesh(Vertex* vertices, GLuint* indices){
+	const GLuint quad[6] = {0, 1, 2, 0, 2, 3};
+	if(boxed()){
+		float columns = windowColumns(2.0f * _size);
+		for(int f = 0; f < FACES; f++){
+			glm::vec3 n = normal(f);
+			for(int c = 0; c < 4; c++){
+				const Corner& corner = corners(f)[c];
+				setVertex(vertices[f * 4 + c], position(f, c), n, corner.u, corner.v, f == FACES - 1 ? -1.0f : corner.u * columns,
+					_occlusion[f][c]);
+			}
+			for(int i = 0; i < 6; i++){
+				indices[f * 6 + i] = f * 4 + quad[i];
+			}
+		}
+		return;
+	}
+	float outline[MAX_CORNERS][2];
+	int n = footprint(outline);
+	int tiers = this->tiers();
+	int v = 0;
+	int i = 0;
+	for(int t = 0; t < tiers; t++){
+		float scale = 1.0f - 0.4f * t / tiers;//Each tier set back from the one below
+		float bottom = float(t) / tiers;
+		float top = float(t + 1) / tiers;
+		for(int e = 0; e < n; e++){
+			glm::vec2 a = scale * glm::vec2(outline[e][0], outline[e][1]);
+			glm::vec2 b = scale * glm::vec2(outline[(e + 1) % n][0], outline[(e + 1) % n][1]);
+			//The edges run anticlockwise seen from above, so this points out
+			glm::vec2 out = glm::normalize(glm::vec2(a.y - b.y, b.x - a.x));
+			int f = out.y > 0.5f ? 0 : out.x > 0.5f ? 1 : out.x < -0.5f ? 2 : 3;
+			glm::vec3 wallNormal = turn(glm::vec3(out.x, 0.0f, out.y));
+			float u = 0.5f * glm::distance(a, b);
+			float columns = windowColumns(2.0f * u * _size);
+			const glm::vec3 wall[4] = {glm::vec3(a.x, top, a.y), glm::vec3(a.x, bottom, a.y),
+				glm::vec3(b.x, bottom, b.y), glm::vec3(b.x, top, b.y)};
+			for(int c = 0; c < 4; c++){
+				setVertex(vertices[v + c], place(wall[c]), wallNormal, c < 2 ? 0.0f : u, 1.0f - wall[c].y,
+					c < 2 ? 0.0f : columns, occlusionAt(f, wall[c]));
+			}
+			for(int q = 0; q < 6; q++){
+				indices[i++] = v + quad[q];
+			}
+			v += 4;
+		}
+		//The roof has no texture of its own and reuses the last coordinate, like the box's
+		glm::vec3 up = normal(FACES - 1);
+		for(int c = 0; c < n; c++){
+			glm::vec3 p(scale * outline[c][0], top, scale * outline[c][1]);
+			setVertex(vertices[v + c], place(p), up, 1.0f, 0.0f, -1.0f, occlusionAt(FACES - 1, p));
+		}
+		for(int c = 1; c + 1 < n; c++){
+			indices[i++] = v;
+			indices[i++] = v + c;
+			indices[i++] = v + c + 1;
+		}
+		v += n;
+	}
+  }
+
+  //writeMesh() packed, see PackedVertex
+  void writeMesh(PackedVertex* vertices, GLuint* indices){
+	Vertex full[MAX_VERTICES];
+	writeMesh(full, indices);
+	glm::vec4 origin = packOrigin();
+	float perStep = 1.0f / origin.w;//Exact, the step is a power of two
+	int count = vertexCount();
+	for(int v = 0; v < count; v++){
+		pack(full[v], origin, perStep, vertices[v]);
+	}
+  }
+
+  /*Where the packed mesh's positions count from (the corner of the bounds)
+  and, in w, the size of a step: the smallest power of two from 1/1024 up
+  that reaches across the building*/
+  glm::vec4 packOrigin(){
+	glm::vec3 extent = boundsMax() - boundsMin();
+	float largest = std::max(extent.x, std::max(extent.y, extent.z));
+	float step = 1.0f / 1024.0f;
+	while(largest > POSITION_STEPS * step){
+		step *= 2.0f;
+	}
+	return glm::vec4(boundsMin(), step);
+  }
+
+  //Where corner c (0 to 3, in drawing order) of face f of the box is
+  glm::vec3 position(int f, int c){
+	const Corner& corner = corners(f)[c];
+	return place(glm::vec3(corner.x, corner.y, corner.z));
+  }
+
+  glm::vec3 normal(int f){
+	const glm::vec3 normals[FACES] = {
+		glm::vec3(0.0f, 0.0f, 1.0f),//Facing towards me -> Front facing
+		glm::vec3(1.0f, 0.0f, 0.0f),//Right facing
+		glm::vec3(-1.0f, 0.0f, 0.0f),//Left facing
+		glm::vec3(0.0f, 0.0f, -1.0f),//Facing away from me -> Rear facing
+		glm::vec3(0.0f, 1.0f, 0.0f)//Facing straight up -> Top facing
+	};
+	return turn(normals[f]);
+  }
+
+  /*1 where the corner of the box sees the whole sky, 0 where it is
+  completely hidden*/
+  void setOcclusion(int f, int c, float open){
+	_occlusion[f][c] = open;
+  }
+
+  float occlusion(int f, int c){
+	return _occlusion[f][c];
+  }
+
+  /*Moves and resizes the building in place. The occlusion baked for its
+  old shape is kept until it is baked again*/
+  void reshape(float x, float z, float size, float height, unsigned int layer, unsigned int shape){
+	_x = x;
+	_z = z;
+	_size = size;
+	_height = height;
+	_layer = layer;
+	setShape(shape);
+  }
+
+  float x(){
+	return _x;
+  }
+
+  float z(){
+	return _z;
+  }
+
+  float size(){
+	return _size;
+  }
+
+  float height(){
+	return _height;
+  }
+
+  unsigned int layer(){
+	return _layer;
+  }
+
+  unsigned int shape(){
+	return _shape;
+  }
+
+  //Axis aligned bounding box, used for culling
+  glm::vec3 boundsMin(){
+	float reach = _size * (fabs(_cos) + fabs(_sin));
+	return glm::vec3(_x - reach, 0.0f, _z - reach);
+  }
+
+  glm::vec3 boundsMax(){
+	float reach = _size * (fabs(_cos) + fabs(_sin));
+	return glm::vec3(_x + reach, _height, _z + reach);
   }
 
 private:
+  enum{L_SHAPED = 1 << 10};
+
   float _x;
   float _z;
   float _height;//This willl be the y-coordinate
   float _size;//Normally determines the width or depth of a building
-  int _noWindowsPerRow;
-  unsigned int _texture;
+  unsigned int _layer;//Layer of the facade texture array
+  unsigned int _shape;//From makeShape()
+  float _cos;//Of the shape's turn
+  float _sin;
+  float _occlusion[FACES][4];//Baked ambient occlusion of every corner of the box
+
+  /*Corners of the faces as signs of the half size in x and z, 0 or 1 times
+  the height in y, and the texture coordinate in windows*/
+  struct Corner{
+	signed char x, y, z, u, v;
+  };
+
+  static const Corner* corners(int f){
+	static const Corner table[FACES][4] = {
+		{{-1, 1, 1, 0, 0}, {-1, 0, 1, 0, 1}, {1, 0, 1, 1, 1}, {1, 1, 1, 1, 0}},//Front
+		{{1, 1, 1, 0, 0}, {1, 0, 1, 0, 1}, {1, 0, -1, 1, 1}, {1, 1, -1, 1, 0}},//Right
+		{{-1, 1, -1, 0, 0}, {-1, 0, -1, 0, 1}, {-1, 0, 1, 1, 1}, {-1, 1, 1, 1, 0}},//Left
+		{{-1, 0, -1, 0, 0}, {-1, 1, -1, 0, 1}, {1, 1, -1, 1, 1}, {1, 0, -1, 1, 0}},//Rear
+		//The roof has no texture of its own and reuses the last coordinate
+		{{-1, 1, -1, 1, 0}, {-1, 1, 1, 1, 0}, {1, 1, 1, 1, 0}, {1, 1, -1, 1, 0}}//Top
+	};
+	return table[f];
+  }
+
+  //Quarter turns are exact, so L shapes turned by them keep straight walls and bounds
+  void setShape(unsigned int shape){
+	_shape = shape;
+	unsigned int turn = shape & 1023;
+	if(turn % 256 == 0){
+		const float quarter[4][2] = {{1.0f, 0.0f}, {0.0f, 1.0f}, {-1.0f, 0.0f}, {0.0f, -1.0f}};
+		_cos = quarter[turn / 256][0];
+		_sin = quarter[turn / 256][1];
+	}else{
+		float angle = turn * 6.2831853f / 1024.0f;
+		_cos = cos(angle);
+		_sin = sin(angle);
+	}
+  }
+
+  //A plain or turned box, drawn as the five faces occlusion is baked on
+  bool boxed(){
+	return (_shape & ~1023u) == 0;
+  }
+
+  int tiers(){
+	return ((_shape >> 11) & 3) + 1;
+  }
+
+  int footprintCorners(){
+	return _shape & L_SHAPED ? 6 : 4;
+  }
+
+  /*Writes the footprint in halves of the size across, running the same
+  way as the box's walls, and returns how many corners it has. An L
+  starts at its inside corner, which sees every other one, so its roof
+  can be a fan from there*/
+  int footprint(float outline[MAX_CORNERS][2]){
+	if(!(_shape & L_SHAPED)){
+		const float square[4][2] = {{-1.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, -1.0f}, {-1.0f, -1.0f}};
+		for(int c = 0; c < 4; c++){
+			outline[c][0] = square[c][0];
+			outline[c][1] = square[c][1];
+		}
+		return 4;
+	}
+	float inside = 1.0f - 2.0f * (2 + ((_shape >> 13) & 7)) / 16.0f;//The notch takes the right rear corner
+	const float l[6][2] = {{inside, -inside}, {inside, -1.0f}, {-1.0f, -1.0f}, {-1.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, -inside}};
+	for(int c = 0; c < 6; c++){
+		outline[c][0] = l[c][0];
+		outline[c][1] = l[c][1];
+	}
+	return 6;
+  }
+
+  //A point of the box, in halves of the size across and fractions of the height up, turned and put in place
+  glm::vec3 place(const glm::vec3& p){
+	return glm::vec3((p.x * _cos - p.z * _sin) * _size + _x, p.y * _height, (p.x * _sin + p.z * _cos) * _size + _z);
+  }
+
+  glm::vec3 turn(const glm::vec3& n){
+	return glm::vec3(n.x * _cos - n.z * _sin, n.y, n.x * _sin + n.z * _cos);
+  }
+
+  //Occlusion at a point of the box (as for place()) blended from the corners of its face f
+  float occlusionAt(int f, const glm::vec3& p){
+	float open = 0.0f;
+	for(int c = 0; c < 4; c++){
+		const Corner& corner = corners(f)[c];
+		float weight = 1.0f;
+		if(f != 1 && f != 2){//x is the same all over the right and left faces
+			weight *= 0.5f + 0.5f * corner.x * p.x;
+		}
+		if(f != 0 && f != 3){
+			weight *= 0.5f + 0.5f * corner.z * p.z;
+		}
+		if(f != FACES - 1){
+			weight *= corner.y ? p.y : 1.0f - p.y;
+		}
+		open += weight * _occlusion[f][c];
+	}
+	return open;
+  }
+
+  //Columns of procedural windows across a wall this long, at least one
+  static float windowColumns(float length){
+	return std::max(1.0f, floorf(length * WINDOWS_PER_UNIT + 0.5f));
+  }
+
+  /*Picks the building's procedural facade. It comes from where the
+  building stands, so it is the same after saving and opening the city*/
+  unsigned int seed(){
+	uint32_t x, z;
+	memcpy(&x, &_x, sizeof(x));
+	memcpy(&z, &_z, sizeof(z));
+	uint32_t h = x * 0x9E3779B1u ^ (z + 0x7F4A7C15u) * 0x85EBCA77u;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	return h & 0xFFFFFF;
+  }
+
+  //Rounds to the nearest step. Everything is offset to be positive first, so truncating rounds
+  static void pack(const Vertex& v, const glm::vec4& origin, float perStep, PackedVertex& packed){
+	for(int a = 0; a < 3; a++){
+		float steps = std::min(std::max((v.position[a] - origin[a]) * perStep, 0.0f), float(POSITION_STEPS));
+		packed.position[a] = GLshort(steps + 0.5f);
+		packed.normal[a] = GLbyte(int(v.normal[a] * 127.0f + 128.5f) - 128);
+	}
+	packed.position[3] = 0;
+	packed.normal[3] = 0;
+	packed.texCoord[0] = GLshort(v.texCoord[0] * TEXCOORD_STEPS + 0.5f);//s and t are never negative
+	packed.texCoord[1] = GLshort(v.texCoord[1] * TEXCOORD_STEPS + 0.5f);
+	packed.texCoord[2] = GLshort(v.texCoord[2]);//Whole numbers, as are the columns
+	packed.texCoord[3] = GLshort(v.texCoord[3]);
+	for(int c = 0; c < 4; c++){
+		packed.color[c] = v.color[c];
+	}
+  }
+
+  void setVertex(Vertex& v, const glm::vec3& p, const glm::vec3& n, float u, float t, float column, float open){
+	v.position[0] = p.x;
+	v.position[1] = p.y;
+	v.position[2] = p.z;
+	v.normal[0] = n.x;
+	v.normal[1] = n.y;
+	v.normal[2] = n.z;
+	v.texCoord[0] = u;
+	v.texCoord[1] = t;
+	v.texCoord[2] = _layer;
+	v.texCoord[3] = column;
+	unsigned int seed = this->seed();
+	v.color[0] = GLubyte(seed);
+	v.color[1] = GLubyte(seed >> 8);
+	v.color[2] = GLubyte(seed >> 16);
+	v.color[3] = GLubyte(open * 255.0f + 0.5f);
+  }
 };
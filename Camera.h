@@ -3,11 +3,12 @@ public:
   Camera(glm::vec3 eyePos = glm::vec3(0.0f, 0.0f, 0.0f))//Initialized eyePos 
 	:_forward(glm::vec3(0.0f, 0.0f, -1.0f)),//Initialized forward
 	_worldUp(glm::vec3(0.0f, 1.0f, 0.0f)),//Initialied up 
-	_speed(1.0f),
+	_speed(60.0f),
 	_fovy(45.0f),
-	_rotationDelta(0.05f){
+	_rotationDelta(3.0f){
 	_position = eyePos;
 	updateCameraVectors();
+	saveState();
   }
 
   glm::mat4 getViewMatrix(){
@@ -16,6 +17,22 @@ public:
 	return glm::lookAt(_position, _position + _forward, _up);
   }
 
+  /*The view part way (alpha from 0 to 1) from the state saved by
+  saveState() to the current one, for drawing between update steps*/
+  glm::mat4 getViewMatrix(float alpha){
+	glm::vec3 position = glm::mix(_previousPosition, _position, alpha);
+	glm::vec3 forward = glm::normalize(glm::mix(_previousForward, _forward, alpha));
+	glm::vec3 up = glm::normalize(glm::mix(_previousUp, _up, alpha));
+	return glm::lookAt(position, position + forward, up);
+  }
+
+  //Call at the start of every update step, before moving
+  void saveState(){
+	_previousPosition = _position;
+	_previousForward = _forward;
+	_previousUp = _up;
+  }
+
   GLfloat getFovy(){
 	return _fovy;
   }
@@ -24,65 +41,82 @@ public:
 	return _position;
   }
 
-  void moveForwards(){
-	_position += _forward * _speed;
+  glm::vec3 getForward(){
+	return _forward;
   }
 
-  void moveBackwards(){
-	_position -= _forward * _speed;
+  void moveForwards(float dt){
+	_position += _forward * _speed * dt;
   }
 
-  void sideStepLeft(){
-	_position -= _right * _speed;
+  void moveBackwards(float dt){
+	_position -= _forward * _speed * dt;
   }
 
-  void sideStepRight(){
-	_position += _right * _speed;
+  void sideStepLeft(float dt){
+	_position -= _right * _speed * dt;
   }
 
-  void ascend(){
-	_position += _up * _speed;
+  void sideStepRight(float dt){
+	_position += _right * _speed * dt;
   }
 
-  void descend(){
-	_position -= _up * _speed;
+  void ascend(float dt){
+	_position += _up * _speed * dt;
   }
 
-  void rotateCameraUp(){
+  void descend(float dt){
+	_position -= _up * _speed * dt;
+  }
+
+  void rotateCameraUp(float dt){
 	//Create a rotation matrix that rotates about the right axis
-	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta, _right);
+	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta * dt, _right);
 	_up = rotationMatrix * _up;//Rotate the up and the forward
 	_forward = rotationMatrix * _forward;
   }
 
-  void rotateCameraDown(){
-	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta, _right);
+  void rotateCameraDown(float dt){
+	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta * dt, _right);
 	_up = rotationMatrix * _up;
 	_forward = rotationMatrix * _forward;
   }
 
-  void panCameraLeft(){
-	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta, _up);
+  void panCameraLeft(float dt){
+	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta * dt, _up);
 	//Rotate the gaze (forward) and the right
 	_forward = rotationMatrix * _forward;
 	_right = rotationMatrix * _right;
   }
 
-  void panCameraRight(){
-	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta, _up);
+  void panCameraRight(float dt){
+	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta * dt, _up);
 	_forward = rotationMatrix * _forward;
 	_right = rotationMatrix * _right;
   }
 
+  //Turns by yaw radians about up (positive is left) and pitch radians about right (positive is up)
+  void look(float yaw, float pitch){
+	glm::mat3 yawMatrix = glm::rotate(yaw, _up);
+	_forward = yawMatrix * _forward;
+	_right = yawMatrix * _right;
+	glm::mat3 pitchMatrix = glm::rotate(pitch, _right);
+	_forward = pitchMatrix * _forward;
+	_up = pitchMatrix * _up;
+  }
+
 private:
   glm::vec3 _position;//eyePosition
   glm::vec3 _forward;
   glm::vec3 _up;//Up vector
   glm::vec3 _right;
   glm::vec3 _worldUp;
-  GLfloat _speed;//Speed of strafe, forward, backward, ascend and descend
+  GLfloat _speed;//Speed of strafe, forward, backward, ascend and descend per second
   GLfloat _fovy;//a.k.a. zoom
-  GLfloat _rotationDelta;
+  GLfloat _rotationDelta;//Radians per second
+  glm::vec3 _previousPosition;//State at the start of the current update step
+  glm::vec3 _previousForward;
+  glm::vec3 _previousUp;
 
   void updateCameraVectors(){//Finds the orthonormal basis
 	_forward = glm::normalize(_forward);
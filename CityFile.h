@@ -0,0 +1,432 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: On-disk layout of a saved city (.city). Shared by Plane.h,
+which saves cities and opens them instead of generating one, and
+city_file.cpp, which converts them to and from text and checks them.
+
+The file is memory mapped and read in place: every table and column is
+at a fixed, aligned offset given in the header, so opening a city is a
+mmap and a bounds check, and processes opening the same file share its
+pages.
+*/
+
+#ifndef _CITYFILE_H_
+#define _CITYFILE_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/*A city file is laid out as:
+	CityFileHeader
+	CityFileTexture[textures]
+	CityFileBlock[blocks]
+	one column per building field, CITY_COLUMNS of them
+Each table and column starts on a 64 byte boundary. Buildings are stored
+block by block, so a block's buildings are a range of every column.
+Everything is little endian*/
+#define CITY_FILE_MAGIC "CITY"
+#define CITY_FILE_VERSION 2//1 had no shape column
+#define CITY_FILE_EXTENSION ".city"
+#define CITY_FILE_ALIGNMENT 64
+#define CITY_FILE_CORNERS 20//Occlusion bytes a building, 4 corners of 5 faces
+
+//The building columns, in file order
+enum{
+  CITY_X,//float, centre
+  CITY_Z,//float
+  CITY_SIZE,//float, half the width and depth
+  CITY_HEIGHT,//float
+  CITY_LAYER,//uint32_t, index into the texture table
+  CITY_SHAPE,//uint32_t, footprint from Building::makeShape(), 0 for a plain square box
+  CITY_OCCLUSION,//uint8_t[CITY_FILE_CORNERS], baked ambient occlusion from 0 (hidden) to 255 (open)
+  CITY_COLUMNS
+};
+
+struct CityFileHeader{
+  char magic[4];//"CITY"
+  uint32_t version;
+  uint32_t size;//Size of the plane the buildings stand on
+  uint32_t buildings;
+  uint32_t blocks;
+  uint32_t textures;
+  uint64_t textureOffset;//Each from the start of the file
+  uint64_t blockOffset;
+  uint64_t columnOffset[CITY_COLUMNS];
+  uint64_t fileSize;
+};
+
+//One facade style, in facade array layer order
+struct CityFileTexture{
+  char path[128];//Null terminated
+};
+
+//A range of buildings that are close together, with the box around them
+struct CityFileBlock{
+  uint32_t first;
+  uint32_t count;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+//A whole city in memory, column by column like the file, for writing one
+struct CityData{
+  uint32_t size;
+  std::vector<std::string> textures;
+  std::vector<CityFileBlock> blocks;
+  std::vector<float> x;
+  std::vector<float> z;
+  std::vector<float> buildingSize;
+  std::vector<float> height;
+  std::vector<uint32_t> layer;
+  std::vector<uint32_t> shape;
+  std::vector<uint8_t> occlusion;//CITY_FILE_CORNERS a building
+
+  CityData(): size(0){}
+
+  size_t buildings() const{
+	return x.size();
+  }
+};
+
+//Bytes of one entry of each column
+inline size_t cityColumnBytes(int column){
+	return column == CITY_OCCLUSION ? CITY_FILE_CORNERS : 4;
+}
+
+inline uint64_t cityAlign(uint64_t offset){
+	return (offset + CITY_FILE_ALIGNMENT - 1) / CITY_FILE_ALIGNMENT * CITY_FILE_ALIGNMENT;
+}
+
+/*True if count items of bytes each from offset end within length. The
+counts are 32 bit so the product can't overflow, but offset + product
+could with a bad offset, so it is never added*/
+inline bool cityRangeFits(uint64_t offset, uint64_t count, size_t bytes, uint64_t length){
+	return offset <= length && count * bytes <= length - offset;
+}
+
+/*Checks that a mapped file really is a city we understand, that every
+table and column lies inside it, and that the blocks and layers only
+refer to buildings and textures that are there. Given the mapping the
+data is in, pages are let go once checked, for a file that will be read
+only once*/
+inline bool validCityFile(const unsigned char* data, size_t length, MappedFile* once = NULL){
+	if(length < sizeof(CityFileHeader)){
+		return false;
+	}
+	const CityFileHeader* header = (const CityFileHeader*)data;
+	if(memcmp(header->magic, CITY_FILE_MAGIC, 4) != 0 || header->version != CITY_FILE_VERSION ||
+		header->fileSize != length || header->textures == 0){
+		return false;
+	}
+	if(header->textureOffset % CITY_FILE_ALIGNMENT || !cityRangeFits(header->textureOffset, header->textures, sizeof(CityFileTexture), length) ||
+		header->blockOffset % CITY_FILE_ALIGNMENT || !cityRangeFits(header->blockOffset, header->blocks, sizeof(CityFileBlock), length)){
+		return false;
+	}
+	for(int c = 0; c < CITY_COLUMNS; c++){
+		if(header->columnOffset[c] % CITY_FILE_ALIGNMENT ||
+			!cityRangeFits(header->columnOffset[c], header->buildings, cityColumnBytes(c), length)){
+			return false;
+		}
+	}
+	const CityFileTexture* textures = (const CityFileTexture*)(data + header->textureOffset);
+	for(uint32_t i = 0; i < header->textures; i++){
+		if(memchr(textures[i].path, 0, sizeof(textures[i].path)) == NULL){
+			return false;
+		}
+	}
+	//Blocks must cover the buildings in order without gaps
+	const CityFileBlock* blocks = (const CityFileBlock*)(data + header->blockOffset);
+	uint64_t next = 0;
+	for(uint32_t i = 0; i < header->blocks; i++){
+		if(blocks[i].first != next){
+			return false;
+		}
+		next += blocks[i].count;
+		if(once && (i + 1) % 65536 == 0){
+			once->release(header->blockOffset, (i + 1) * sizeof(CityFileBlock));
+		}
+	}
+	if(next != header->buildings){
+		return false;
+	}
+	const uint32_t* layers = (const uint32_t*)(data + header->columnOffset[CITY_LAYER]);
+	for(uint32_t i = 0; i < header->buildings; i++){
+		if(layers[i] >= header->textures){
+			return false;
+		}
+		if(once && (i + 1) % 262144 == 0){
+			once->release(header->columnOffset[CITY_LAYER], (i + 1) * 4);
+		}
+	}
+	return true;
+}
+
+//Where everything goes in a file of this many buildings, blocks and textures
+inline CityFileHeader cityLayout(uint32_t size, uint32_t buildings, uint32_t blocks, uint32_t textures){
+	CityFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CITY_FILE_MAGIC, 4);
+	header.version = CITY_FILE_VERSION;
+	header.size = size;
+	header.buildings = buildings;
+	header.blocks = blocks;
+	header.textures = textures;
+	uint64_t offset = cityAlign(sizeof(CityFileHeader));
+	header.textureOffset = offset;
+	offset = cityAlign(offset + header.textures * sizeof(CityFileTexture));
+	header.blockOffset = offset;
+	offset = cityAlign(offset + header.blocks * sizeof(CityFileBlock));
+	for(int c = 0; c < CITY_COLUMNS; c++){
+		header.columnOffset[c] = offset;
+		offset = cityAlign(offset + header.buildings * cityColumnBytes(c));
+	}
+	header.fileSize = offset;
+	return header;
+}
+
+//Where everything goes in the file for city
+inline CityFileHeader cityLayout(const CityData& city){
+	return cityLayout(city.size, city.buildings(), city.blocks.size(), city.textures.size());
+}
+
+//The columns of city in file order
+inline const void* cityColumn(const CityData& city, int column){
+	switch(column){
+	case CITY_X:
+		return &city.x[0];
+	case CITY_Z:
+		return &city.z[0];
+	case CITY_SIZE:
+		return &city.buildingSize[0];
+	case CITY_HEIGHT:
+		return &city.height[0];
+	case CITY_LAYER:
+		return &city.layer[0];
+	case CITY_SHAPE:
+		return &city.shape[0];
+	default:
+		return &city.occlusion[0];
+	}
+}
+
+/*The file's bytes for a city. Padding is zeroed, so the same city always
+gives the same bytes*/
+inline void serializeCity(const CityData& city, std::vector<unsigned char>& bytes){
+	CityFileHeader header = cityLayout(city);
+	bytes.assign(header.fileSize, 0);
+	memcpy(&bytes[0], &header, sizeof(header));
+	for(uint32_t i = 0; i < header.textures; i++){
+		CityFileTexture* texture = (CityFileTexture*)&bytes[header.textureOffset + i * sizeof(CityFileTexture)];
+		strncpy(texture->path, city.textures[i].c_str(), sizeof(texture->path) - 1);
+	}
+	if(header.blocks){
+		memcpy(&bytes[header.blockOffset], &city.blocks[0], header.blocks * sizeof(CityFileBlock));
+	}
+	for(int c = 0; header.buildings && c < CITY_COLUMNS; c++){
+		memcpy(&bytes[header.columnOffset[c]], cityColumn(city, c), header.buildings * cityColumnBytes(c));
+	}
+}
+
+/*Writes a city file a piece at a time, for cities that are never all in
+memory at once. The counts are given up front; then the blocks and the
+buildings are added in file order, in pieces of any size, each going
+straight to its place in its table or column. The gaps between them are
+left to read as zeros, so the file has the same bytes as serializeCity()
+would give. Check close() to know it all got written*/
+class CityFileWriter{
+public:
+  CityFileWriter(const char* path, uint32_t size, const std::vector<std::string>& textures, uint32_t buildings, uint32_t blocks):
+	_file(fopen(path, "wb")),
+	_header(cityLayout(size, buildings, blocks, textures.size())),
+	_blocks(0),
+	_buildings(0){
+	_ok = _file && fwrite(&_header, sizeof(_header), 1, _file) == 1;
+	for(uint32_t i = 0; _ok && i < _header.textures; i++){
+		CityFileTexture texture;
+		memset(texture.path, 0, sizeof(texture.path));
+		strncpy(texture.path, textures[i].c_str(), sizeof(texture.path) - 1);
+		_ok = write(_header.textureOffset + i * sizeof(CityFileTexture), &texture, sizeof(texture));
+	}
+  }
+
+  ~CityFileWriter(){
+	if(_file){
+		fclose(_file);
+	}
+  }
+
+  const CityFileHeader& header() const{
+	return _header;
+  }
+
+  //The next count blocks
+  bool addBlocks(const CityFileBlock* blocks, uint32_t count){
+	if(count == 0){
+		return _ok;
+	}
+	_ok = _ok && _blocks + count <= _header.blocks &&
+		write(_header.blockOffset + _blocks * sizeof(CityFileBlock), blocks, count * sizeof(CityFileBlock));
+	_blocks += count;
+	return _ok;
+  }
+
+  //The next buildings, every one in city's columns; its blocks are left alone
+  bool addBuildings(const CityData& city){
+	uint32_t count = city.buildings();
+	if(count == 0){
+		return _ok;
+	}
+	_ok = _ok && _buildings + count <= _header.buildings;
+	for(int c = 0; _ok && c < CITY_COLUMNS; c++){
+		_ok = write(_header.columnOffset[c] + _buildings * cityColumnBytes(c), cityColumn(city, c), count * cityColumnBytes(c));
+	}
+	_buildings += count;
+	return _ok;
+  }
+
+  //Pads the file to its full size. False if anything failed or went missing
+  bool close(){
+	if(!_file){
+		return false;
+	}
+	bool ok = _ok && _blocks == _header.blocks && _buildings == _header.buildings &&
+		fflush(_file) == 0 && ftruncate(fileno(_file), _header.fileSize) == 0;
+	ok = fclose(_file) == 0 && ok;
+	_file = NULL;
+	return ok;
+  }
+
+private:
+  FILE* _file;
+  CityFileHeader _header;
+  uint64_t _blocks;//Added so far
+  uint64_t _buildings;
+  bool _ok;
+
+  bool write(uint64_t offset, const void* data, uint64_t bytes){
+	return fseeko(_file, offset, SEEK_SET) == 0 && fwrite(data, 1, bytes, _file) == bytes;
+  }
+
+  CityFileWriter(const CityFileWriter&);//Owns the file, not copyable
+  CityFileWriter& operator=(const CityFileWriter&);
+};
+
+//Writes the same bytes as serializeCity() straight from the columns
+inline bool writeCityFile(const char* path, const CityData& city){
+	CityFileWriter writer(path, city.size, city.textures, city.buildings(), city.blocks.size());
+	writer.addBlocks(city.blocks.empty() ? NULL : &city.blocks[0], city.blocks.size());
+	writer.addBuildings(city);
+	return writer.close();
+}
+
+//A mapped city file, read in place. Check isOpen() before using anything else
+class CityFile{
+public:
+  CityFile(const char* path, MappedFile::hint_t hint = MappedFile::WILLNEED): _file(path, hint){
+	bool once = hint == MappedFile::SEQUENTIAL;
+	_valid = _file.isOpen() && validCityFile(_file.data(), _file.size(), once ? &_file : NULL);
+	if(once){
+		_file.release(0, _file.size());//Checking it was a read of its own
+	}
+  }
+
+  bool isOpen() const{
+	return _valid;
+  }
+
+  const CityFileHeader& header() const{
+	return *(const CityFileHeader*)_file.data();
+  }
+
+  const char* texture(uint32_t i) const{
+	return ((const CityFileTexture*)(_file.data() + header().textureOffset))[i].path;
+  }
+
+  const CityFileBlock* blocks() const{
+	return (const CityFileBlock*)(_file.data() + header().blockOffset);
+  }
+
+  const float* x() const{
+	return (const float*)column(CITY_X);
+  }
+
+  const float* z() const{
+	return (const float*)column(CITY_Z);
+  }
+
+  const float* size() const{
+	return (const float*)column(CITY_SIZE);
+  }
+
+  const float* height() const{
+	return (const float*)column(CITY_HEIGHT);
+  }
+
+  const uint32_t* layer() const{
+	return (const uint32_t*)column(CITY_LAYER);
+  }
+
+  const uint32_t* shape() const{
+	return (const uint32_t*)column(CITY_SHAPE);
+  }
+
+  //CITY_FILE_CORNERS bytes for building i
+  const uint8_t* occlusion(uint32_t i) const{
+	return column(CITY_OCCLUSION) + (size_t)i * CITY_FILE_CORNERS;
+  }
+
+  //Copies everything out, e.g. to change it and write it again
+  void read(CityData& city) const{
+	const CityFileHeader& h = header();
+	city.size = h.size;
+	city.textures.clear();
+	for(uint32_t i = 0; i < h.textures; i++){
+		city.textures.push_back(texture(i));
+	}
+	city.blocks.assign(blocks(), blocks() + h.blocks);
+	city.x.assign(x(), x() + h.buildings);
+	city.z.assign(z(), z() + h.buildings);
+	city.buildingSize.assign(size(), size() + h.buildings);
+	city.height.assign(height(), height() + h.buildings);
+	city.layer.assign(layer(), layer() + h.buildings);
+	city.shape.assign(shape(), shape() + h.buildings);
+	city.occlusion.assign(occlusion(0), occlusion(0) + (size_t)h.buildings * CITY_FILE_CORNERS);
+  }
+
+  /*For reading a city once from start to end: lets go of the pages
+  holding blocks first to first + count - 1 and their buildings, which
+  stay readable*/
+  void release(uint32_t first, uint32_t count){
+	if(count == 0){
+		return;
+	}
+	const CityFileBlock& last = blocks()[first + count - 1];
+	uint32_t firstBuilding = blocks()[first].first;
+	uint32_t buildings = last.first + last.count - firstBuilding;
+	_file.release(header().blockOffset + first * sizeof(CityFileBlock), count * sizeof(CityFileBlock));
+	for(int c = 0; c < CITY_COLUMNS; c++){
+		_file.release(header().columnOffset[c] + firstBuilding * cityColumnBytes(c), buildings * cityColumnBytes(c));
+	}
+  }
+
+private:
+  MappedFile _file;
+  bool _valid;
+
+  const uint8_t* column(int c) const{
+	return _file.data() + header().columnOffset[c];
+  }
+
+  CityFile(const CityFile&);//Owns the mapping, not copyable
+  CityFile& operator=(const CityFile&);
+};
+
+#endif
@@ -0,0 +1,657 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: GPU driven drawing of a Plane's buildings (OpenGL 4.3).
+
+Every building's mesh goes into one vertex and one index buffer, and its
+bounds and index range into a storage buffer. Each frame a compute
+shader (shaders/cull_buildings.comp.glsl) tests every building against
+the view frustum and writes a DrawElementsIndirectCommand for it, and
+one glMultiDrawElementsIndirect draws the lot. The CPU's part is a
+uniform upload, a dispatch and a draw, whatever the number of buildings.
+
+With ARB_indirect_parameters the visible commands are packed together
+and counted on the GPU, so hidden buildings cost no draws at all.
+Without it every building keeps a command and hidden ones are drawn
+with 0 instances.
+
+The same mesh is also drawn with commands culled on the CPU and
+streamed through a RingBuffer (drawVisible), e.g. for the shadow
+cascades, which skips the per building immediate mode calls.
+
+The vertices are stored packed (Building::PackedVertex), 24 bytes each
+instead of 44: positions are 16 bit steps from the building's origin,
+which the vertex shader reads from the building's record as an
+attribute that advances once per instance.
+
+The meshes are built on every hardware thread, each writing whole
+buildings straight into the arrays that are uploaded: their ranges are
+handed out first, so no thread needs memory of its own or waits on
+another.
+
+Buildings can be placed, updated and freed one at a time. Their ranges
+of the two buffers come from BufferAllocators, so an edit is a couple of
+glBufferSubData calls of one building's size, never a re-upload of the
+city. The holes freeing leaves are filled by compact(), which moves a
+few meshes from the end of a buffer down into them every frame.
+*/
+
+class CityMesh{
+public:
+  //Multi-draw-indirect, compute shaders and storage buffers are all core in 4.3
+  static bool supported(){
+	return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_compute_shader &&
+		GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_base_instance);
+  }
+
+  /*Places every building, numbered by its index in buildings, with one
+  upload. The buffers are made a quarter bigger so edits have room*/
+  CityMesh(std::vector<Building*>& buildings):
+	_vertexAllocator(meshSize(buildings, false) * 5 / 4 + Building::MAX_VERTICES),
+	_indexAllocator(meshSize(buildings, true) * 5 / 4 + Building::MAX_INDICES),
+	_recordCapacity(0),
+	_countSupported(GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters),
+	_edits(0),
+	_editSeconds(0.0),
+	_moves(0){
+	std::vector<Building::PackedVertex> vertices(_vertexAllocator.capacity());
+	std::vector<GLuint> indices(_indexAllocator.capacity());
+	_records.reserve(buildings.size());
+	_handleOf.reserve(buildings.size());
+	_recordOf.reserve(buildings.size());
+	//Laid out in building order and taken from the allocators as one range each, which free() gives back a building at a time
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for(unsigned int i = 0; i < buildings.size(); i++){
+		DrawRecord record;
+		record.baseVertex = vertexCount;
+		record.vertexCount = buildings[i]->vertexCount();
+		record.firstIndex = indexCount;
+		record.count = buildings[i]->indexCount();
+		vertexCount += record.vertexCount;
+		indexCount += record.count;
+		setBounds(record, *buildings[i]);
+		addRecord(record);
+	}
+	size_t vertexOffset, indexOffset;//Both 0, the allocators being empty
+	_vertexAllocator.allocate(vertexCount, vertexOffset);
+	_indexAllocator.allocate(indexCount, indexOffset);
+	//Writing the meshes should only allocate for the threads, however many buildings there are
+	AllocationCounts& counts = allocationCounts();
+	size_t allocations = counts.allocations;
+	size_t bytes = counts.bytes;
+	counts.resetPeak();
+	double start = glfwGetTime();
+	unsigned int threads = writeMeshes(buildings, &vertices[0], &indices[0]);
+	double seconds = glfwGetTime() - start;
+	allocations = counts.allocations - allocations;
+	size_t peak = counts.peak - bytes;
+
+	glGenVertexArrays(1, &_VAO);
+	glGenBuffers(1, &_vertexBuffer);
+	glGenBuffers(1, &_indexBuffer);
+	glGenBuffers(1, &_recordBuffer);
+	glGenBuffers(1, &_commandBuffer);
+	glGenBuffers(1, &_countBuffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Building::PackedVertex), vertices.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	setArrays();
+	//The command buffer is written by the compute shader and read by the draw, never by the CPU
+	growRecords(std::max<size_t>(1, _records.size()));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if(!loadComputeProgram(_cullProgram, "shaders/cull_buildings.comp.glsl")){
+		exit(1);
+	}
+	_uPlanes = glGetUniformLocation(_cullProgram.id(), "planes");
+	_uBuildings = glGetUniformLocation(_cullProgram.id(), "buildings");
+	_uCompact = glGetUniformLocation(_cullProgram.id(), "compact");
+
+	size_t triangles = _indexAllocator.used() / 3;
+	printf("City mesh: %zu buildings, %zu triangles built in %.1f ms on %u threads (%.1f M triangles/s) with %zu allocations "
+		"(at most %.1f KB more in use), %.1f MB of vertices (%zu bytes each) and %.1f MB of indices, %s\n",
+		_records.size(), triangles, 1000.0 * seconds, threads, triangles / std::max(1e-9, seconds) / 1e6, allocations, peak / 1024.0,
+		vertices.size() * sizeof(Building::PackedVertex) / 1048576.0, sizeof(Building::PackedVertex),
+		indices.size() * sizeof(GLuint) / 1048576.0,
+		_countSupported ? "visible draws counted on the GPU" : "hidden draws skipped with 0 instances");
+  }
+
+  virtual ~CityMesh(){
+	glDeleteVertexArrays(1, &_VAO);
+	glDeleteBuffers(1, &_vertexBuffer);
+	glDeleteBuffers(1, &_indexBuffer);
+	glDeleteBuffers(1, &_recordBuffer);
+	glDeleteBuffers(1, &_commandBuffer);
+	glDeleteBuffers(1, &_countBuffer);
+  }
+
+  /*Culls the buildings against the frustum and draws the visible ones with the
+  program that is active when this is called. The facade array must be bound*/
+  void draw(const Frustum& frustum){
+	if(_records.empty()){
+		return;
+	}
+	GLint drawProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &drawProgram);
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glUseProgram(_cullProgram.id());
+	glUniform4fv(_uPlanes, 6, glm::value_ptr(frustum.plane(0)));
+	glUniform1ui(_uBuildings, _records.size());
+	glUniform1i(_uCompact, _countSupported);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _recordBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _countBuffer);
+	glDispatchCompute((_records.size() + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+	//The draw reads the commands and the count as indirect arguments
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	glUseProgram(drawProgram);
+
+	glBindVertexArray(_VAO);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	if(_countSupported){
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, _countBuffer);
+		glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, _records.size(), 0);
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}else{
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, _records.size(), 0);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+  }
+
+  /*Culls on the CPU and draws the buildings inside the frustum with commands
+  written into stream. Returns how many were drawn, or -1 if stream was full
+  and nothing was drawn*/
+  int drawVisible(const Frustum& frustum, RingBuffer* stream){
+	GLintptr offset = 0;
+	Command* commands = (Command*)stream->allocate(_records.size() * sizeof(Command), offset);
+	if(!commands){
+		return -1;
+	}
+	GLsizei drawn = 0;
+	for(size_t i = 0; i < _records.size(); i++){
+		const DrawRecord& record = _records[i];
+		if(frustum.intersects(glm::vec3(record.boundsMin), glm::vec3(record.boundsMax))){
+			Command& command = commands[drawn++];
+			command.count = record.count;
+			command.instanceCount = 1;
+			command.firstIndex = record.firstIndex;
+			command.baseVertex = record.baseVertex;
+			command.baseInstance = i;
+		}
+	}
+	if(drawn > 0){
+		glBindVertexArray(_VAO);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream->buffer());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)offset, drawn, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+	return drawn;
+  }
+
+  //Adds a building's mesh and returns the number to update() or free() it with
+  int place(Building& building){
+	double start = glfwGetTime();
+	DrawRecord record;
+	if(!allocate(record, building)){
+		growBuffers();
+		allocate(record, building);
+	}
+	setBounds(record, building);
+	writeMesh(record, building);
+	int handle = addRecord(record);
+	if(_records.size() > _recordCapacity){
+		growRecords(2 * _recordCapacity);
+	}else{
+		uploadRecord(_records.size() - 1);
+	}
+	edited(start);
+	return handle;
+  }
+
+  /*Adds several buildings' meshes, handles[i] going with buildings[i].
+  They are given one range of each buffer, so the meshes and the records
+  are each a single upload; if no free range is big enough for all of
+  them they are placed one at a time instead*/
+  void placeAll(const std::vector<Building*>& buildings, std::vector<int>& handles){
+	handles.resize(buildings.size());
+	if(buildings.empty()){
+		return;
+	}
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for(size_t i = 0; i < buildings.size(); i++){
+		vertexCount += buildings[i]->vertexCount();
+		indexCount += buildings[i]->indexCount();
+	}
+	size_t vertexOffset, indexOffset;
+	if(!_vertexAllocator.allocate(vertexCount, vertexOffset)){
+		for(size_t i = 0; i < buildings.size(); i++){
+			handles[i] = place(*buildings[i]);
+		}
+		return;
+	}
+	if(!_indexAllocator.allocate(indexCount, indexOffset)){
+		_vertexAllocator.free(vertexOffset, vertexCount);
+		for(size_t i = 0; i < buildings.size(); i++){
+			handles[i] = place(*buildings[i]);
+		}
+		return;
+	}
+	double start = glfwGetTime();
+	_vertexScratch.resize(vertexCount);
+	_indexScratch.resize(indexCount);
+	size_t firstRecord = _records.size();
+	size_t vertex = 0;
+	size_t index = 0;
+	for(size_t i = 0; i < buildings.size(); i++){
+		//Each building's part of the ranges is its own, for free() to give back
+		DrawRecord record;
+		record.baseVertex = vertexOffset + vertex;
+		record.vertexCount = buildings[i]->vertexCount();
+		record.firstIndex = indexOffset + index;
+		record.count = buildings[i]->indexCount();
+		buildings[i]->writeMesh(&_vertexScratch[vertex], &_indexScratch[index]);
+		vertex += record.vertexCount;
+		index += record.count;
+		setBounds(record, *buildings[i]);
+		handles[i] = addRecord(record);
+	}
+	if(vertexCount > 0){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(Building::PackedVertex),
+			vertexCount * sizeof(Building::PackedVertex), &_vertexScratch[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLuint), indexCount * sizeof(GLuint), &_indexScratch[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	if(_records.size() > _recordCapacity){
+		growRecords(std::max(2 * _recordCapacity, _records.size()));
+	}else{
+		uploadRecords(firstRecord, _records.size());
+	}
+	edited(start, buildings.size());
+  }
+
+  /*Rewrites a placed building's mesh and bounds, where they are unless a
+  new shape changed the mesh's size*/
+  void update(int handle, Building& building){
+	double start = glfwGetTime();
+	int r = _recordOf[handle];
+	if(_records[r].vertexCount != (GLuint)building.vertexCount() || _records[r].count != (GLuint)building.indexCount()){
+		release(_records[r]);
+		if(!allocate(_records[r], building)){
+			growBuffers();
+			allocate(_records[r], building);
+		}
+		_vertexOwners[_records[r].baseVertex] = handle;
+		_indexOwners[_records[r].firstIndex] = handle;
+	}
+	setBounds(_records[r], building);
+	writeMesh(_records[r], building);
+	uploadRecord(r);
+	edited(start);
+  }
+
+  /*Gives the building's ranges back. The last record takes its place, so
+  the records the compute shader reads stay packed*/
+  void free(int handle){
+	double start = glfwGetTime();
+	int r = _recordOf[handle];
+	release(_records[r]);
+	int last = _records.size() - 1;
+	if(r != last){
+		_records[r] = _records[last];
+		_handleOf[r] = _handleOf[last];
+		_recordOf[_handleOf[r]] = r;
+		uploadRecord(r);
+	}
+	_records.pop_back();
+	_handleOf.pop_back();
+	_recordOf[handle] = -1;
+	_freeHandles.push_back(handle);
+	edited(start);
+  }
+
+  /*Gives several buildings' ranges back. The records that take the freed
+  ones' places are uploaded together at the end*/
+  void freeAll(const std::vector<int>& handles){
+	double start = glfwGetTime();
+	size_t low = _records.size();//Records changed, from low to high
+	size_t high = 0;
+	for(size_t i = 0; i < handles.size(); i++){
+		int r = _recordOf[handles[i]];
+		release(_records[r]);
+		int last = _records.size() - 1;
+		if(r != last){
+			_records[r] = _records[last];
+			_handleOf[r] = _handleOf[last];
+			_recordOf[_handleOf[r]] = r;
+			low = std::min<size_t>(low, r);
+			high = std::max<size_t>(high, r + 1);
+		}
+		_records.pop_back();
+		_handleOf.pop_back();
+		_recordOf[handles[i]] = -1;
+		_freeHandles.push_back(handles[i]);
+	}
+	//Records past the end are gone, not changed
+	high = std::min(high, _records.size());
+	if(low < high){
+		uploadRecords(low, high);
+	}
+	edited(start, handles.size());
+  }
+
+  /*Moves up to moves meshes from the end of the vertex and index buffers
+  into the lowest holes that fit them. A GPU side copy each, so running
+  it every frame keeps the buffers packed without a frame ever paying for
+  all of it. Meshes differ in size, so one too big for any hole below it
+  is passed over for the ones under it, up to moves of them. Returns how
+  many were moved*/
+  int compact(int moves){
+	int moved = 0;
+	int passed = 0;
+	for(std::map<size_t, int>::iterator it = _vertexOwners.end(); moved < moves && passed < moves && it != _vertexOwners.begin();){
+		--it;
+		size_t from = it->first;
+		int r = _recordOf[it->second];
+		size_t to;
+		if(!_vertexAllocator.allocateBelow(_records[r].vertexCount, from, to)){
+			passed++;
+			continue;
+		}
+		copy(_vertexBuffer, from * sizeof(Building::PackedVertex), to * sizeof(Building::PackedVertex), _records[r].vertexCount * sizeof(Building::PackedVertex));
+		_vertexAllocator.free(from, _records[r].vertexCount);
+		_vertexOwners.erase(it);
+		_vertexOwners[to] = _handleOf[r];
+		it = _vertexOwners.lower_bound(from);//Just above where it was
+		_records[r].baseVertex = to;
+		uploadRecord(r);
+		moved++;
+	}
+	passed = 0;
+	for(std::map<size_t, int>::iterator it = _indexOwners.end(); moved < moves && passed < moves && it != _indexOwners.begin();){
+		--it;
+		size_t from = it->first;
+		int r = _recordOf[it->second];
+		size_t to;
+		if(!_indexAllocator.allocateBelow(_records[r].count, from, to)){
+			passed++;
+			continue;
+		}
+		copy(_indexBuffer, from * sizeof(GLuint), to * sizeof(GLuint), _records[r].count * sizeof(GLuint));
+		_indexAllocator.free(from, _records[r].count);
+		_indexOwners.erase(it);
+		_indexOwners[to] = _handleOf[r];
+		it = _indexOwners.lower_bound(from);
+		_records[r].firstIndex = to;
+		uploadRecord(r);
+		moved++;
+	}
+	_moves += moved;
+	return moved;
+  }
+
+  //Prints how full and broken up the buffers are and what the edits cost since the last report
+  void report(){
+	printf("City mesh: %zu buildings, %.1f of %.1f MB of vertices in %zu free ranges, %d edits averaging %.1f us, %d meshes moved by compaction\n",
+		_records.size(), _vertexAllocator.used() * sizeof(Building::PackedVertex) / 1048576.0,
+		_vertexAllocator.capacity() * sizeof(Building::PackedVertex) / 1048576.0, _vertexAllocator.ranges(),
+		_edits, _edits > 0 ? 1000000.0 * _editSeconds / _edits : 0.0, _moves);
+	_edits = 0;
+	_editSeconds = 0.0;
+	_moves = 0;
+  }
+
+private:
+  enum{GROUP_SIZE = 64};//local_size_x of the compute shader
+  enum{BUILD_BATCH = 256};//Buildings a thread takes at a time when building the meshes
+
+  //Matches DrawRecord in the compute shader (std430)
+  struct DrawRecord{
+	glm::vec4 boundsMin;//w is the step of the building's packed positions, see Building::packOrigin()
+	glm::vec4 boundsMax;
+	GLuint count;
+	GLuint firstIndex;
+	GLuint baseVertex;
+	GLuint vertexCount;//Only for the allocator, the shader skips it
+  };
+
+  //DrawElementsIndirectCommand
+  struct Command{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLuint baseVertex;
+	GLuint baseInstance;
+  };
+
+  BufferAllocator _vertexAllocator;//In vertices
+  BufferAllocator _indexAllocator;//In indices
+  std::vector<DrawRecord> _records;//Also kept on the CPU for drawVisible()
+  size_t _recordCapacity;//Records the record and command buffers have room for
+  std::vector<int> _recordOf;//Record of each handle, -1 once freed
+  std::vector<int> _handleOf;//Handle of each record
+  std::vector<int> _freeHandles;
+  std::map<size_t, int> _vertexOwners;//Handle placed at each vertex offset, for compact()
+  std::map<size_t, int> _indexOwners;
+  std::vector<Building::PackedVertex> _vertexScratch;//Meshes on their way to the GPU, one building's or placeAll()'s
+  std::vector<GLuint> _indexScratch;
+  bool _countSupported;//ARB_indirect_parameters
+  GLuint _VAO;
+  GLuint _vertexBuffer;
+  GLuint _indexBuffer;
+  GLuint _recordBuffer;
+  GLuint _commandBuffer;
+  GLuint _countBuffer;
+  GLSLProgram _cullProgram;
+  GLint _uPlanes;
+  GLint _uBuildings;
+  GLint _uCompact;
+  int _edits;
+  double _editSeconds;
+  int _moves;
+
+  //Vertices (or indices) of all the buildings' meshes
+  static size_t meshSize(std::vector<Building*>& buildings, bool indices){
+	size_t size = 0;
+	for(unsigned int i = 0; i < buildings.size(); i++){
+		size += indices ? buildings[i]->indexCount() : buildings[i]->vertexCount();
+	}
+	return size;
+  }
+
+  /*Writes building i's mesh into its record's ranges of vertices and
+  indices, a batch of buildings at a time on every hardware thread.
+  The ranges never overlap, so the threads share nothing but the counter.
+  Returns how many threads there were*/
+  unsigned int writeMeshes(std::vector<Building*>& buildings, Building::PackedVertex* vertices, GLuint* indices){
+	std::atomic<size_t> next(0);
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for(unsigned int t = 0; t < threads; t++){
+		workers.push_back(std::thread([&](){
+			for(size_t first = next.fetch_add(BUILD_BATCH); first < buildings.size(); first = next.fetch_add(BUILD_BATCH)){
+				size_t last = std::min<size_t>(first + BUILD_BATCH, buildings.size());
+				for(size_t i = first; i < last; i++){
+					buildings[i]->writeMesh(vertices + _records[i].baseVertex, indices + _records[i].firstIndex);
+				}
+			}
+		}));
+	}
+	for(unsigned int t = 0; t < threads; t++){
+		workers[t].join();
+	}
+	return threads;
+  }
+
+  //Ranges for building's mesh, false (with nothing taken) if a buffer is full
+  bool allocate(DrawRecord& record, Building& building){
+	size_t vertices = building.vertexCount();
+	size_t indices = building.indexCount();
+	size_t vertex, index;
+	if(!_vertexAllocator.allocate(vertices, vertex)){
+		return false;
+	}
+	if(!_indexAllocator.allocate(indices, index)){
+		_vertexAllocator.free(vertex, vertices);
+		return false;
+	}
+	record.baseVertex = vertex;
+	record.vertexCount = vertices;
+	record.firstIndex = index;
+	record.count = indices;
+	return true;
+  }
+
+  //Gives the record's ranges back to the allocators
+  void release(const DrawRecord& record){
+	_vertexOwners.erase(record.baseVertex);
+	_indexOwners.erase(record.firstIndex);
+	_vertexAllocator.free(record.baseVertex, record.vertexCount);
+	_indexAllocator.free(record.firstIndex, record.count);
+  }
+
+  void setBounds(DrawRecord& record, Building& building){
+	record.boundsMin = building.packOrigin();
+	record.boundsMax = glm::vec4(building.boundsMax(), 1.0f);
+  }
+
+  //Gives the record a handle (a freed one if there is one) and returns it
+  int addRecord(const DrawRecord& record){
+	int handle;
+	if(_freeHandles.empty()){
+		handle = _recordOf.size();
+		_recordOf.push_back(0);
+	}else{
+		handle = _freeHandles.back();
+		_freeHandles.pop_back();
+	}
+	_recordOf[handle] = _records.size();
+	_records.push_back(record);
+	_handleOf.push_back(handle);
+	_vertexOwners[record.baseVertex] = handle;
+	_indexOwners[record.firstIndex] = handle;
+	return handle;
+  }
+
+  void writeMesh(const DrawRecord& record, Building& building){
+	_vertexScratch.resize(record.vertexCount);
+	_indexScratch.resize(record.count);
+	building.writeMesh(&_vertexScratch[0], &_indexScratch[0]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, record.baseVertex * sizeof(Building::PackedVertex),
+		record.vertexCount * sizeof(Building::PackedVertex), &_vertexScratch[0]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, record.firstIndex * sizeof(GLuint), record.count * sizeof(GLuint), &_indexScratch[0]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void uploadRecord(int r){
+	uploadRecords(r, r + 1);
+  }
+
+  //Records first to last - 1, in one upload
+  void uploadRecords(size_t first, size_t last){
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _recordBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(DrawRecord), (last - first) * sizeof(DrawRecord), &_records[first]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void edited(double start, size_t edits = 1){
+	_edits += edits;
+	_editSeconds += glfwGetTime() - start;
+  }
+
+  //Within one buffer; the ranges never overlap since to was free
+  void copy(GLuint buffer, size_t from, size_t to, size_t bytes){
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  //Points the vertex array at the vertex and index buffers, again whenever they are replaced
+  void setArrays(){
+	glBindVertexArray(_VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	//The city shaders read the fixed attributes, so the arrays feed those
+	GLsizei stride = sizeof(Building::PackedVertex);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_SHORT, stride, (const GLvoid*)offsetof(Building::PackedVertex, position));
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glNormalPointer(GL_BYTE, stride, (const GLvoid*)offsetof(Building::PackedVertex, normal));
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glTexCoordPointer(4, GL_SHORT, stride, (const GLvoid*)offsetof(Building::PackedVertex, texCoord));
+	glEnableClientState(GL_COLOR_ARRAY);
+	glColorPointer(4, GL_UNSIGNED_BYTE, stride, (const GLvoid*)offsetof(Building::PackedVertex, color));
+	/*Each building's origin comes from its record, once per instance: every
+	draw command's base instance is its record's number*/
+	glBindBuffer(GL_ARRAY_BUFFER, _recordBuffer);
+	glEnableVertexAttribArray(Building::ORIGIN_ATTRIBUTE);
+	glVertexAttribPointer(Building::ORIGIN_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRecord), (const GLvoid*)offsetof(DrawRecord, boundsMin));
+	glVertexAttribDivisor(Building::ORIGIN_ATTRIBUTE, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  //Replaces buffer with one of newBytes holding the same first oldBytes
+  void regrow(GLuint& buffer, size_t oldBytes, size_t newBytes){
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+  }
+
+  /*Doubles the vertex and index buffers when a building doesn't fit. Rare,
+  and still a copy on the GPU rather than an upload from the CPU*/
+  void growBuffers(){
+	size_t vertices = _vertexAllocator.capacity();
+	size_t indices = _indexAllocator.capacity();
+	regrow(_vertexBuffer, vertices * sizeof(Building::PackedVertex), 2 * vertices * sizeof(Building::PackedVertex));
+	regrow(_indexBuffer, indices * sizeof(GLuint), 2 * indices * sizeof(GLuint));
+	_vertexAllocator.grow(2 * vertices);
+	_indexAllocator.grow(2 * indices);
+	setArrays();
+  }
+
+  //Makes room for capacity records (and their commands) and uploads them all
+  void growRecords(size_t capacity){
+	_recordCapacity = capacity;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _recordBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, _recordCapacity * sizeof(DrawRecord), NULL, GL_DYNAMIC_DRAW);
+	if(!_records.empty()){
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, _records.size() * sizeof(DrawRecord), _records.data());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, _recordCapacity * sizeof(Command), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+
+  CityMesh(const CityMesh&);//Owns GL objects, not copyable
+  CityMesh& operator=(const CityMesh&);
+};
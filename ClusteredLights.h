@@ -0,0 +1,279 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Clustered forward lighting for many point lights.
+
+The view frustum is divided into DIM_X x DIM_Y screen tiles and DIM_Z
+slices that get exponentially deeper with distance (froxels). Every
+frame the lights are moved into view space and binned on the CPU into
+each cluster their sphere of influence touches, using a counting sort
+so each frame is two linear passes with no allocation.
+
+The results go to the GPU as three data textures read with texelFetch:
+  clusterTable  RG32UI   per cluster: first index and light count
+  lightIndices  R32UI    the light numbers, grouped by cluster
+  lightData     RGBA32F  per light: view position + radius, color
+The fragment shader finds its cluster from gl_FragCoord and its depth
+and loops over only the lights listed there. With a RingBuffer the
+tables are copied into it and uploaded from there, so the texture
+updates don't wait for the GPU to finish reading last frame's tables.
+*/
+
+struct PointLight{
+  glm::vec3 position;
+  float radius;//Distance at which the light has faded out completely
+  glm::vec3 color;
+};
+
+class ClusteredLights{
+public:
+  enum{DIM_X = 16, DIM_Y = 16, DIM_Z = 24, CLUSTERS = DIM_X * DIM_Y * DIM_Z};
+  enum{TEXTURE_WIDTH = 1024};//Row length of every data texture
+
+  ClusteredLights(float farDistance = 500.0f):
+	_sliceNear(1.0f),
+	_far(farDistance),
+	_indexRows(0),
+	_dataRows(0),
+	_binnedIndices(0),
+	_binMs(0.0),
+	_stream(NULL){
+	_clusterTable.resize(CLUSTERS * 2);
+	glGenTextures(3, _textures);
+	allocate(_textures[0], GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT, CLUSTERS / TEXTURE_WIDTH);
+  }
+
+  virtual ~ClusteredLights(){
+	glDeleteTextures(3, _textures);
+  }
+
+  void setLights(const std::vector<PointLight>& lights){
+	_lights = lights;
+	_ranges.resize(_lights.size());
+  }
+
+  //Upload through stream from now on (NULL to go back to plain uploads)
+  void setStreamBuffer(RingBuffer* stream){
+	_stream = stream;
+  }
+
+  size_t lightCount(){
+	return _lights.size();
+  }
+
+  /*Bin every light into the clusters of this frame's view and
+  upload the tables. fovy is in degrees like Camera::getFovy()*/
+  void update(const glm::mat4& view, float fovy, float aspect, float zNear){
+	double start = glfwGetTime();
+	float tanY = tan(glm::radians(fovy) * 0.5f);
+	float tanX = tanY * aspect;
+	float sliceScale = DIM_Z / log(_far / _sliceNear);
+
+	//Pass 1: find the cluster range of every light and count lights per cluster
+	_counts.assign(CLUSTERS, 0u);
+	_viewLights.resize(_lights.size() * 8);
+	for(size_t i = 0; i < _lights.size(); i++){
+		glm::vec3 p = glm::vec3(view * glm::vec4(_lights[i].position, 1.0f));
+		float r = _lights[i].radius;
+		ClusterRange& range = _ranges[i];
+		range.empty = true;
+		float nearest = -p.z - r;
+		float furthest = -p.z + r;
+		if(furthest < zNear || nearest > _far){
+			continue;
+		}
+		range.z0 = slice(nearest, sliceScale);
+		range.z1 = slice(furthest, sliceScale);
+		float ndcMin[2] = {-1.0f, -1.0f};
+		float ndcMax[2] = {1.0f, 1.0f};
+		if(nearest > zNear){
+			/*The sphere is entirely in front of the camera, so the projection
+			of its view space box bounds it on screen*/
+			ndcMin[0] = ndcMin[1] = 1e9f;
+			ndcMax[0] = ndcMax[1] = -1e9f;
+			float depths[2] = {nearest, furthest};
+			for(int d = 0; d < 2; d++){
+				for(int sy = -1; sy <= 1; sy += 2){
+					for(int sx = -1; sx <= 1; sx += 2){
+						float x = (p.x + sx * r) / (depths[d] * tanX);
+						float y = (p.y + sy * r) / (depths[d] * tanY);
+						ndcMin[0] = std::min(ndcMin[0], x);
+						ndcMax[0] = std::max(ndcMax[0], x);
+						ndcMin[1] = std::min(ndcMin[1], y);
+						ndcMax[1] = std::max(ndcMax[1], y);
+					}
+				}
+			}
+			if(ndcMin[0] > 1.0f || ndcMax[0] < -1.0f || ndcMin[1] > 1.0f || ndcMax[1] < -1.0f){
+				continue;
+			}
+		}
+		range.x0 = tile(ndcMin[0], DIM_X);
+		range.x1 = tile(ndcMax[0], DIM_X);
+		range.y0 = tile(ndcMin[1], DIM_Y);
+		range.y1 = tile(ndcMax[1], DIM_Y);
+		range.empty = false;
+		for(int z = range.z0; z <= range.z1; z++){
+			for(int y = range.y0; y <= range.y1; y++){
+				for(int x = range.x0; x <= range.x1; x++){
+					_counts[cluster(x, y, z)]++;
+				}
+			}
+		}
+		_viewLights[i * 8 + 0] = p.x;
+		_viewLights[i * 8 + 1] = p.y;
+		_viewLights[i * 8 + 2] = p.z;
+		_viewLights[i * 8 + 3] = r;
+		_viewLights[i * 8 + 4] = _lights[i].color.r;
+		_viewLights[i * 8 + 5] = _lights[i].color.g;
+		_viewLights[i * 8 + 6] = _lights[i].color.b;
+		_viewLights[i * 8 + 7] = 0.0f;
+	}
+
+	//Prefix sum gives every cluster its first slot in the index list
+	unsigned int total = 0;
+	for(int c = 0; c < CLUSTERS; c++){
+		_clusterTable[c * 2] = total;
+		_clusterTable[c * 2 + 1] = 0;
+		total += _counts[c];
+	}
+
+	//Pass 2: write the light numbers into their clusters' slots
+	_indices.resize(std::max(1u, (total + TEXTURE_WIDTH - 1) / TEXTURE_WIDTH) * TEXTURE_WIDTH);
+	for(size_t i = 0; i < _lights.size(); i++){
+		const ClusterRange& range = _ranges[i];
+		if(range.empty){
+			continue;
+		}
+		for(int z = range.z0; z <= range.z1; z++){
+			for(int y = range.y0; y <= range.y1; y++){
+				for(int x = range.x0; x <= range.x1; x++){
+					int c = cluster(x, y, z);
+					_indices[_clusterTable[c * 2] + _clusterTable[c * 2 + 1]++] = (unsigned int)i;
+				}
+			}
+		}
+	}
+	_binnedIndices = total;
+	upload();
+	_binMs = 1000.0 * (glfwGetTime() - start);
+  }
+
+  //Binds the tables to three consecutive texture units starting at firstUnit
+  void bind(int firstUnit){
+	for(int i = 0; i < 3; i++){
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_2D, _textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+  }
+
+  //Constants the fragment shader needs to find its cluster
+  glm::vec4 clusterParameters(){
+	return glm::vec4(_sliceNear, DIM_Z / log(_far / _sliceNear), float(DIM_X), float(DIM_Y));
+  }
+
+  void report(){
+	printf("Lights: %zu point lights, %u cluster entries, binned and uploaded in %.3f ms CPU\n",
+		_lights.size(), _binnedIndices, _binMs);
+  }
+
+private:
+  struct ClusterRange{
+	int x0, x1, y0, y1, z0, z1;
+	bool empty;
+  };
+
+  float _sliceNear;//Depth of the end of the first slice
+  float _far;//Lights beyond this are ignored
+  GLuint _textures[3];//clusterTable, lightIndices, lightData
+  int _indexRows;//Rows currently allocated in the index and data textures
+  int _dataRows;
+  std::vector<PointLight> _lights;
+  std::vector<ClusterRange> _ranges;
+  std::vector<unsigned int> _counts;
+  std::vector<unsigned int> _clusterTable;
+  std::vector<unsigned int> _indices;
+  std::vector<float> _viewLights;
+  unsigned int _binnedIndices;
+  double _binMs;
+  RingBuffer* _stream;//Per frame upload space, if the context has it
+
+  int cluster(int x, int y, int z){
+	return x + DIM_X * (y + DIM_Y * z);
+  }
+
+  //Depth slice of a view distance; matches ClusterIndex() in blinn_phong.frag.glsl
+  int slice(float depth, float sliceScale){
+	if(depth <= _sliceNear){
+		return 0;
+	}
+	return std::min(DIM_Z - 1, int(log(depth / _sliceNear) * sliceScale));
+  }
+
+  int tile(float ndc, int tiles){
+	return std::max(0, std::min(tiles - 1, int((ndc * 0.5f + 0.5f) * tiles)));
+  }
+
+  void allocate(GLuint texture, GLint internalFormat, GLenum format, GLenum type, int rows){
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, TEXTURE_WIDTH, rows, 0, format, type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  }
+
+  //Textures only grow, so steady state frames just replace their contents
+  void upload(){
+	int indexRows = _indices.size() / TEXTURE_WIDTH;
+	if(indexRows > _indexRows){
+		_indexRows = indexRows;
+		allocate(_textures[1], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, _indexRows);
+	}
+	int dataRows = std::max<int>(1, (_lights.size() * 2 + TEXTURE_WIDTH - 1) / TEXTURE_WIDTH);
+	if(dataRows > _dataRows){
+		_dataRows = dataRows;
+		allocate(_textures[2], GL_RGBA32F, GL_RGBA, GL_FLOAT, _dataRows);
+	}
+	_viewLights.resize(_dataRows * TEXTURE_WIDTH * 4);
+
+	/*The tables are read from the pixel unpack buffer when one is bound,
+	so the pointers below become offsets into the stream buffer*/
+	const GLvoid* sources[3] = {&_clusterTable[0], &_indices[0], &_viewLights[0]};
+	if(_stream){
+		size_t sizes[3] = {CLUSTERS * 2 * sizeof(unsigned int), indexRows * TEXTURE_WIDTH * sizeof(unsigned int),
+			dataRows * TEXTURE_WIDTH * 4 * sizeof(float)};
+		GLintptr offsets[3];
+		void* destinations[3];
+		bool fits = true;
+		for(int i = 0; i < 3 && fits; i++){
+			destinations[i] = _stream->allocate(sizes[i], offsets[i]);
+			fits = destinations[i] != NULL;
+		}
+		if(fits){
+			for(int i = 0; i < 3; i++){
+				memcpy(destinations[i], sources[i], sizes[i]);
+				sources[i] = (const GLvoid*)offsets[i];
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _stream->buffer());
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, _textures[0]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_WIDTH, CLUSTERS / TEXTURE_WIDTH,
+		GL_RG_INTEGER, GL_UNSIGNED_INT, sources[0]);
+	glBindTexture(GL_TEXTURE_2D, _textures[1]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_WIDTH, indexRows,
+		GL_RED_INTEGER, GL_UNSIGNED_INT, sources[1]);
+	glBindTexture(GL_TEXTURE_2D, _textures[2]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_WIDTH, dataRows,
+		GL_RGBA, GL_FLOAT, sources[2]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  ClusteredLights(const ClusteredLights&);//Owns GL textures, not copyable
+  ClusteredLights& operator=(const ClusteredLights&);
+};
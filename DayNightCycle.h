@@ -0,0 +1,63 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Moves the SpinningLight along the sun's path over a day
+and colours it with the sunlight that gets through the Atmosphere.
+At night the light swaps to the opposite side as a dim blue moon, so
+shadows keep working.
+*/
+
+class DayNightCycle{
+public:
+  //dayLength in seconds; timeOfDay runs from 0 to 1 starting at midnight
+  DayNightCycle(float dayLength = 120.0f, float timeOfDay = 0.35f):
+	_dayLength(dayLength),
+	_time(timeOfDay),
+	_running(true){}
+
+  void update(float dt, SpinningLight& light, Atmosphere* sky){
+	if(!_running){
+		return;
+	}
+	_time = fmod(_time + dt / _dayLength, 1.0f);
+	glm::vec3 sun = sunDirection();
+	glm::vec3 center = light.center();
+	float distance = glm::length(glm::vec3(light.position()) - center);
+	//Fade the sun out just below the horizon and bring the moon in behind it
+	float day = glm::clamp((sun.y + 0.05f) / 0.15f, 0.0f, 1.0f);
+	float night = glm::clamp((-sun.y - 0.05f) / 0.15f, 0.0f, 1.0f);
+	if(sun.y > -0.05f){
+		light.setPosition(center + sun * distance);
+		light.setColor(sky->sunlight(sun.y) * day);
+	}else{
+		light.setPosition(center - sun * distance);
+		light.setColor(glm::vec3(0.12f, 0.15f, 0.22f) * night);
+	}
+  }
+
+  //Points from the ground towards the sun. It rises in +x and sets in -x
+  glm::vec3 sunDirection(){
+	float angle = 2.0f * glm::pi<float>() * (_time - 0.25f);
+	return glm::normalize(glm::vec3(cos(angle), sin(angle), 0.35f));
+  }
+
+  float timeOfDay(){
+	return _time;
+  }
+
+  void toggle(){
+	_running = !_running;
+  }
+
+  bool isRunning(){
+	return _running;
+  }
+
+private:
+  float _dayLength;
+  float _time;
+  bool _running;
+};
@@ -0,0 +1,102 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Lines for looking at what the renderer is doing (e.g. the
+boxes culling tests against). They are collected during a frame, copied
+into the frame's part of a RingBuffer and drawn with one call, then
+forgotten. Without a RingBuffer they are drawn from client memory.
+*/
+
+class DebugLines{
+public:
+  DebugLines(){
+	glGenVertexArrays(1, &_VAO);
+	if(!loadShaderProgram(_program, "shaders/debug_lines.vert.glsl", "shaders/debug_lines.frag.glsl")){
+		exit(1);
+	}
+	_uViewProjection = glGetUniformLocation(_program.id(), "viewProjection");
+	_program.deactivate();
+  }
+
+  virtual ~DebugLines(){
+	glDeleteVertexArrays(1, &_VAO);
+  }
+
+  void line(const glm::vec3& from, const glm::vec3& to, const glm::vec4& color){
+	add(from, color);
+	add(to, color);
+  }
+
+  //The twelve edges of an axis aligned box
+  void box(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec4& color = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)){
+	for(int i = 0; i < 4; i++){
+		//Corners of the bottom, in order around it, and the next one
+		glm::vec3 a((i == 1 || i == 2) ? boxMax.x : boxMin.x, 0.0f, i >= 2 ? boxMax.z : boxMin.z);
+		glm::vec3 b((i == 0 || i == 1) ? boxMax.x : boxMin.x, 0.0f, (i == 1 || i == 2) ? boxMax.z : boxMin.z);
+		line(glm::vec3(a.x, boxMin.y, a.z), glm::vec3(b.x, boxMin.y, b.z), color);
+		line(glm::vec3(a.x, boxMax.y, a.z), glm::vec3(b.x, boxMax.y, b.z), color);
+		line(glm::vec3(a.x, boxMin.y, a.z), glm::vec3(a.x, boxMax.y, a.z), color);
+	}
+  }
+
+  //Draws and clears everything added since the last call
+  void draw(const glm::mat4& viewProjection, RingBuffer* stream){
+	if(_vertices.empty()){
+		return;
+	}
+	size_t bytes = _vertices.size() * sizeof(Vertex);
+	GLintptr offset = 0;
+	void* destination = stream ? stream->allocate(bytes, offset) : NULL;
+	const GLubyte* base = (const GLubyte*)&_vertices[0];
+	if(destination){
+		memcpy(destination, base, bytes);
+		glBindVertexArray(_VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, stream->buffer());
+		base = (const GLubyte*)offset;
+	}
+	//Otherwise client memory, which only the default vertex array can point at
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, position));
+	glEnableClientState(GL_COLOR_ARRAY);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), base + offsetof(Vertex, color));
+	_program.activate();
+	glUniformMatrix4fv(_uViewProjection, 1, false, glm::value_ptr(viewProjection));
+	glDrawArrays(GL_LINES, 0, _vertices.size());
+	_program.deactivate();
+	if(!destination){
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_COLOR_ARRAY);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	_vertices.clear();
+  }
+
+private:
+  struct Vertex{
+	GLfloat position[3];
+	GLubyte color[4];
+  };
+
+  GLuint _VAO;
+  GLSLProgram _program;
+  GLint _uViewProjection;
+  std::vector<Vertex> _vertices;//This frame's lines, two vertices each
+
+  void add(const glm::vec3& p, const glm::vec4& color){
+	Vertex v;
+	v.position[0] = p.x;
+	v.position[1] = p.y;
+	v.position[2] = p.z;
+	for(int i = 0; i < 4; i++){
+		v.color[i] = GLubyte(glm::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+	_vertices.push_back(v);
+  }
+
+  DebugLines(const DebugLines&);//Owns GL objects, not copyable
+  DebugLines& operator=(const DebugLines&);
+};
@@ -0,0 +1,166 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Deferred shading path for the city.
+
+The geometry pass draws the city once into a compact G-buffer:
+  albedo  RGBA8      facade texture colour
+  normal  RGB10_A2   view space normal, packed into [0, 1]
+  depth   DEPTH24    view space position is rebuilt from this
+That is 12 bytes a pixel. The lighting pass then draws one full screen
+triangle that shades each pixel exactly once with shaders/lighting.glsl,
+so the street lamp loop runs per visible pixel instead of per drawn
+fragment. The clustered light grid doubles as the tile culling.
+
+The forward path wins when there are few lights and little overdraw;
+the G-buffer write and read cost is paid whatever the light count.
+*/
+
+class DeferredRenderer{
+public:
+  DeferredRenderer(): _width(0), _height(0), _framebuffer(0){
+	glGenTextures(3, _textures);
+	//The full screen triangle has no attributes but core contexts still need a vertex array
+	glGenVertexArrays(1, &_emptyVAO);
+
+	_geometryProgram.bindAttribLocation(Building::ORIGIN_ATTRIBUTE, "origin");
+	if(!loadShaderProgram(_geometryProgram, "shaders/blinn_phong.vert.glsl", "shaders/gbuffer.frag.glsl")){
+		exit(1);
+	}
+	_uModelViewMatrix = glGetUniformLocation(_geometryProgram.id(), "modelViewMatrix");
+	_uProjectionMatrix = glGetUniformLocation(_geometryProgram.id(), "projectionMatrix");
+	_uNormalMatrix = glGetUniformLocation(_geometryProgram.id(), "normalMatrix");
+	glUniform1i(glGetUniformLocation(_geometryProgram.id(), "building"), 0);
+	_uProceduralFacades = glGetUniformLocation(_geometryProgram.id(), "proceduralFacades");
+	_geometryProgram.deactivate();
+
+	if(!loadShaderProgram(_lightingProgram, "shaders/deferred_lighting.vert.glsl", "shaders/deferred_lighting.frag.glsl")){
+		exit(1);
+	}
+	_uInverseProjectionMatrix = glGetUniformLocation(_lightingProgram.id(), "inverseProjectionMatrix");
+	_uInverseViewMatrix = glGetUniformLocation(_lightingProgram.id(), "inverseViewMatrix");
+	//The G-buffer goes after the units LightingUniforms uses
+	glUniform1i(glGetUniformLocation(_lightingProgram.id(), "albedoBuffer"), GBUFFER_UNIT);
+	glUniform1i(glGetUniformLocation(_lightingProgram.id(), "normalBuffer"), GBUFFER_UNIT + 1);
+	glUniform1i(glGetUniformLocation(_lightingProgram.id(), "depthBuffer"), GBUFFER_UNIT + 2);
+	_lighting.locate(_lightingProgram.id());
+	_lightingProgram.deactivate();
+  }
+
+  virtual ~DeferredRenderer(){
+	glDeleteVertexArrays(1, &_emptyVAO);
+	glDeleteFramebuffers(1, &_framebuffer);
+	glDeleteTextures(3, _textures);
+  }
+
+  //Fill the G-buffer with shaders/facade.glsl's facades instead of the facade textures
+  void setProceduralFacades(bool procedural){
+	_geometryProgram.activate();
+	glUniform1i(_uProceduralFacades, procedural);
+	_geometryProgram.deactivate();
+  }
+
+  void setMaterials(const std::vector<Material>& materials){
+	_lightingProgram.activate();
+	_lighting.setMaterials(materials);
+	_lightingProgram.deactivate();
+  }
+
+  /*Draws the city into the G-buffer. (Re)allocates the G-buffer first
+  if the window changed size*/
+  void geometryPass(World* world, const glm::mat4& modelView, const glm::mat4& projection,
+	const glm::mat4& normalMatrix, int width, int height){
+	resize(width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	_geometryProgram.activate();
+	glUniformMatrix4fv(_uModelViewMatrix, 1, false, glm::value_ptr(modelView));
+	glUniformMatrix4fv(_uProjectionMatrix, 1, false, glm::value_ptr(projection));
+	glUniformMatrix4fv(_uNormalMatrix, 1, false, glm::value_ptr(normalMatrix));
+	world->drawLevel(Frustum(projection * modelView));
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  /*Shades the G-buffer into the current framebuffer, writing the G-buffer's
+  depth along with the colour so later passes still depth test against the city.
+  The framebuffer's depth must be freshly cleared: every written depth is <= 1,
+  so the GL_LEQUAL test always passes*/
+  void lightingPass(const glm::mat4& view, const glm::mat4& projection, const glm::vec4& light0Position,
+	const glm::vec4& light0Color, CascadedShadowMap* shadows, bool shadowsEnabled, ClusteredLights* lights){
+	_lightingProgram.activate();
+	glUniformMatrix4fv(_uInverseProjectionMatrix, 1, false, glm::value_ptr(glm::inverse(projection)));
+	glUniformMatrix4fv(_uInverseViewMatrix, 1, false, glm::value_ptr(glm::inverse(view)));
+	_lighting.activate(light0Position, light0Color, shadows, shadowsEnabled, lights, _width, _height);
+	for(int i = 0; i < 3; i++){
+		glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, _textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(_emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	_lightingProgram.deactivate();
+  }
+
+  //Video memory held by the G-buffer
+  size_t bytes(){
+	return size_t(_width) * _height * 12;
+  }
+
+private:
+  enum{GBUFFER_UNIT = 5};//Albedo, normal and depth on three units in a row
+  int _width;
+  int _height;
+  GLuint _framebuffer;
+  GLuint _textures[3];//Albedo, normal, depth
+  GLuint _emptyVAO;
+  GLSLProgram _geometryProgram;
+  GLint _uModelViewMatrix;
+  GLint _uProjectionMatrix;
+  GLint _uNormalMatrix;
+  GLint _uProceduralFacades;
+  GLSLProgram _lightingProgram;
+  GLint _uInverseProjectionMatrix;
+  GLint _uInverseViewMatrix;
+  LightingUniforms _lighting;
+
+  void allocate(GLuint texture, GLint internalFormat, GLenum format, GLenum type){
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height, 0, format, type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  }
+
+  void resize(int width, int height){
+	if(width == _width && height == _height){
+		return;
+	}
+	_width = width;
+	_height = height;
+	allocate(_textures[0], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+	allocate(_textures[1], GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV);
+	allocate(_textures[2], GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(!_framebuffer){
+		glGenFramebuffers(1, &_framebuffer);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _textures[0], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _textures[1], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _textures[2], 0);
+	GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	glDrawBuffers(2, buffers);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		printf("G-buffer framebuffer is incomplete.\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  DeferredRenderer(const DeferredRenderer&);//Owns GL objects, not copyable
+  DeferredRenderer& operator=(const DeferredRenderer&);
+};
@@ -0,0 +1,251 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Paces frames and measures how they are presented.
+
+Every swap is timestamped, giving the present interval (average, min,
+max) and a count of late frames. An optional frame rate cap starts each
+frame on a fixed schedule: the pacer sleeps until just before the
+frame's start time and spins on the clock for the rest, because sleeps
+alone overshoot by up to a millisecond or more. Input is polled after
+the wait, so a capped frame works on the freshest input it can.
+
+In adaptive mode vsync is turned off (to late swap tearing where the
+driver has it) once frames keep missing the refresh, and turned back on
+after a run of frames that would have made it.
+
+Key presses are timestamped and matched with the swap of the frame that
+first used them. GLFW only sees a key when events are polled, so the
+key to swap time leaves out the wait for the next poll; the key to
+photon estimate adds the time for the swapped frame to reach the screen
+(the next refresh with vsync, half a scanout without).
+*/
+
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <GLFW/glfw3.h>
+
+class FramePacer{
+public:
+  FramePacer():
+	_interval(1),
+	_requestedInterval(1),
+	_adaptive(false),
+	_tearSupported(false),
+	_refreshPeriod(1.0 / 60.0),
+	_targetFps(0.0),
+	_nextStart(0.0),
+	_lastPresent(-1.0),
+	_pendingInput(-1.0),
+	_inFlightInput(-1.0),
+	_lateRun(0),
+	_onTimeRun(0){
+	reset();
+  }
+
+  virtual ~FramePacer(){}
+
+  /*Swap interval as in glfwSwapInterval. With adaptive set, an interval of 1 is
+  dropped whenever frames keep running late. The context must be current*/
+  void sync(int interval, bool adaptive){
+	_requestedInterval = interval;
+	_adaptive = adaptive;
+	_tearSupported = glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+		glfwExtensionSupported("WGL_EXT_swap_control_tear");
+	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : NULL;
+	_refreshPeriod = mode && mode->refreshRate > 0 ? 1.0 / mode->refreshRate : 1.0 / 60.0;
+	swapInterval(interval);
+	_lateRun = 0;
+	_onTimeRun = 0;
+  }
+
+  //Frames a second to cap at, 0 for no cap
+  void targetFps(double fps){
+	_targetFps = fps;
+	_nextStart = 0.0;
+  }
+
+  double targetFps() const{
+	return _targetFps;
+  }
+
+  /*Call at the top of the frame, before polling input. Returns
+  once the frame is due according to the cap*/
+  void wait(){
+	if(_targetFps <= 0.0){
+		return;
+	}
+	double now = glfwGetTime();
+	//Keep to the schedule, but don't try to make up for frames that ran long
+	if(_nextStart < now - 1.0 / _targetFps){
+		_nextStart = now;
+	}
+	double remaining = _nextStart - now;
+	double spin = SPIN_MICROSECONDS / 1000000.0;
+	if(remaining > spin){
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining - spin));
+	}
+	while(glfwGetTime() < _nextStart){
+		std::this_thread::yield();
+	}
+	_waitTotal += std::max(0.0, remaining);
+	_nextStart += 1.0 / _targetFps;
+  }
+
+  //A key went down at time (seconds on the glfwGetTime clock)
+  void input(double time){
+	if(_pendingInput < 0.0){
+		_pendingInput = time;
+	}
+  }
+
+  //Call after polling input: the keys seen so far are handled by this frame
+  void frameStarted(){
+	_inFlightInput = _pendingInput;
+	_pendingInput = -1.0;
+  }
+
+  //Call right after the buffers are swapped
+  void presented(){
+	double now = glfwGetTime();
+	if(_inFlightInput >= 0.0){
+		double latency = now - _inFlightInput;
+		_inputs++;
+		_latencyTotal += latency;
+		_latencyMax = std::max(_latencyMax, latency);
+		_inFlightInput = -1.0;
+	}
+	if(_lastPresent >= 0.0){
+		double interval = now - _lastPresent;
+		_frames++;
+		_presentTotal += interval;
+		_presentMin = std::min(_presentMin, interval);
+		_presentMax = std::max(_presentMax, interval);
+		//A frame is late when it misses the refresh (or the cap, if that's slower) by half a period
+		double expected = std::max(_interval != 0 ? _refreshPeriod : 0.0, _targetFps > 0.0 ? 1.0 / _targetFps : 0.0);
+		bool late = expected > 0.0 && interval > 1.5 * expected;
+		if(late){
+			_late++;
+		}
+		adapt(interval, late);
+	}
+	_lastPresent = now;
+  }
+
+  //Prints the pacing and input latency since the last report
+  void report(){
+	if(_frames == 0){
+		return;
+	}
+	const char* sync = _interval == 0 ? "off" : (_interval < 0 ? "late swap tearing" : "on");
+	printf("Present: %.3f ms average, %.3f min, %.3f max, %d of %d late, %.3f ms a frame waiting for the cap, vsync %s%s, cap %s\n",
+		1000.0 * _presentTotal / _frames, 1000.0 * _presentMin, 1000.0 * _presentMax, _late, _frames,
+		1000.0 * _waitTotal / _frames, sync, _adaptive ? " (adaptive)" : "", capName());
+	if(_switches > 0){
+		printf("Present: vsync switched %d times\n", _switches);
+	}
+	if(_inputs > 0){
+		double display = _interval > 0 ? _refreshPeriod : 0.5 * _refreshPeriod;
+		double average = _latencyTotal / _inputs;
+		printf("Input: %d key presses, key to swap %.3f ms average (%.3f max), about %.3f ms key to photon\n",
+			_inputs, 1000.0 * average, 1000.0 * _latencyMax, 1000.0 * (average + display));
+	}
+	reset();
+  }
+
+  void reset(){
+	_frames = 0;
+	_late = 0;
+	_switches = 0;
+	_presentTotal = 0.0;
+	_presentMin = 1e30;
+	_presentMax = 0.0;
+	_waitTotal = 0.0;
+	_inputs = 0;
+	_latencyTotal = 0.0;
+	_latencyMax = 0.0;
+  }
+
+private:
+  //The last part of a wait is spun rather than slept, sleeps can wake this late
+  enum{SPIN_MICROSECONDS = 2000};
+  enum{LATE_FRAMES = 3, ON_TIME_FRAMES = 120};//Runs that switch vsync off and back on
+
+  int _interval;//Swap interval in use
+  int _requestedInterval;
+  bool _adaptive;
+  bool _tearSupported;
+  double _refreshPeriod;//Seconds between refreshes of the primary monitor
+  double _targetFps;
+  double _nextStart;//When the next capped frame may start
+  double _lastPresent;
+  double _pendingInput;//Earliest key press not seen by a frame yet
+  double _inFlightInput;//Earliest key press handled by the frame being drawn
+  int _lateRun;
+  int _onTimeRun;
+
+  int _frames;
+  int _late;
+  int _switches;
+  double _presentTotal;
+  double _presentMin;
+  double _presentMax;
+  double _waitTotal;
+  int _inputs;
+  double _latencyTotal;
+  double _latencyMax;
+
+  void swapInterval(int interval){
+	_interval = interval;
+	glfwSwapInterval(interval);
+  }
+
+  /*Waiting for the next refresh after missing one halves the frame rate,
+  so in adaptive mode a run of late frames turns vsync off. It is turned
+  back on once frames have been fast enough to make every refresh for a while*/
+  void adapt(double interval, bool late){
+	if(!_adaptive || _requestedInterval != 1){
+		return;
+	}
+	if(_interval == 1){
+		_lateRun = late ? _lateRun + 1 : 0;
+		if(_lateRun >= LATE_FRAMES){
+			swapInterval(_tearSupported ? -1 : 0);
+			_switches++;
+			_lateRun = 0;
+			_onTimeRun = 0;
+		}
+	}else{
+		_onTimeRun = interval < 0.9 * _refreshPeriod ? _onTimeRun + 1 : 0;
+		if(_onTimeRun >= ON_TIME_FRAMES){
+			swapInterval(1);
+			_switches++;
+			_onTimeRun = 0;
+			_lateRun = 0;
+		}
+	}
+  }
+
+  const char* capName() const{
+	static char name[32];
+	if(_targetFps <= 0.0){
+		return "none";
+	}
+	snprintf(name, sizeof(name), "%.0f fps", _targetFps);
+	return name;
+  }
+
+  FramePacer(const FramePacer&);
+  FramePacer& operator=(const FramePacer&);
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: The six planes of a view volume, used to skip buildings
+that can't be seen from a camera or a light
+*/
+
+class Frustum{
+public:
+  Frustum(){}
+
+  /*Extract the planes from a (projection * view) matrix.
+  glm matrices are column major, so m[c][r] is row r of column c*/
+  Frustum(const glm::mat4& m){
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+	_planes[0] = row3 + row0;//Left
+	_planes[1] = row3 - row0;//Right
+	_planes[2] = row3 + row1;//Bottom
+	_planes[3] = row3 - row1;//Top
+	_planes[4] = row3 + row2;//Near
+	_planes[5] = row3 - row2;//Far
+	for(int i = 0; i < 6; i++){
+		_planes[i] /= glm::length(glm::vec3(_planes[i]));
+	}
+  }
+
+  /*True if the axis aligned box is at least partly inside.
+  For each plane only the corner furthest along its normal is tested*/
+  bool intersects(const glm::vec3& boxMin, const glm::vec3& boxMax) const{
+	for(int i = 0; i < 6; i++){
+		glm::vec3 corner(_planes[i].x > 0.0f ? boxMax.x : boxMin.x,
+			_planes[i].y > 0.0f ? boxMax.y : boxMin.y,
+			_planes[i].z > 0.0f ? boxMax.z : boxMin.z);
+		if(glm::dot(glm::vec3(_planes[i]), corner) + _planes[i].w < 0.0f){
+			return false;
+		}
+	}
+	return true;
+  }
+
+  const glm::vec4& plane(int i) const{
+	return _planes[i];
+  }
+
+private:
+  glm::vec4 _planes[6];//xyz is the inward normal, w the offset
+};
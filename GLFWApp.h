@@ -54,6 +54,7 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
 #include <iostream>
 #include <string>
@@ -66,6 +67,9 @@
 //#define GLFW_INCLUDE_GLCOREARB
 #include <GLFW/glfw3.h>
 
+#include "FramePacer.h"
+#include "InputMap.h"
+
 class GLFWApp{
  public:
 
@@ -77,7 +81,8 @@ class GLFWApp{
   typedef enum{
     VSYNC,
     ASYNC,
-    TEARING
+    TEARING,
+    ADAPTIVE // VSYNC until frames run late, see FramePacer
   }syncmode_t;
 
   typedef enum{
@@ -101,10 +106,13 @@ class GLFWApp{
     _windowTitle(windowTitle),
     _major(major),
     _minor(minor),
-    _mouseButtonFlags(0) {
+    _mouseButtonFlags(0),
+    _timestep(1.0 / 120.0),
+    _interpolation(0.0) {
     _mousePreviousPosition = std::make_tuple(windowSize_X / 2.0, windowSize_Y / 2.0);
     _mouseCurrentPosition = _mousePreviousPosition;
     memset(&_keyPressed[0], 0, sizeof(_keyPressed));
+    memset(&_keyHit[0], 0, sizeof(_keyHit));
     glfwInit( );
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
     glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
@@ -149,13 +157,16 @@ class GLFWApp{
   void sync(syncmode_t const & sync){
     switch(sync){
     case ASYNC:
-      glfwSwapInterval(0);
+      _pacer.sync(0, false);
       break;
     case VSYNC:
-      glfwSwapInterval(1);
+      _pacer.sync(1, false);
       break;
     case TEARING:
-      glfwSwapInterval(-1);
+      _pacer.sync(-1, false);
+      break;
+    case ADAPTIVE:
+      _pacer.sync(1, true);
       break;
     default:
       fprintf(stderr, "No such syncmode. (%d)\n", sync);
@@ -171,6 +182,15 @@ class GLFWApp{
   virtual bool render( ) = 0;
   virtual bool end( ) = 0;
 
+  /*
+   * Advances the simulation by exactly dt seconds. It is called
+   * as many times as needed to catch up with the clock before each
+   * render( ), so motion speed doesn't depend on the frame rate.
+   */
+  virtual bool update(double dt){
+    return true;
+  }
+
   void windowShouldClose( ){
     glfwSetWindowShouldClose(_window, GL_TRUE);
   }
@@ -179,14 +199,36 @@ class GLFWApp{
     int rv = EXIT_FAILURE;
     if(_window != 0){
       rv = this->begin() ? EXIT_SUCCESS : EXIT_FAILURE;
+      double previous = glfwGetTime( );
+      double accumulator = 0.0;
       while(rv == EXIT_SUCCESS){
-        rv = this->render() ? EXIT_SUCCESS : EXIT_FAILURE;
-        rv = rv && this->checkGLError("Render");
+        // Input is polled after any wait for the frame rate cap so
+        // the frame starts with the newest key presses
+        _pacer.wait( );
         glfwPollEvents( );
         if(glfwWindowShouldClose(_window)){
           break;
         }
+        _pacer.frameStarted( );
+        _input.gather(&_keyPressed[0], &_keyHit[0],
+                      std::get<0>(_mouseCurrentPosition), std::get<1>(_mouseCurrentPosition));
+        // Fixed timestep: run whole update steps for the time that has
+        // passed and carry the remainder over to the next frame.
+        double now = glfwGetTime( );
+        // Don't try to catch up after a long stall (e.g. a breakpoint)
+        accumulator += std::min(now - previous, 0.25);
+        previous = now;
+        while(accumulator >= _timestep && rv == EXIT_SUCCESS){
+          rv = this->update(_timestep) ? EXIT_SUCCESS : EXIT_FAILURE;
+          _input.stepped( );
+          accumulator -= _timestep;
+        }
+        // How far render( ) is between the last two update steps
+        _interpolation = accumulator / _timestep;
+        rv = rv == EXIT_SUCCESS && this->render() ? EXIT_SUCCESS : EXIT_FAILURE;
+        rv = rv && this->checkGLError("Render");
         swap( );
+        _pacer.presented( );
       }
       rv = rv && this->end();
     }
@@ -222,6 +264,30 @@ class GLFWApp{
     _keyPressed[key] = false;
   }
 
+  // Length of one update( ) step in seconds
+  double timestep( ) const{
+    return _timestep;
+  }
+
+  void timestep(double seconds){
+    _timestep = seconds;
+  }
+
+  // Key bindings and the actions they produced this frame
+  InputMap& input( ){
+    return _input;
+  }
+
+  // Frame rate cap, present times and input latency
+  FramePacer& pacer( ){
+    return _pacer;
+  }
+
+  // Fraction (0 to 1) of a step since the last update( ), for blending states in render( )
+  double interpolation( ) const{
+    return _interpolation;
+  }
+
  protected:   
   bool checkGLError(const char *msg){
     bool ret = true;
@@ -276,9 +342,14 @@ class GLFWApp{
   int _major;
   int _minor;
   std::array<bool, 512> _keyPressed;
+  std::array<bool, 512> _keyHit; // Went down since the last InputMap::gather( )
   int _mouseButtonFlags;
   std::tuple<float, float> _mousePreviousPosition;
   std::tuple<float, float> _mouseCurrentPosition;
+  double _timestep;
+  double _interpolation;
+  FramePacer _pacer;
+  InputMap _input;
 
   static void _mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){
     GLFWApp *app = reinterpret_cast<GLFWApp*>(glfwGetWindowUserPointer(window));
@@ -333,12 +404,17 @@ class GLFWApp{
   }
   
   static void _keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods){
-    if(key < 0){
+    // GLFW_KEY_UNKNOWN is -1; anything past the arrays is dropped as well
+    if(key < 0 || key >= int(sizeof(_keyPressed) / sizeof(_keyPressed[0]))){
       return;
     }
     GLFWApp *app = reinterpret_cast<GLFWApp*>(glfwGetWindowUserPointer(window));
     assert(app != nullptr);
     app->_keyPressed[key] = (action == KEY_PRESS || action == GLFW_REPEAT);
+    if(action == KEY_PRESS){
+      app->_keyHit[key] = true;
+      app->_pacer.input(glfwGetTime( ));
+    }
     if(app->isKeyPressed(GLFW_KEY_ESCAPE)){
       app->end( );
     }
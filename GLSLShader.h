@@ -42,6 +42,9 @@
 #include <cstring>
 
 #include <string>
+#include <vector>
+
+#include "MappedFile.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -106,33 +109,6 @@ bool _msglError( FILE *out, const char *filename, int line ){
   return( ret );
 }
 
-char* file2strings( const char *filename ){
-  long fileLength, numberOfCharsRead;
-  char *strings;
-  FILE *fhandle = fopen( filename, "r" );
-  if( !fhandle ){
-    fprintf( stderr, "%s: Can't open file %s for reading\n", __FUNCTION__, filename );
-    return NULL;
-  }
-  fseek( fhandle, 0, SEEK_END );
-  fileLength = ftell( fhandle );
-
-  fseek( fhandle, 0, SEEK_SET );
-
-  if( !(strings = (char*)calloc( (fileLength+1), sizeof(char) )) ){
-    fprintf( stderr, "%s: Can't malloc space for string buffer %s\n", __FUNCTION__, filename );
-    return NULL;
-  }
-
-  numberOfCharsRead = (long)fread( strings, sizeof(char), fileLength, fhandle );
-
-  strings[numberOfCharsRead] = '\0';
-
-  fclose( fhandle );
-
-  return( strings );
-}
-
 class Shader{
 public:
   GLuint _object;
@@ -149,10 +125,39 @@ public:
   }
 
   bool compileShader( const GLchar *src ){
+    return( compileShader( src, (GLint)strlen(src) ) );
+  }
+
+  // The source doesn't need to be NUL terminated, so it can come straight from a mapping
+  bool compileShader( const GLchar *src, GLint length ){
+    return( compileShader( 1, &src, &length ) );
+  }
+
+  /*
+   * Compiles a shader file. A line of the form
+   *   #include "name"
+   * is replaced by the file it names (relative to the including file),
+   * so shaders can share code. Each piece is handed to glShaderSource
+   * as a separate string pointing into its mapping; nothing is copied.
+   */
+  bool compileFile( const char *srcFileName ){
+    std::vector<MappedFile*> files;
+    std::vector<const GLchar*> strings;
+    std::vector<GLint> lengths;
+    bool ok = gatherSource( srcFileName, files, strings, lengths, 0 );
+    if( ok ){
+      ok = compileShader( (GLsizei)strings.size( ), &strings[0], &lengths[0] );
+    }
+    for( size_t i = 0; i < files.size( ); i++ ){
+      delete files[i];
+    }
+    return( ok );
+  }
+
+  bool compileShader( GLsizei count, const GLchar **src, const GLint *length ){
     GLint compiled_ok;
     char *msg;
-    GLint length = (GLint)strlen(src);
-    glShaderSource( _object, 1, &src, &length );
+    glShaderSource( _object, count, src, length );
     glCompileShader( _object );
     msglError( );
     glGetShaderiv( _object, GL_COMPILE_STATUS, &compiled_ok );
@@ -174,21 +179,66 @@ public:
     glGetShaderInfoLog( _object, info_log_length, NULL, info_log);
     return( info_log );
   }
+
+private:
+  bool gatherSource( const std::string &path, std::vector<MappedFile*> &files,
+    std::vector<const GLchar*> &strings, std::vector<GLint> &lengths, int depth ){
+    if( depth > 8 ){
+      fprintf( stderr, "%s: #include nested too deeply\n", path.c_str( ) );
+      return( false );
+    }
+    MappedFile *file = new MappedFile( path.c_str( ), MappedFile::SEQUENTIAL );
+    files.push_back( file );
+    if( !file->isOpen( ) ){
+      fprintf( stderr, "%s: Can't open file %s for reading\n", __FUNCTION__, path.c_str( ) );
+      return( false );
+    }
+    std::string directory;
+    if( path.find_last_of( '/' ) != std::string::npos ){
+      directory = path.substr( 0, path.find_last_of( '/' ) + 1 );
+    }
+    const char *src = (const char*)file->data( );
+    size_t size = file->size( );
+    size_t chunk = 0;
+    size_t line = 0;
+    while( line < size ){
+      size_t end = line;
+      while( end < size && src[end] != '\n' ){
+        end++;
+      }
+      std::string text( src + line, end - line );
+      size_t open = text.find( '"' );
+      size_t close = text.rfind( '"' );
+      if( text.compare( 0, 8, "#include" ) == 0 && open != std::string::npos && close > open ){
+        if( line > chunk ){
+          strings.push_back( src + chunk );
+          lengths.push_back( (GLint)(line - chunk) );
+        }
+        if( !gatherSource( directory + text.substr( open + 1, close - open - 1 ), files, strings, lengths, depth + 1 ) ){
+          return( false );
+        }
+        chunk = end;
+      }
+      line = end + 1;
+    }
+    if( size > chunk ){
+      strings.push_back( src + chunk );
+      lengths.push_back( (GLint)(size - chunk) );
+    }
+    return( true );
+  }
 };
 
 class VertexShader : public Shader{
 
 public:
   VertexShader( const char *srcFileName ) : Shader(srcFileName){
-    char *src = file2strings( _srcFileName );
-    assert(src);
     if( (Shader::_object = glCreateShader( GL_VERTEX_SHADER )) == 0 ){
       fprintf( stderr, "Can't generate vertex shader name\n" );
     }
     msglError( );
-    compileShader( src );
+    compileFile( _srcFileName );
     msglError( );
-    free( src );
   }
 
   GLuint object( ){
@@ -202,14 +252,11 @@ class FragmentShader : public Shader{
 
 public:
   FragmentShader( const char *srcFileName ) : Shader(srcFileName){
-    char *src = file2strings( _srcFileName );
-    assert(src);
     if( (Shader::_object = glCreateShader( GL_FRAGMENT_SHADER )) == 0 ){
       fprintf( stderr, "Can't generate fragment shader name\n" );
       exit(1);
     }
-      compileShader( src );
-      free( src );
+      compileFile( _srcFileName );
     }
 
     GLuint object( ){
@@ -218,6 +265,24 @@ public:
 };
 
 
+// OpenGL 4.3 or ARB_compute_shader
+class ComputeShader : public Shader{
+
+public:
+  ComputeShader( const char *srcFileName ) : Shader(srcFileName){
+    if( (Shader::_object = glCreateShader( GL_COMPUTE_SHADER )) == 0 ){
+      fprintf( stderr, "Can't generate compute shader name\n" );
+      exit(1);
+    }
+    compileFile( _srcFileName );
+  }
+
+  GLuint object( ){
+    return Shader::_object;
+  }
+};
+
+
 class GLSLProgram{
 
 private:
@@ -253,6 +318,17 @@ public:
     return( !msglError( ) );
   }
 
+  bool attach( ComputeShader &cs ){
+    glAttachShader( _object, cs.object( ) );
+    return( !msglError( ) );
+  }
+
+  // Takes effect at the next link( )
+  bool bindAttribLocation( GLuint index, const char* name ){
+    glBindAttribLocation( _object, index, name );
+    return( !msglError( ) );
+  }
+
   bool detachAll( ){
     bool ret = false;
     GLsizei const maxCount = 32;
@@ -283,6 +359,11 @@ public:
     return( !msglError( ) );
   }
 
+  bool detach( ComputeShader &cs ){
+    glDetachShader( _object, cs.object( ) );
+    return( !msglError( ) );
+  }
+
   bool link( ){
     GLint linked_ok;
     char *msg;
@@ -396,4 +477,15 @@ bool loadShaderProgram(GLSLProgram& shaderProgram, const char* vertexShaderSourc
   return rv;
 }
 
+bool loadComputeProgram(GLSLProgram& shaderProgram, const char* computeShaderSource){
+  ComputeShader computeShader(computeShaderSource);
+  shaderProgram.attach(computeShader);
+  if( !shaderProgram.link( ) ){
+    fprintf(stderr, "Compute program %s did not link.\n", computeShaderSource);
+    return false;
+  }
+  fprintf(stderr, "Compute program built from %s with id %d.\n", computeShaderSource, shaderProgram.id( ));
+  return true;
+}
+
 #endif
@@ -0,0 +1,110 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Measures how long the GPU spends on a range of commands
+using GL_TIME_ELAPSED queries, averaged over a window of frames
+*/
+
+class GPUTimer{
+public:
+  GPUTimer(): _name(""), _window(0), _supported(false){}
+
+  GPUTimer(const char* name, int window = 120):
+	_name(name),
+	_window(window),
+	_next(0),
+	_pending(0),
+	_samples(0),
+	_totalMs(0.0),
+	_lastAverageMs(0.0),
+	_supported(GLEW_VERSION_3_3 || GLEW_ARB_timer_query){
+	if(_supported){
+		glGenQueries(QUERIES, _queries);
+	}
+  }
+
+  virtual ~GPUTimer(){}
+
+  //Must be paired with end(). Timers can't be nested
+  void begin(){
+	if(!_supported){
+		return;
+	}
+	collect();
+	if(_pending < QUERIES){
+		glBeginQuery(GL_TIME_ELAPSED, _queries[_next]);
+	}
+  }
+
+  void end(){
+	if(!_supported || _pending >= QUERIES){
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	_next = (_next + 1) % QUERIES;
+	_pending++;
+  }
+
+  /*Average GPU time in milliseconds over the last complete window,
+  or 0 if no window has completed yet*/
+  double averageMs(){
+	return _lastAverageMs;
+  }
+
+  //Prints the average once per window. Returns true when it printed
+  bool report(){
+	if(_samples < _window){
+		return false;
+	}
+	_lastAverageMs = _totalMs / _samples;
+	printf("%s: %.3f ms GPU (average of %d frames)\n", _name, _lastAverageMs, _samples);
+	reset();
+	return true;
+  }
+
+  //Throws away the samples gathered so far
+  void reset(){
+	_samples = 0;
+	_totalMs = 0.0;
+  }
+
+  void release(){
+	if(_supported){
+		glDeleteQueries(QUERIES, _queries);
+		_supported = false;
+	}
+  }
+
+private:
+  /*Results are read a few frames late so that asking for them
+  never makes the CPU wait for the GPU to catch up*/
+  enum{QUERIES = 4};
+  const char* _name;
+  int _window;
+  GLuint _queries[QUERIES];
+  int _next;//Query to use for the next begin()
+  int _pending;//Queries issued but not read back yet
+  int _samples;
+  double _totalMs;
+  double _lastAverageMs;
+  bool _supported;
+
+  void collect(){
+	while(_pending > 0){
+		GLuint oldest = _queries[(_next + QUERIES - _pending) % QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available){
+			break;
+		}
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed);
+		_totalMs += elapsed / 1000000.0;
+		_samples++;
+		_pending--;
+	}
+  }
+};
@@ -0,0 +1,112 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Maps keys to the application's actions. Once a frame, after
+events are polled, every binding is checked once and the result is kept
+as a bitset of active actions, so update() can apply all of them
+together (moving forward while strafing, for example) instead of asking
+about one key after another.
+
+HELD actions are active for as long as their key is down. PRESSED
+actions (toggles and the like) are active for the first update step
+after their key goes down and then cleared, so they fire once per press
+however many steps a frame runs. Mouse motion since the last frame is
+kept the same way, for mouse-look.
+*/
+
+#ifndef _INPUTMAP_H_
+#define _INPUTMAP_H_
+
+#include <bitset>
+#include <vector>
+
+class InputMap{
+public:
+  enum{MAX_ACTIONS = 64};
+  typedef std::bitset<MAX_ACTIONS> actions_t;
+
+  typedef enum{
+	HELD,//Active while the key is down
+	PRESSED//Active once each time the key goes down
+  }trigger_t;
+
+  InputMap(): _cursorX(0.0f), _cursorY(0.0f), _motionX(0.0f), _motionY(0.0f), _cursorKnown(false){}
+
+  virtual ~InputMap(){}
+
+  void bind(int key, unsigned int action, trigger_t trigger = HELD){
+	Binding binding = {key, action, trigger};
+	_bindings.push_back(binding);
+  }
+
+  void clear(){
+	_bindings.clear();
+	_held.reset();
+	_pressed.reset();
+  }
+
+  /*Builds the actions for this frame. keysDown says which keys are held,
+  keyHits which went down since the last call (they are cleared here).
+  The cursor position is in window pixels*/
+  void gather(const bool* keysDown, bool* keyHits, float cursorX, float cursorY){
+	_held.reset();
+	for(unsigned int i = 0; i < _bindings.size(); i++){
+		const Binding& binding = _bindings[i];
+		if(binding.trigger == HELD ? keysDown[binding.key] : keyHits[binding.key]){
+			(binding.trigger == HELD ? _held : _pressed).set(binding.action);
+		}
+	}
+	for(unsigned int i = 0; i < _bindings.size(); i++){
+		keyHits[_bindings[i].key] = false;
+	}
+	if(_cursorKnown){
+		_motionX += cursorX - _cursorX;
+		_motionY += cursorY - _cursorY;
+	}
+	_cursorX = cursorX;
+	_cursorY = cursorY;
+	_cursorKnown = true;
+  }
+
+  //Everything active for the current update step
+  actions_t actions() const{
+	return _held | _pressed;
+  }
+
+  //Pixels the cursor moved since the last step that used it
+  float motionX() const{
+	return _motionX;
+  }
+
+  float motionY() const{
+	return _motionY;
+  }
+
+  //Call after each update step so presses and mouse motion are only applied once
+  void stepped(){
+	_pressed.reset();
+	_motionX = 0.0f;
+	_motionY = 0.0f;
+  }
+
+private:
+  struct Binding{
+	int key;
+	unsigned int action;
+	trigger_t trigger;
+  };
+
+  std::vector<Binding> _bindings;
+  actions_t _held;
+  actions_t _pressed;//Kept until a step has seen them
+  float _cursorX;
+  float _cursorY;
+  float _motionX;
+  float _motionY;
+  bool _cursorKnown;
+};
+
+#endif
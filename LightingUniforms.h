@@ -0,0 +1,78 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Uniforms of shaders/lighting.glsl. Every program that includes
+it (the forward city shader and the deferred lighting pass) keeps one of
+these, so both are fed the same sun, shadows and street lamps
+*/
+
+class LightingUniforms{
+public:
+  //Texture units used by the lighting samplers; unit 0 is left for the facades
+  enum{SHADOW_UNIT = 1, CLUSTER_UNIT = 2};
+  enum{MAX_MATERIALS = 8};//Must match MAX_MATERIALS in lighting.glsl
+
+  LightingUniforms(){}
+
+  //Looks up the uniforms and points the samplers at their units. The program must be active
+  void locate(GLuint program){
+	_light0Position = glGetUniformLocation(program, "light0_position");
+	_light0Color = glGetUniformLocation(program, "light0_color");
+	_shadowMatrices = glGetUniformLocation(program, "shadowMatrices");
+	_cascadeSplits = glGetUniformLocation(program, "cascadeSplits");
+	_shadowsEnabled = glGetUniformLocation(program, "shadowsEnabled");
+	_clusterParameters = glGetUniformLocation(program, "clusterParameters");
+	_viewportSize = glGetUniformLocation(program, "viewportSize");
+	_materials = glGetUniformLocation(program, "materials");
+	glUniform1i(glGetUniformLocation(program, "shadowMap"), SHADOW_UNIT);
+	//The clustered light tables use three units in a row
+	glUniform1i(glGetUniformLocation(program, "clusterTable"), CLUSTER_UNIT);
+	glUniform1i(glGetUniformLocation(program, "lightIndices"), CLUSTER_UNIT + 1);
+	glUniform1i(glGetUniformLocation(program, "lightData"), CLUSTER_UNIT + 2);
+  }
+
+  /*Uploads the material table, indexed by facade layer. It only changes with
+  the city, so this isn't part of activate(). The program must be active*/
+  void setMaterials(const std::vector<Material>& materials){
+	std::vector<glm::vec4> table;
+	for(unsigned int i = 0; i < materials.size() && i < MAX_MATERIALS; i++){
+		table.push_back(materials[i].ambient);
+		table.push_back(materials[i].diffuse);
+		table.push_back(glm::vec4(glm::vec3(materials[i].specular), materials[i].shininess));
+	}
+	if(!table.empty()){
+		glUniform4fv(_materials, table.size(), glm::value_ptr(table[0]));
+	}
+  }
+
+  //Sets the uniforms and binds the textures. light0Position is in view space
+  void activate(const glm::vec4& light0Position, const glm::vec4& light0Color,
+	CascadedShadowMap* shadows, bool shadowsEnabled, ClusteredLights* lights, int width, int height){
+	//Divided here once rather than in every fragment
+	glm::vec3 position0 = glm::vec3(light0Position) / light0Position.w;
+	glUniform3fv(_light0Position, 1, glm::value_ptr(position0));
+	glUniform4fv(_light0Color, 1, glm::value_ptr(light0Color));
+	glUniformMatrix4fv(_shadowMatrices, CascadedShadowMap::CASCADES, false, glm::value_ptr(shadows->shadowMatrices()[0]));
+	glUniform3fv(_cascadeSplits, 1, glm::value_ptr(shadows->splits()));
+	glUniform1i(_shadowsEnabled, shadowsEnabled);
+	glUniform4fv(_clusterParameters, 1, glm::value_ptr(lights->clusterParameters()));
+	glUniform2f(_viewportSize, width, height);
+	glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadows->getTexture());
+	glActiveTexture(GL_TEXTURE0);
+	lights->bind(CLUSTER_UNIT);
+  }
+
+private:
+  GLint _light0Position;
+  GLint _light0Color;
+  GLint _shadowMatrices;
+  GLint _cascadeSplits;
+  GLint _shadowsEnabled;
+  GLint _clusterParameters;
+  GLint _viewportSize;
+  GLint _materials;
+};
@@ -0,0 +1,105 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Read-only memory mapping of a file. All asset loading
+(images, baked textures and shaders) goes through this so the bytes are
+used straight from the page cache instead of being copied through stdio
+*/
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class MappedFile{
+public:
+  //How the mapping will be read, passed on to madvise
+  typedef enum{
+	NORMAL,
+	SEQUENTIAL,//Read once from start to end, e.g. decoding an image
+	WILLNEED//Start reading the whole file ahead right away
+  }hint_t;
+
+  MappedFile(const char* path, hint_t hint = NORMAL): _data(NULL), _size(0){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		return;
+	}
+	struct stat info;
+	if(fstat(fd, &info) == 0 && info.st_size > 0){
+		void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapping != MAP_FAILED){
+			_data = (const unsigned char*)mapping;
+			_size = info.st_size;
+			advise(hint);
+		}
+	}
+	//The mapping stays valid after the descriptor is closed
+	close(fd);
+  }
+
+  virtual ~MappedFile(){
+	if(_data){
+		munmap((void*)_data, _size);
+	}
+  }
+
+  bool isOpen() const{
+	return _data != NULL;
+  }
+
+  const unsigned char* data() const{
+	return _data;
+  }
+
+  size_t size() const{
+	return _size;
+  }
+
+  //Only a hint; failures are harmless and ignored
+  void advise(hint_t hint){
+	if(!_data){
+		return;
+	}
+	switch(hint){
+	case SEQUENTIAL:
+		madvise((void*)_data, _size, MADV_SEQUENTIAL);
+		break;
+	case WILLNEED:
+		madvise((void*)_data, _size, MADV_WILLNEED);
+		break;
+	default:
+		break;
+	}
+  }
+
+  /*Drops the pages of a range that has been read and won't be again, so a
+  long sequential read doesn't keep the whole file resident. The page the
+  range ends in is kept, as the next range starts in it; reading anything
+  dropped brings it back from the file*/
+  void release(size_t offset, size_t length){
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t first = offset / page * page;
+	size_t last = std::min(offset + length, _size) / page * page;
+	if(_data && first < last){
+		madvise((void*)(_data + first), last - first, MADV_DONTNEED);
+	}
+  }
+
+private:
+  const unsigned char* _data;
+  size_t _size;
+
+  MappedFile(const MappedFile&);//Not copyable, the mapping has one owner
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif
@@ -0,0 +1,26 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Blinn-Phong surface constants. Each facade style has one;
+they are uploaded once to the lighting shaders (see LightingUniforms.h)
+and picked per fragment by the facade layer
+*/
+
+struct Material{
+  glm::vec4 ambient;
+  glm::vec4 diffuse;
+  glm::vec4 specular;
+  float shininess;
+
+  Material(const glm::vec4& a = glm::vec4(0.2f, 0.2f, 0.2f, 1.0f),
+	const glm::vec4& d = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f),
+	const glm::vec4& s = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+	float shine = 100.0f):
+	ambient(a),
+	diffuse(d),
+	specular(s),
+	shininess(shine){}
+};
@@ -1,13 +1,27 @@
+//Where a building stands and how big it is, for the Plane's editing calls
+struct BuildingSpec{
+  float x;
+  float z;
+  float size;//Half the width and depth
+  float height;
+  unsigned int layer;//Facade style
+  unsigned int shape;//Footprint from Building::makeShape(), 0 for a plain square box
+};
+
 class Plane{
 public:
-  Plane(int size):_size(size), _block(10.0f){
-	Texture* _texture = new Texture("textures/building.jpg");
-	Texture* _texture1 = new Texture("textures/building2.jpg");
-	_textures.push_back(_texture);
-	_textures.push_back(_texture1);
-	//In the future, add more textures here
+  Plane(int size, TextureManager& textures):_size(size), _block(10.0f), _mesh(NULL), _count(0){
+	/*Every facade style is a layer of one array texture,
+	so adding styles here costs no extra bindings or draw calls*/
+	std::vector<std::string> facades;
+	facades.push_back("textures/building.jpg");
+	facades.push_back("textures/building2.jpg");
+	setFacades(facades, textures);
 	int buildingCount = 0;
 	int randomTexture = 0;
+	//Buildings of each 12 x 12 block, for handing the baking out to threads
+	int blockColumns = (_size + 6) / 12 + 1;
+	std::vector<std::vector<unsigned int> > blocks(blockColumns * ((_size + 6) / 12 + 1));
 
 	/*City Model reference: spawnBuildings() from:
 	https://bitbucket.org/whleucka/cpsc-graphics-final/src/856ef81f67cf92f90c84368965331069d2de4e0f/src/main.cpp?at=master&fileviewer=file-view-default*/
@@ -43,39 +57,475 @@ public:
 					Note that for every block, there are 2 sets of buildings, 
 					so each block will have eight buildings*/
 					buildingCount = 0;
-					randomTexture = rand() % 2;
+					randomTexture = rand() % facades.size();
 				}
 
 				buildingCount++;
 
-				if(randomTexture == 0){
-					Building* _building = new Building(i,//x will be [2, 4, 6, 8]
-						j,//Starting at -2, z will be increments of 6 in the negative z
-						randomSize,//Can be [1, 2]
-						randomHeight,//Can be [1, 25]
-						_textures[0]->getTexture());
-					_buildings.push_back(_building);
-				}else{
-					Building* _building = new Building(i,
-						j,
-						randomSize,
-						randomHeight,
-						_textures[1]->getTexture());
-					_buildings.push_back(_building);
+				//Half the buildings get a footprint of their own
+				unsigned int shape = 0;
+				switch(rand() % 6){
+				case 0://L shaped, with the notch in any corner
+					shape = Building::makeShape(256 * (rand() % 4), true, 0, rand() % 8);
+					break;
+				case 1://Turned
+					shape = Building::makeShape(rand() % 256, false, 0, 0);
+					break;
+				case 2://Set back as it rises, if it is tall enough
+					shape = Building::makeShape(256 * (rand() % 4), rand() % 2 == 0, randomHeight > 5 ? rand() % 3 + 1 : 0, rand() % 8);
+					break;
 				}
+
+				Building* _building = new Building(i,//x will be [2, 4, 6, 8]
+					j,//Starting at -2, z will be increments of 6 in the negative z
+					randomSize,//Can be [1, 2]
+					randomHeight,//Can be [1, 25]
+					randomTexture,//Layer of the facade array
+					shape);
+				blocks[i / 12 + (-j / 12) * blockColumns].push_back(_buildings.size());
+				_buildings.push_back(_building);
 			}
 		}
 	}
+
+	index();
+	_baker.bake(_buildings, blocks, _grid);
+	buildMesh();
+  }
+
+  /*Opens a saved city instead of generating one. Its occlusion was baked
+  before it was saved, so there is nothing to generate or bake, but each
+  record of the file's columns is still made into a Building, and the
+  grid and the mesh are built from those like a generated city's. The
+  mesh is most of the time*/
+  Plane(const CityFile& file, TextureManager& textures):
+	_size(file.header().size),
+	_block(10.0f),
+	_mesh(NULL),
+	_count(0){
+	double start = glfwGetTime();
+	const CityFileHeader& header = file.header();
+	std::vector<std::string> facades;
+	for(uint32_t i = 0; i < header.textures; i++){
+		facades.push_back(file.texture(i));
+	}
+	setFacades(facades, textures);
+	const float* x = file.x();
+	const float* z = file.z();
+	const float* size = file.size();
+	const float* height = file.height();
+	const uint32_t* layer = file.layer();
+	const uint32_t* shape = file.shape();
+	_buildings.reserve(header.buildings);
+	for(uint32_t i = 0; i < header.buildings; i++){
+		Building* building = new Building(x[i], z[i], size[i], height[i], layer[i], shape[i]);
+		const uint8_t* open = file.occlusion(i);
+		for(int f = 0; f < Building::FACES; f++){
+			for(int c = 0; c < 4; c++){
+				building->setOcclusion(f, c, open[f * 4 + c] / 255.0f);
+			}
+		}
+		_buildings.push_back(building);
+	}
+	double made = glfwGetTime();
+	index();
+	double indexed = glfwGetTime();
+	buildMesh();
+	double now = glfwGetTime();
+	printf("City opened: %u buildings in %u blocks in %.1f ms (buildings %.1f ms, grid %.1f ms, mesh %.1f ms)\n", header.buildings,
+		header.blocks, 1000.0 * (now - start), 1000.0 * (made - start), 1000.0 * (indexed - made), 1000.0 * (now - indexed));
   }
 
   virtual ~Plane(){
+	delete _mesh;
+	for(std::vector<Building*>::iterator it = _buildings.begin(); it != _buildings.end(); ++it){
+		delete *it;//NULL for removed ones
+	}
  	_buildings.clear();
-	_textures.clear();
+  }
+
+  /*Writes the city, edits and all, to a .city file (see CityFile.h).
+  Buildings are grouped into 12 x 12 blocks like the generated ones.
+  Returns false if the file can't be written*/
+  bool save(const char* path){
+	CityData city;
+	city.size = _size;
+	city.textures = _facadePaths;
+	const float blockSize = 12.0f;
+	int columns = int((_boundsMax.x - _boundsMin.x) / blockSize) + 1;
+	int rows = int((_boundsMax.z - _boundsMin.z) / blockSize) + 1;
+	std::vector<std::vector<unsigned int> > blocks(columns * rows);
+	for(unsigned int i = 0; i < _buildings.size(); i++){
+		if(_buildings[i]){
+			int column = std::min(columns - 1, int((_buildings[i]->x() - _boundsMin.x) / blockSize));
+			int row = std::min(rows - 1, int((_buildings[i]->z() - _boundsMin.z) / blockSize));
+			blocks[column + row * columns].push_back(i);
+		}
+	}
+	for(unsigned int b = 0; b < blocks.size(); b++){
+		if(blocks[b].empty()){
+			continue;
+		}
+		CityFileBlock block;
+		block.first = city.buildings();
+		block.count = blocks[b].size();
+		glm::vec3 blockMin = _buildings[blocks[b][0]]->boundsMin();
+		glm::vec3 blockMax = _buildings[blocks[b][0]]->boundsMax();
+		for(unsigned int i = 0; i < blocks[b].size(); i++){
+			Building* building = _buildings[blocks[b][i]];
+			blockMin = glm::min(blockMin, building->boundsMin());
+			blockMax = glm::max(blockMax, building->boundsMax());
+			city.x.push_back(building->x());
+			city.z.push_back(building->z());
+			city.buildingSize.push_back(building->size());
+			city.height.push_back(building->height());
+			city.layer.push_back(building->layer());
+			city.shape.push_back(building->shape());
+			for(int f = 0; f < Building::FACES; f++){
+				for(int c = 0; c < 4; c++){
+					//Rounded the same way as in the mesh, so a saved city looks the same
+					city.occlusion.push_back(uint8_t(building->occlusion(f, c) * 255.0f + 0.5f));
+				}
+			}
+		}
+		for(int a = 0; a < 3; a++){
+			block.boundsMin[a] = blockMin[a];
+			block.boundsMax[a] = blockMax[a];
+		}
+		city.blocks.push_back(block);
+	}
+	return writeCityFile(path, city);
+  }
+
+  //Switch how every building texture is filtered
+  void setTextureFilter(Texture::filter_t filter){
+	if(_facades){
+		_facades->setFilter(filter);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+  }
+
+  /*Lets go of the facade array while the facades are drawn procedurally
+  (shaders/facade.glsl), so it is freed unless something else holds it,
+  and loads it again when load is true. Its filter starts as the default*/
+  void loadFacades(bool load, TextureManager& textures){
+	if(!load){
+		_facades.reset();
+	}else if(!_facades){
+		_facades = textures.acquireArray(_facadePaths);
+	}
+  }
+
+  /*Draw only the buildings inside a light's view volume into a shadow map.
+  The ground can't shadow anything, so it is skipped. With a stream buffer
+  the visible list is drawn from the mesh in one call.
+  Returns how many buildings were drawn*/
+  int drawShadowCasters(const Frustum& frustum, RingBuffer* stream){
+	if(_mesh && stream){
+		int drawn = _mesh->drawVisible(frustum, stream);
+		if(drawn >= 0){
+			return drawn;
+		}
+	}
+	int drawn = 0;
+	for(std::vector<Building*>::iterator it = _buildings.begin(); it != _buildings.end(); ++it){
+		if(*it && frustum.intersects((*it)->boundsMin(), (*it)->boundsMax())){
+			(*it)->draw();
+			drawn++;
+		}
+	}
+	return drawn;
+  }
+
+  //Outlines every building inside the frustum
+  void addBounds(const Frustum& frustum, DebugLines& lines){
+	for(std::vector<Building*>::iterator it = _buildings.begin(); it != _buildings.end(); ++it){
+		if(*it && frustum.intersects((*it)->boundsMin(), (*it)->boundsMax())){
+			lines.box((*it)->boundsMin(), (*it)->boundsMax());
+		}
+	}
+  }
+
+  /*Spread count street lamps evenly along the streets between the blocks.
+  Streets run along x between rows of blocks and along z between columns,
+  and the first one of each runs between the map's edge and the first block*/
+  std::vector<PointLight> streetLamps(int count){
+	std::vector<PointLight> lamps;
+	std::vector<glm::vec4> streets;//Start x, start z, end x, end z
+	for(int j = 0; j < _size; j += 12){
+		streets.push_back(glm::vec4(-1.0f, -j - 11.0f, _size + 7.0f, -j - 11.0f));
+	}
+	for(int i = 0; i < _size; i += 12){
+		streets.push_back(glm::vec4(i + 11.0f, 1.0f, i + 11.0f, -_size - 7.0f));
+	}
+	streets.push_back(glm::vec4(-1.0f, 1.0f, _size + 7.0f, 1.0f));
+	streets.push_back(glm::vec4(-1.0f, 1.0f, -1.0f, -_size - 7.0f));
+	float total = 0.0f;
+	for(unsigned int s = 0; s < streets.size(); s++){
+		total += glm::length(glm::vec2(streets[s].z - streets[s].x, streets[s].w - streets[s].y));
+	}
+	if(count <= 0){
+		return lamps;
+	}
+	float spacing = total / count;
+	float along = spacing * 0.5f;//Distance into the current street of the next lamp
+	for(unsigned int s = 0; s < streets.size() && (int)lamps.size() < count; s++){
+		glm::vec2 start(streets[s].x, streets[s].y);
+		glm::vec2 end(streets[s].z, streets[s].w);
+		float length = glm::length(end - start);
+		for(; along < length && (int)lamps.size() < count; along += spacing){
+			glm::vec2 p = start + (end - start) * (along / length);
+			PointLight lamp;
+			lamp.position = glm::vec3(p.x, 1.5f, p.y);
+			lamp.radius = 6.0f;
+			lamp.color = glm::vec3(1.0f, 0.75f, 0.45f);//Sodium lamp orange
+			lamps.push_back(lamp);
+		}
+		along -= length;
+	}
+	return lamps;
+  }
+
+  const std::vector<Material>& materials(){
+	return _materials;
+  }
+
+  /*Box around the ground, the boundary lines and the tallest possible building.
+  Grows to take in edited buildings that stick out of it, never shrinks*/
+  glm::vec3 boundsMin(){
+	return _boundsMin;
+  }
+
+  glm::vec3 boundsMax(){
+	return _boundsMax;
+  }
+
+  /*Editing. Buildings are identified by the id these return (those made
+  with the city are 0 to buildingCount() - 1 to start with); an id stays
+  the same until the building is removed and can then be given to a new
+  one. Each edit updates the spatial grid, the bounds and the building's
+  part of the mesh in place, and queues the nearby buildings' occlusion to
+  be baked again a few per frame. Ids are not kept when the city is
+  regenerated. Returns -1 for a spec that isn't all finite numbers within MAX_REACH*/
+  int addBuilding(const BuildingSpec& spec){
+	if(!valid(spec)){
+		return -1;
+	}
+	int id = newBuilding(spec);
+	placed(id);
+	if(_mesh){
+		_meshHandles[id] = _mesh->place(*_buildings[id]);
+	}
+	return id;
+  }
+
+  //Moves, resizes, restyles or reshapes a building. False if there is no building id or the spec isn't valid()
+  bool modifyBuilding(int id, const BuildingSpec& spec){
+	if(!exists(id) || !valid(spec)){
+		return false;
+	}
+	Building* building = _buildings[id];
+	_grid.remove(id);
+	markNearby(building->boundsMin(), building->boundsMax());//Neighbours of where it was
+	building->reshape(spec.x, spec.z, spec.size, spec.height, spec.layer % _materials.size(), spec.shape);
+	placed(id);
+	if(_mesh){
+		_mesh->update(_meshHandles[id], *building);
+	}
+	return true;
+  }
+
+  //False if there is no building id
+  bool removeBuilding(int id){
+	if(!exists(id)){
+		return false;
+	}
+	Building* building = _buildings[id];
+	_grid.remove(id);
+	markNearby(building->boundsMin(), building->boundsMax());
+	if(_mesh){
+		_mesh->free(_meshHandles[id]);
+		_meshHandles[id] = -1;
+	}
+	delete building;
+	_buildings[id] = NULL;
+	_freeIds.push_back(id);
+	_count--;
+	return true;
+  }
+
+  /*Bulk versions of the above for scripts, with ids[i] going with specs[i].
+  Adding grows the grid at most once for all of the buildings and places
+  their meshes with one upload; removing uploads the mesh's records once.
+  The grid and the occlusion are still updated a building at a time*/
+  void addBuildings(const std::vector<BuildingSpec>& specs, std::vector<int>& ids){
+	ids.assign(specs.size(), -1);
+	std::vector<unsigned int> added;
+	for(unsigned int i = 0; i < specs.size(); i++){
+		if(valid(specs[i])){
+			ids[i] = newBuilding(specs[i]);
+			added.push_back(ids[i]);
+		}
+	}
+	if(added.empty()){
+		return;
+	}
+	glm::vec3 addedMin = _buildings[added[0]]->boundsMin();
+	glm::vec3 addedMax = _buildings[added[0]]->boundsMax();
+	for(unsigned int i = 0; i < added.size(); i++){
+		addedMin = glm::min(addedMin, _buildings[added[i]]->boundsMin());
+		addedMax = glm::max(addedMax, _buildings[added[i]]->boundsMax());
+	}
+	_boundsMin = glm::min(_boundsMin, addedMin);
+	_boundsMax = glm::max(_boundsMax, addedMax);
+	if(!_grid.covers(addedMin, addedMax)){
+		regrid();//Takes in the new buildings too
+	}else{
+		for(unsigned int i = 0; i < added.size(); i++){
+			_grid.insert(added[i], _buildings[added[i]]->boundsMin(), _buildings[added[i]]->boundsMax());
+		}
+	}
+	for(unsigned int i = 0; i < added.size(); i++){
+		markNearby(_buildings[added[i]]->boundsMin(), _buildings[added[i]]->boundsMax());
+	}
+	if(_mesh){
+		std::vector<Building*> buildings(added.size());
+		for(unsigned int i = 0; i < added.size(); i++){
+			buildings[i] = _buildings[added[i]];
+		}
+		std::vector<int> handles;
+		_mesh->placeAll(buildings, handles);
+		for(unsigned int i = 0; i < added.size(); i++){
+			_meshHandles[added[i]] = handles[i];
+		}
+	}
+  }
+
+  //Returns how many of the ids were buildings. A loop over modifyBuilding(), for convenience
+  int modifyBuildings(const std::vector<int>& ids, const std::vector<BuildingSpec>& specs){
+	int modified = 0;
+	for(unsigned int i = 0; i < ids.size() && i < specs.size(); i++){
+		modified += modifyBuilding(ids[i], specs[i]);
+	}
+	return modified;
+  }
+
+  int removeBuildings(const std::vector<int>& ids){
+	std::vector<int> handles;
+	int removed = 0;
+	for(unsigned int i = 0; i < ids.size(); i++){
+		int id = ids[i];
+		if(!exists(id)){
+			continue;
+		}
+		Building* building = _buildings[id];
+		_grid.remove(id);
+		markNearby(building->boundsMin(), building->boundsMax());
+		if(_mesh){
+			handles.push_back(_meshHandles[id]);
+			_meshHandles[id] = -1;
+		}
+		delete building;
+		_buildings[id] = NULL;
+		_freeIds.push_back(id);
+		_count--;
+		removed++;
+	}
+	if(_mesh){
+		_mesh->freeAll(handles);
+	}
+	return removed;
+  }
+
+  //Where building id is and how big, false if there is none
+  bool building(int id, BuildingSpec& spec){
+	if(!exists(id)){
+		return false;
+	}
+	Building* building = _buildings[id];
+	spec.x = building->x();
+	spec.z = building->z();
+	spec.size = building->size();
+	spec.height = building->height();
+	spec.layer = building->layer();
+	spec.shape = building->shape();
+	return true;
+  }
+
+  //The building a ray hits first, or -1 if it hits none within maxDistance
+  int pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance){
+	unsigned int id;
+	float distance;
+	return _grid.nearest(origin, direction, maxDistance, id, distance) ? int(id) : -1;
+  }
+
+  size_t buildingCount(){
+	return _count;
+  }
+
+  /*Times edits rounds of modifying, removing and adding random buildings,
+  one at a time and in bulk, and prints the edits per second. The GPU
+  uploads are finished inside the timing; the occlusion baked again
+  afterwards is not*/
+  void benchmarkEdits(int edits){
+	std::vector<int> ids;
+	for(unsigned int i = 0; i < _buildings.size() && ids.size() < (size_t)edits; i += std::max<size_t>(1, _buildings.size() / edits)){
+		if(_buildings[i]){
+			ids.push_back(i);
+		}
+	}
+	std::vector<BuildingSpec> specs(ids.size());
+	std::vector<BuildingSpec> taller(ids.size());
+	for(unsigned int i = 0; i < ids.size(); i++){
+		building(ids[i], specs[i]);
+		taller[i] = specs[i];
+		taller[i].height = rand() % 25 + 1;
+	}
+	glFinish();
+	double rates[5];
+	const char* names[5] = {"modify", "remove", "add", "bulk remove", "bulk add"};
+	double start = glfwGetTime();
+	for(unsigned int i = 0; i < ids.size(); i++){
+		modifyBuilding(ids[i], taller[i]);
+	}
+	rates[0] = finished(start, ids.size());
+	for(unsigned int i = 0; i < ids.size(); i++){
+		removeBuilding(ids[i]);
+	}
+	rates[1] = finished(start, ids.size());
+	for(unsigned int i = 0; i < ids.size(); i++){
+		ids[i] = addBuilding(specs[i]);
+	}
+	rates[2] = finished(start, ids.size());
+	removeBuildings(ids);
+	rates[3] = finished(start, ids.size());
+	addBuildings(specs, ids);
+	rates[4] = finished(start, ids.size());
+	printf("Edits at %zu buildings (%zu of each):", _count, ids.size());
+	for(int i = 0; i < 5; i++){
+		printf(" %s %.0f/s%s", names[i], rates[i], i < 4 ? "," : "\n");
+	}
+  }
+
+  //How full the building mesh's buffers are and what editing them costs
+  void reportMesh(){
+	if(_mesh){
+		_mesh->report();
+	}
+  }
+
+  //True if the buildings can be culled and drawn on the GPU
+  bool gpuDriven(){
+	return _mesh != NULL;
   }
 
   /*Start by drawing the blocks
-  (The regions where the buildings will sit on top of)*/
-  void draw(){
+  (The regions where the buildings will sit on top of).
+  The buildings outside the frustum are skipped, on the GPU if gpuDriven is set.
+  Otherwise the visible list goes through stream when there is one*/
+  void draw(const Frustum& frustum, bool gpuDriven, RingBuffer* stream){
+	//The ground and lines are given whole positions, not packed ones
+	glVertexAttrib4f(Building::ORIGIN_ATTRIBUTE, 0.0f, 0.0f, 0.0f, 1.0f);
 	glColor4f(0.0, 1.0, 0.0, 1.0f);
 	glBegin(GL_QUADS);//Start drawing a 17 x 17 quadrilateral
 	for(int j = 0; j < _size; j += 12){//Go to one row
@@ -118,15 +568,180 @@ public:
 
 	glEnd();
 
-	//Draw Buildings
-	for(std::vector<Building*>::iterator it = _buildings.begin(); it != _buildings.end(); ++it){
-		(*it)->draw();
+	//Draw Buildings, all of them sample the same facade array
+	rebake(REBAKE_BUILDINGS);
+	if(_mesh){
+		_mesh->compact(COMPACT_MOVES);
 	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _facades ? _facades->getTexture() : 0);
+	if(gpuDriven && _mesh){
+		_mesh->draw(frustum);
+	}else if(!_mesh || !stream || _mesh->drawVisible(frustum, stream) < 0){
+		for(std::vector<Building*>::iterator it = _buildings.begin(); it != _buildings.end(); ++it){
+			if(*it && frustum.intersects((*it)->boundsMin(), (*it)->boundsMax())){
+				(*it)->draw();
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
   }
 
 private:
+  enum{COMPACT_MOVES = 32};//Meshes moved into holes in the mesh's buffers each frame
+  enum{REBAKE_BUILDINGS = 8};//Buildings near edits whose occlusion is baked again each frame
+  enum{GRID_CELL = 4};//Size of the spatial grid's cells, unless it covers too much for that
+  enum{MAX_REACH = 1000000000};//Furthest from the origin, and biggest, a building can be
+
   int _size;
   float _block;//Size of the block (a.k.a. the length of the "street")
   std::vector<Building*> _buildings;
-  std::vector<Texture*> _textures;
+  TextureHandle _facades;//One layer per facade style, none while they are procedural
+  std::vector<std::string> _facadePaths;//Image of each layer, for saving
+  std::vector<Material> _materials;//One per facade style
+  SpatialGrid _grid;//Every building's box, by its index in _buildings
+  CityMesh* _mesh;//The buildings for GPU culling, NULL without OpenGL 4.3
+  std::vector<int> _meshHandles;//Each building's handle in _mesh
+  std::vector<unsigned int> _freeIds;//Left by removed buildings (NULL in _buildings)
+  size_t _count;//Buildings that aren't removed
+  glm::vec3 _boundsMin;
+  glm::vec3 _boundsMax;
+  AmbientOcclusionBaker _baker;
+  std::deque<unsigned int> _rebake;//Buildings whose occlusion is out of date, oldest first
+  std::vector<bool> _stale;//Whether each building is in _rebake
+  std::vector<unsigned int> _nearby;//Scratch for grid queries
+
+  //Loads the facade array and gives each style the default material
+  void setFacades(const std::vector<std::string>& facades, TextureManager& textures){
+	_facadePaths = facades;
+	_facades = textures.acquireArray(facades);
+	//Surface constants of each facade style, in the same order
+	_materials.assign(facades.size(), Material());
+  }
+
+  //Bounds and grid for the buildings just made or loaded
+  void index(){
+	_boundsMin = glm::vec3(-2.0f, 0.0f, -_size - 8.0f);
+	_boundsMax = glm::vec3(_size + 8.0f, 26.0f, 2.0f);
+	for(unsigned int i = 0; i < _buildings.size(); i++){
+		_boundsMin = glm::min(_boundsMin, _buildings[i]->boundsMin());
+		_boundsMax = glm::max(_boundsMax, _buildings[i]->boundsMax());
+	}
+	_count = _buildings.size();
+	_grid = SpatialGrid(boundsMin(), boundsMax(), GRID_CELL);
+	for(unsigned int i = 0; i < _buildings.size(); i++){
+		_grid.insert(i, _buildings[i]->boundsMin(), _buildings[i]->boundsMax());
+	}
+	_stale.assign(_buildings.size(), false);
+  }
+
+  //Occlusion is baked into the vertices, so this comes after it. The mesh's handles start out as the building ids
+  void buildMesh(){
+	if(CityMesh::supported()){
+		_mesh = new CityMesh(_buildings);
+		for(unsigned int i = 0; i < _buildings.size(); i++){
+			_meshHandles.push_back(i);
+		}
+	}
+  }
+
+  bool exists(int id){
+	return id >= 0 && id < (int)_buildings.size() && _buildings[id];
+  }
+
+  //Makes the building for spec under a free id (or a new one) and returns the id; nothing else knows of it yet
+  int newBuilding(const BuildingSpec& spec){
+	Building* building = new Building(spec.x, spec.z, spec.size, spec.height, spec.layer % _materials.size(), spec.shape);
+	int id;
+	if(_freeIds.empty()){
+		id = _buildings.size();
+		_buildings.push_back(building);
+		_stale.push_back(false);
+		_meshHandles.push_back(-1);
+	}else{
+		id = _freeIds.back();
+		_freeIds.pop_back();
+		_buildings[id] = building;
+	}
+	_count++;
+	return id;
+  }
+
+  /*A NaN or infinite building would never fit in the grid, and one
+  further out than MAX_REACH would overflow the bounds around it*/
+  static bool valid(const BuildingSpec& spec){
+	const float values[4] = {spec.x, spec.z, spec.size, spec.height};
+	for(int i = 0; i < 4; i++){
+		if(!std::isfinite(values[i]) || fabs(values[i]) > MAX_REACH){
+			return false;
+		}
+	}
+	return true;
+  }
+
+  /*Puts building id (new or reshaped) into the grid and the bounds. A
+  building outside the grid would be clamped into its border cells, where
+  rays from outside the grid never look, so the grid is made again first*/
+  void placed(unsigned int id){
+	Building* building = _buildings[id];
+	_boundsMin = glm::min(_boundsMin, building->boundsMin());
+	_boundsMax = glm::max(_boundsMax, building->boundsMax());
+	if(!_grid.covers(building->boundsMin(), building->boundsMax())){
+		regrid();
+	}
+	_grid.insert(id, building->boundsMin(), building->boundsMax());
+	markNearby(building->boundsMin(), building->boundsMax());
+  }
+
+  /*Makes the grid again over the bounds with half their size again to
+  spare on every side, so buildings added further and further out only
+  cost a few of these*/
+  void regrid(){
+	glm::vec3 spare = (_boundsMax - _boundsMin) * 0.5f;
+	_grid = SpatialGrid(_boundsMin - spare, _boundsMax + spare, GRID_CELL);
+	for(unsigned int i = 0; i < _buildings.size(); i++){
+		if(_buildings[i]){
+			_grid.insert(i, _buildings[i]->boundsMin(), _buildings[i]->boundsMax());
+		}
+	}
+  }
+
+  //Queues every building close enough to the box to be darkened by it (including itself)
+  void markNearby(const glm::vec3& boxMin, const glm::vec3& boxMax){
+	glm::vec3 reach(_baker.distance(), 0.0f, _baker.distance());
+	_grid.query(boxMin - reach, boxMax + reach, _nearby);
+	for(unsigned int i = 0; i < _nearby.size(); i++){
+		if(!_stale[_nearby[i]]){
+			_stale[_nearby[i]] = true;
+			_rebake.push_back(_nearby[i]);
+		}
+	}
+  }
+
+  //Bakes up to count queued buildings again and rewrites their meshes
+  void rebake(int count){
+	int baked = 0;
+	while(baked < count && !_rebake.empty()){
+		unsigned int id = _rebake.front();
+		_rebake.pop_front();
+		_stale[id] = false;
+		if(!_buildings[id]){
+			continue;
+		}
+		_baker.bakeBuilding(_buildings[id], id, _grid);
+		if(_mesh){
+			_mesh->update(_meshHandles[id], *_buildings[id]);
+		}
+		baked++;
+	}
+  }
+
+  //Edits per second since start, after the GPU is done with them. Resets start
+  static double finished(double& start, size_t edits){
+	glFinish();
+	double now = glfwGetTime();
+	double rate = edits / std::max(1e-9, now - start);
+	start = now;
+	return rate;
+  }
 };
@@ -0,0 +1,164 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Streams data that changes every frame to the GPU (OpenGL 4.4
+or ARB_buffer_storage).
+
+One buffer is created with glBufferStorage and mapped once, persistently
+and coherently, and split into FRAMES parts. Each frame writes into its
+own part straight through the mapping, so there are no glBufferData or
+glMapBuffer calls and the driver never copies or synchronises. A fence
+is put in after each frame's commands; before a part is written again
+its fence must have passed, which with three parts means the GPU may run
+up to two frames behind without the CPU waiting. When it does have to
+wait it is counted as a stall.
+
+The same buffer can be bound to any target, so pixel uploads, indirect
+draw commands and vertices all come from here. A frame that needs more
+than its part gets NULL back (the caller uses its old path for that
+frame) and the buffer is grown at the start of the next one.
+*/
+
+class RingBuffer{
+public:
+  enum{FRAMES = 3};
+
+  static bool supported(){
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+  }
+
+  RingBuffer(size_t frameBytes):
+	_frameBytes(0),
+	_wantedBytes(frameBytes),
+	_buffer(0),
+	_data(NULL),
+	_frame(0),
+	_used(0),
+	_peak(0),
+	_frames(0),
+	_stalls(0),
+	_stallMs(0.0),
+	_overflows(0){
+	for(int i = 0; i < FRAMES; i++){
+		_fences[i] = 0;
+	}
+	resize();
+  }
+
+  virtual ~RingBuffer(){
+	for(int i = 0; i < FRAMES; i++){
+		if(_fences[i]){
+			glDeleteSync(_fences[i]);
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &_buffer);
+  }
+
+  //Moves on to the next part, waiting for the GPU only if it is still reading it
+  void beginFrame(){
+	if(_wantedBytes > _frameBytes){
+		resize();
+	}
+	_frame = (_frame + 1) % FRAMES;
+	wait(_frame);
+	_used = 0;
+	_frames++;
+  }
+
+  //Call after the last command that reads this frame's data
+  void endFrame(){
+	_peak = std::max(_peak, _used);
+	if(_fences[_frame]){
+		glDeleteSync(_fences[_frame]);
+	}
+	_fences[_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  /*Room for bytes in this frame's part, or NULL if it is full. offset is
+  where that is from the start of buffer(), for passing to GL*/
+  void* allocate(size_t bytes, GLintptr& offset, size_t alignment = 256){
+	size_t start = (_used + alignment - 1) / alignment * alignment;
+	if(start + bytes > _frameBytes){
+		_overflows++;
+		_wantedBytes = std::max(_wantedBytes, 2 * (start + bytes));
+		return NULL;
+	}
+	_used = start + bytes;
+	offset = _frame * _frameBytes + start;
+	return _data + offset;
+  }
+
+  GLuint buffer(){
+	return _buffer;
+  }
+
+  //Prints the stalls since the last report
+  void report(){
+	printf("Stream buffer: %zu KB x %d, peak %zu KB a frame, %d of %d frames waited for the GPU (%.3f ms), %d allocations didn't fit\n",
+		_frameBytes / 1024, FRAMES, _peak / 1024, _stalls, _frames, _stallMs, _overflows);
+	_peak = 0;
+	_frames = 0;
+	_stalls = 0;
+	_stallMs = 0.0;
+	_overflows = 0;
+  }
+
+private:
+  size_t _frameBytes;//Size of each frame's part
+  size_t _wantedBytes;//Grown to this at the next beginFrame()
+  GLuint _buffer;
+  unsigned char* _data;//The whole buffer, mapped for as long as it exists
+  GLsync _fences[FRAMES];//Passed once the GPU is done with each part
+  int _frame;//Part being written
+  size_t _used;//Bytes handed out from it
+  size_t _peak;
+  int _frames;
+  int _stalls;
+  double _stallMs;
+  int _overflows;
+
+  void wait(int frame){
+	if(!_fences[frame]){
+		return;
+	}
+	if(glClientWaitSync(_fences[frame], 0, 0) == GL_TIMEOUT_EXPIRED){
+		double start = glfwGetTime();
+		//Flush so the fence itself is sure to reach the GPU
+		while(glClientWaitSync(_fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED){
+		}
+		_stalls++;
+		_stallMs += 1000.0 * (glfwGetTime() - start);
+	}
+	glDeleteSync(_fences[frame]);
+	_fences[frame] = 0;
+  }
+
+  //(Re)creates the buffer with _wantedBytes a frame. Any old one is still in use, so every fence is waited for
+  void resize(){
+	for(int i = 0; i < FRAMES; i++){
+		wait(i);
+	}
+	if(_buffer){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glDeleteBuffers(1, &_buffer);
+	}
+	_frameBytes = _wantedBytes;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, _frameBytes * FRAMES, NULL, flags);
+	_data = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, _frameBytes * FRAMES, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	_used = 0;
+  }
+
+  RingBuffer(const RingBuffer&);//Owns a GL buffer, not copyable
+  RingBuffer& operator=(const RingBuffer&);
+};
@@ -0,0 +1,237 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Cascaded shadow maps for the SpinningLight, treated as a
+sun shining from its position towards its center.
+
+The camera frustum (up to _shadowDistance) is cut into CASCADES slices.
+Each slice gets its own layer of a depth texture array, rendered from
+an orthographic light view that encloses a bounding sphere of the slice.
+Only buildings inside that light view are drawn into it.
+
+A cascade is cached: it is only re-rendered when the light turns or
+the camera moves its slice further than a fraction of the sphere's
+radius. The sphere is padded by the same fraction when fitted, so the
+cached map still covers the slice until it is re-rendered.
+*/
+
+class CascadedShadowMap{
+public:
+  enum{CASCADES = 3};
+
+  CascadedShadowMap(int resolution = 2048, float shadowDistance = 250.0f):
+	_resolution(resolution),
+	_shadowDistance(shadowDistance),
+	_moveThreshold(0.1f),
+	_turnThreshold(0.9999f),//About 0.8 degrees
+	_renders(0),
+	_updates(0),
+	_casters(0){
+	for(int i = 0; i < CASCADES; i++){
+		_centers[i] = glm::vec3(0.0f);
+		_directions[i] = glm::vec3(0.0f);
+		_radii[i] = 0.0f;
+	}
+	glGenTextures(1, &_depth);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _depth);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24,
+		_resolution, _resolution, CASCADES, 0,
+		GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	//Hardware depth comparison plus bilinear filtering gives 2x2 PCF per lookup
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _depth, 0, 0);
+	glDrawBuffer(GL_NONE);//Depth only
+	glReadBuffer(GL_NONE);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		printf("Shadow map framebuffer is incomplete.\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	_depthProgram.bindAttribLocation(Building::ORIGIN_ATTRIBUTE, "origin");
+	if(!loadShaderProgram(_depthProgram, "shaders/shadow_depth.vert.glsl", "shaders/shadow_depth.frag.glsl")){
+		exit(1);
+	}
+	_uLightViewProjection = glGetUniformLocation(_depthProgram.id(), "lightViewProjection");
+	_depthProgram.deactivate();
+	invalidate();
+  }
+
+  virtual ~CascadedShadowMap(){
+	glDeleteFramebuffers(1, &_framebuffer);
+	glDeleteTextures(1, &_depth);
+  }
+
+  //Forces every cascade to be re-rendered, e.g. after the city changed
+  void invalidate(){
+	for(int i = 0; i < CASCADES; i++){
+		_valid[i] = false;
+	}
+  }
+
+  /*Fits the cascades to the camera and re-renders the ones whose cache
+  is no longer good enough. Changes the framebuffer and the viewport*/
+  void update(const glm::mat4& view, float fovy, float aspect, float zNear,
+	const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax, World* world){
+	glm::vec3 direction = glm::normalize(lightDirection);
+	glm::mat4 inverseView = glm::inverse(view);
+	float zFar = _shadowDistance;
+	float sceneRadius = 0.5f * glm::length(sceneMax - sceneMin);
+	glm::vec3 sceneCenter = 0.5f * (sceneMax + sceneMin);
+
+	//Practical split scheme: a blend of logarithmic and uniform splits
+	float lambda = 0.8f;
+	float splitNear = zNear;
+	for(int i = 0; i < CASCADES; i++){
+		float p = float(i + 1) / CASCADES;
+		float logSplit = zNear * pow(zFar / zNear, p);
+		float uniformSplit = zNear + (zFar - zNear) * p;
+		float splitFar = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+		_splits[i] = splitFar;
+
+		glm::vec3 center;
+		float radius;
+		sliceSphere(inverseView, fovy, aspect, splitNear, splitFar, center, radius);
+		splitNear = splitFar;
+
+		bool moved = glm::length(center - _centers[i]) > _moveThreshold * radius;
+		bool turned = glm::dot(direction, _directions[i]) < _turnThreshold;
+		bool resized = fabs(radius - _radii[i]) > _moveThreshold * radius;
+		if(_valid[i] && !moved && !turned && !resized){
+			continue;
+		}
+		_centers[i] = center;
+		_directions[i] = direction;
+		_radii[i] = radius;
+		fit(i, center, radius * (1.0f + _moveThreshold), direction, sceneCenter, sceneRadius);
+		render(i, world);
+		_valid[i] = true;
+	}
+	_updates++;
+  }
+
+  unsigned int getTexture(){
+	return _depth;
+  }
+
+  //Bias * projection * view for each cascade, maps world space to shadow map space
+  const glm::mat4* shadowMatrices(){
+	return _shadowMatrices;
+  }
+
+  //Far end of each cascade as a view space distance
+  glm::vec3 splits(){
+	return glm::vec3(_splits[0], _splits[1], _splits[2]);
+  }
+
+  //Prints how many cascades were re-rendered since the last call
+  void report(){
+	printf("Shadows: %d of %d cascade updates re-rendered (%d casters drawn)\n",
+		_renders, _updates * CASCADES, _casters);
+	_renders = 0;
+	_updates = 0;
+	_casters = 0;
+  }
+
+private:
+  int _resolution;
+  float _shadowDistance;//Nothing further than this from the camera gets shadows
+  float _moveThreshold;//Fraction of a cascade's radius the slice may move before re-rendering
+  float _turnThreshold;//Cosine of the light turn that forces a re-render
+  GLuint _depth;//Depth texture array, one layer per cascade
+  GLuint _framebuffer;
+  GLSLProgram _depthProgram;
+  GLint _uLightViewProjection;
+  glm::mat4 _lightViewProjections[CASCADES];
+  glm::mat4 _shadowMatrices[CASCADES];
+  float _splits[CASCADES];
+  //What each cached cascade was fitted to
+  bool _valid[CASCADES];
+  glm::vec3 _centers[CASCADES];
+  glm::vec3 _directions[CASCADES];
+  float _radii[CASCADES];
+  //Statistics
+  int _renders;
+  int _updates;
+  int _casters;
+
+  //Bounding sphere of the camera frustum between two view distances
+  void sliceSphere(const glm::mat4& inverseView, float fovy, float aspect, float sliceNear, float sliceFar,
+	glm::vec3& center, float& radius){
+	float tanY = tan(glm::radians(fovy) * 0.5f);
+	float tanX = tanY * aspect;
+	glm::vec3 corners[8];
+	int n = 0;
+	for(int s = 0; s < 2; s++){
+		float d = s == 0 ? sliceNear : sliceFar;
+		for(int y = -1; y <= 1; y += 2){
+			for(int x = -1; x <= 1; x += 2){
+				corners[n++] = glm::vec3(inverseView * glm::vec4(x * tanX * d, y * tanY * d, -d, 1.0f));
+			}
+		}
+	}
+	center = glm::vec3(0.0f);
+	for(int i = 0; i < 8; i++){
+		center += corners[i] / 8.0f;
+	}
+	radius = 0.0f;
+	for(int i = 0; i < 8; i++){
+		radius = std::max(radius, glm::length(corners[i] - center));
+	}
+	//Round up so small changes in the slice don't change the projection scale
+	radius = ceil(radius);
+  }
+
+  /*Orthographic light view around a sphere. The near plane is pulled back
+  so buildings between the light and the sphere still cast into it, and
+  the projection is snapped to whole texels to stop shadow edges shimmering*/
+  void fit(int cascade, const glm::vec3& center, float radius, const glm::vec3& direction,
+	const glm::vec3& sceneCenter, float sceneRadius){
+	float back = radius + glm::length(sceneCenter - center) + sceneRadius;
+	glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(center - direction * back, center, up);
+	glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, back + radius);
+
+	glm::vec4 origin = lightProjection * lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	float texels = _resolution * 0.5f;
+	glm::vec2 snapped = glm::vec2(origin) * texels;
+	glm::vec2 offset = (glm::round(snapped) - snapped) / texels;
+	lightProjection[3][0] += offset.x;
+	lightProjection[3][1] += offset.y;
+
+	_lightViewProjections[cascade] = lightProjection * lightView;
+	glm::mat4 bias = glm::translate(glm::mat4(), glm::vec3(0.5f)) * glm::scale(glm::mat4(), glm::vec3(0.5f));
+	_shadowMatrices[cascade] = bias * _lightViewProjections[cascade];
+  }
+
+  void render(int cascade, World* world){
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _depth, 0, cascade);
+	glViewport(0, 0, _resolution, _resolution);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	//Push depths away from the light to avoid shadow acne
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+	_depthProgram.activate();
+	glUniformMatrix4fv(_uLightViewProjection, 1, false, glm::value_ptr(_lightViewProjections[cascade]));
+	_casters += world->drawShadowCasters(Frustum(_lightViewProjections[cascade]));
+	_depthProgram.deactivate();
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	_renders++;
+  }
+
+  CascadedShadowMap(const CascadedShadowMap&);//Owns GL objects, not copyable
+  CascadedShadowMap& operator=(const CascadedShadowMap&);
+};
@@ -0,0 +1,243 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Uniform grid over the ground (x and z) holding axis aligned
+boxes, so ray and area queries only look at the boxes in the cells they
+pass through instead of every building in the city.
+Boxes are identified by the number they were inserted with.
+*/
+
+#ifndef _SPATIALGRID_H_
+#define _SPATIALGRID_H_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+class SpatialGrid{
+public:
+  SpatialGrid(): _cellSize(1.0f), _columns(0), _rows(0), _maxHeight(0.0f){}
+
+  /*Covers min to max on the ground; boxes outside are clamped into the border cells.
+  An area too big for MAX_CELLS cells of cellSize gets bigger cells instead*/
+  SpatialGrid(const glm::vec3& min, const glm::vec3& max, float cellSize):
+	_min(min.x, min.z),
+	_cellSize(cellSize),
+	_maxHeight(0.0f){
+	double width = std::max(0.0, double(max.x) - min.x);
+	double depth = std::max(0.0, double(max.z) - min.z);
+	double cell = std::max(double(cellSize), std::max(sqrt(width * depth / MAX_CELLS), std::max(width, depth) / MAX_CELLS));
+	_cellSize = float(cell);
+	_columns = std::max<size_t>(1, size_t(ceil(width / _cellSize)));
+	_rows = std::max<size_t>(1, size_t(ceil(depth / _cellSize)));
+	_cells.resize(size_t(_columns) * size_t(_rows));
+  }
+
+  //True if the area on the ground lies inside the grid, so nothing in it is clamped into a border cell
+  bool covers(const glm::vec3& boxMin, const glm::vec3& boxMax) const{
+	return boxMin.x >= _min.x && boxMin.z >= _min.y &&
+		boxMax.x <= _min.x + _columns * _cellSize && boxMax.z <= _min.y + _rows * _cellSize;
+  }
+
+  void insert(unsigned int id, const glm::vec3& boxMin, const glm::vec3& boxMax){
+	if(id >= _boxes.size()){
+		_boxes.resize(id + 1);
+	}
+	_boxes[id].min = boxMin;
+	_boxes[id].max = boxMax;
+	_boxes[id].used = true;
+	_maxHeight = std::max(_maxHeight, boxMax.y);
+	int x0, z0, x1, z1;
+	cellRange(boxMin, boxMax, x0, z0, x1, z1);
+	for(int z = z0; z <= z1; z++){
+		for(int x = x0; x <= x1; x++){
+			_cells[x + z * _columns].push_back(id);
+		}
+	}
+  }
+
+  //Takes a box out again, e.g. before it is moved, resized or deleted
+  void remove(unsigned int id){
+	if(id >= _boxes.size() || !_boxes[id].used){
+		return;
+	}
+	int x0, z0, x1, z1;
+	cellRange(_boxes[id].min, _boxes[id].max, x0, z0, x1, z1);
+	for(int z = z0; z <= z1; z++){
+		for(int x = x0; x <= x1; x++){
+			std::vector<unsigned int>& cell = _cells[x + z * _columns];
+			std::vector<unsigned int>::iterator it = std::find(cell.begin(), cell.end(), id);
+			if(it != cell.end()){
+				*it = cell.back();
+				cell.pop_back();
+			}
+		}
+	}
+	//_maxHeight is left alone; it only has to be at least the tallest box
+	_boxes[id].used = false;
+  }
+
+  /*True if the ray hits a box other than ignore before maxDistance.
+  Walks the cells under the ray in order (2D DDA) and stops at the first hit*/
+  bool occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int ignore) const{
+	bool hit = false;
+	walk(origin, direction, maxDistance, [&](const std::vector<unsigned int>& cell, float){
+		float distance;
+		for(unsigned int i = 0; i < cell.size(); i++){
+			if(cell[i] != ignore && hits(_boxes[cell[i]], origin, direction, maxDistance, distance)){
+				hit = true;
+				return true;
+			}
+		}
+		return false;
+	});
+	return hit;
+  }
+
+  /*The box the ray hits first before maxDistance, and how far along the ray
+  that is; false if it hits none. A box met in one cell can still be beaten
+  by one met in a later cell, so the walk only stops once it is past the hit*/
+  bool nearest(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& id, float& distance) const{
+	bool found = false;
+	distance = maxDistance;
+	walk(origin, direction, maxDistance, [&](const std::vector<unsigned int>& cell, float exit){
+		float t;
+		for(unsigned int i = 0; i < cell.size(); i++){
+			if(hits(_boxes[cell[i]], origin, direction, distance, t) && t < distance){
+				distance = t;
+				id = cell[i];
+				found = true;
+			}
+		}
+		return found && distance <= exit;
+	});
+	return found;
+  }
+
+  //Every box overlapping the area on the ground, each listed once
+  void query(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<unsigned int>& ids) const{
+	int x0, z0, x1, z1;
+	cellRange(boxMin, boxMax, x0, z0, x1, z1);
+	ids.clear();
+	for(int z = z0; z <= z1; z++){
+		for(int x = x0; x <= x1; x++){
+			const std::vector<unsigned int>& cell = _cells[x + z * _columns];
+			for(unsigned int i = 0; i < cell.size(); i++){
+				const Box& box = _boxes[cell[i]];
+				if(box.min.x <= boxMax.x && box.max.x >= boxMin.x && box.min.z <= boxMax.z && box.max.z >= boxMin.z){
+					ids.push_back(cell[i]);
+				}
+			}
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  }
+
+private:
+  enum{MAX_CELLS = 1 << 21};//About 50 MB of empty cells
+
+  struct Box{
+	glm::vec3 min;
+	glm::vec3 max;
+	bool used;
+	Box(): used(false){}
+  };
+
+  glm::vec2 _min;
+  float _cellSize;
+  int _columns;
+  int _rows;
+  float _maxHeight;//Top of the tallest box
+  std::vector<Box> _boxes;//Indexed by id
+  std::vector<std::vector<unsigned int> > _cells;//Ids of the boxes overlapping each cell
+
+  /*Calls visit(cell, exit) for each cell under the ray, nearest first,
+  with the distance at which the ray leaves the cell, until visit returns
+  true or the ray is past maxDistance*/
+  template<class Visit>
+  void walk(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Visit visit) const{
+	glm::vec2 start = (glm::vec2(origin.x, origin.z) - _min) / _cellSize;
+	glm::vec2 dir(direction.x, direction.z);
+	int x = int(floor(start.x));
+	int z = int(floor(start.y));
+	int stepX = dir.x > 0.0f ? 1 : -1;
+	int stepZ = dir.y > 0.0f ? 1 : -1;
+	//Ray distance to the next cell border, and between borders, along each axis
+	float deltaX = dir.x != 0.0f ? _cellSize / fabs(dir.x) : 1e30f;
+	float deltaZ = dir.y != 0.0f ? _cellSize / fabs(dir.y) : 1e30f;
+	float nextX = dir.x != 0.0f ? (dir.x > 0.0f ? x + 1 - start.x : start.x - x) * deltaX : 1e30f;
+	float nextZ = dir.y != 0.0f ? (dir.y > 0.0f ? z + 1 - start.y : start.y - z) * deltaZ : 1e30f;
+	float t = 0.0f;
+	while(t < maxDistance){
+		//Climbing rays that are above every box can't hit anything any more
+		if(direction.y > 0.0f && origin.y + direction.y * t > _maxHeight){
+			return;
+		}
+		if(x >= 0 && x < _columns && z >= 0 && z < _rows){
+			if(visit(_cells[x + z * _columns], std::min(nextX, nextZ))){
+				return;
+			}
+		}else if((x < 0 && stepX < 0) || (x >= _columns && stepX > 0) || (z < 0 && stepZ < 0) || (z >= _rows && stepZ > 0)){
+			return;//Left the grid for good
+		}
+		if(nextX < nextZ){
+			t = nextX;
+			nextX += deltaX;
+			x += stepX;
+		}else{
+			t = nextZ;
+			nextZ += deltaZ;
+			z += stepZ;
+		}
+	}
+  }
+
+  void cellRange(const glm::vec3& boxMin, const glm::vec3& boxMax, int& x0, int& z0, int& x1, int& z1) const{
+	x0 = clampColumn((boxMin.x - _min.x) / _cellSize);
+	x1 = clampColumn((boxMax.x - _min.x) / _cellSize);
+	z0 = clampRow((boxMin.z - _min.y) / _cellSize);
+	z1 = clampRow((boxMax.z - _min.y) / _cellSize);
+  }
+
+  //Clamped before it is made an int, which far away boxes would overflow
+  int clampColumn(float x) const{
+	return int(std::max(0.0f, std::min(float(_columns - 1), floorf(x))));
+  }
+
+  int clampRow(float z) const{
+	return int(std::max(0.0f, std::min(float(_rows - 1), floorf(z))));
+  }
+
+  //Slab test: does the ray enter the box between 0 and maxDistance, and where
+  static bool hits(const Box& box, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance){
+	float tNear = 0.0f;
+	float tFar = maxDistance;
+	for(int axis = 0; axis < 3; axis++){
+		if(direction[axis] == 0.0f){
+			if(origin[axis] < box.min[axis] || origin[axis] > box.max[axis]){
+				return false;
+			}
+			continue;
+		}
+		float t0 = (box.min[axis] - origin[axis]) / direction[axis];
+		float t1 = (box.max[axis] - origin[axis]) / direction[axis];
+		if(t0 > t1){
+			std::swap(t0, t1);
+		}
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+		if(tNear > tFar){
+			return false;
+		}
+	}
+	distance = tNear;
+	return true;
+  }
+};
+
+#endif
@@ -3,7 +3,7 @@ public:
   SpinningLight(){}
 
   SpinningLight(glm::vec3& color, glm::vec3& position, glm::vec3& center):
-	_rotationDelta(0.01), 
+	_rotationDelta(0.6),//Radians per second 
 	_color(color), 
 	_position(position), 
 	_center(center), 
@@ -28,32 +28,49 @@ public:
 	return glm::vec4(_position, 1.0);
   }
 
+  //The point the light shines towards
+  glm::vec3 center(){
+	return _center;
+  }
+
+  //Used by the DayNightCycle, which moves the light along the sun's path
+  void setPosition(const glm::vec3& position){
+	_position = position;
+  }
+
+  void setColor(const glm::vec3& color){
+	_savedColor = color;
+	if(_isOn){
+		_color = color;
+	}
+  }
+
   //NOTE: All rotation methods used to determine ortho basis first
-  void rotateUp(){//Create a rotation matrix that rotates about the right axis
-	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta, right);
+  void rotateUp(float dt){//Create a rotation matrix that rotates about the right axis
+	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta * dt, right);
 	//Now rotate the "worldUp" about the right axis
 	_tangent = rotationMatrix * up;
 	_position = rotationMatrix * _position;
   }
 
-  void rotateDown(){
-	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta, right);
+  void rotateDown(float dt){
+	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta * dt, right);
 	_tangent = rotationMatrix * up;
 	_position = rotationMatrix * _position;
   }
 
-  void rotateLeft(){//Create a rotation matrix that rotates about the up axis
-	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta, up);
+  void rotateLeft(float dt){//Create a rotation matrix that rotates about the up axis
+	glm::mat3 rotationMatrix = glm::rotate(_rotationDelta * dt, up);
 	_position = rotationMatrix * _position;
   }
 
-  void rotateRight(){
-	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta, up);
+  void rotateRight(float dt){
+	glm::mat3 rotationMatrix = glm::rotate(-_rotationDelta * dt, up);
 	_position = rotationMatrix * _position;
   }
 
-  void roll(){
-	glm::mat3 m = glm::rotate(-_rotationDelta, direction());
+  void roll(float dt){
+	glm::mat3 m = glm::rotate(-_rotationDelta * dt, direction());
 	_tangent = m * _tangent;
   }
   
@@ -1,5 +1,11 @@
 class Texture{
 public:
+  typedef enum{
+	NEAREST,//Point sampled from the full resolution level only
+	TRILINEAR,//Linear within and between mipmap levels
+	ANISOTROPIC//Trilinear plus anisotropic filtering, when supported
+  }filter_t;
+
   Texture(){
 	_faces = {"textures/right.tga", 
 		"textures/left.tga", 
@@ -10,11 +16,22 @@ public:
 	/*Create 1 texture that are of type unsigned int,
 	as indicated by the texture type*/
 	glGenTextures(1, &_texture);
+	_bytes = 0;
 	/*Bind the texture so that any texture commands called after
 	apply to this texture*/
 	glBindTexture(GL_TEXTURE_CUBE_MAP, _texture);
-	for (unsigned int i = 0; i < _faces.size(); i++){
-		_data = stbi_load(_faces[i].c_str(), 
+	/*Prefer the baked faces. All six faces must share one format,
+	so if any face isn't baked every face is decoded from its image instead*/
+	bool baked = true;
+	for (unsigned int i = 0; i < _faces.size() && baked; i++){
+		baked = uploadBaked(_faces[i], GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+	}
+	if(!baked){
+		_levels = 1;
+		_bytes = 0;
+	}
+	for (unsigned int i = 0; i < _faces.size() && !baked; i++){
+		_data = loadImage(_faces[i], 
 			&_width, &_height, 
 			&_colorChannels, 
 			0);
@@ -58,37 +75,145 @@ public:
 	/*If you don't clamp to edge 
 	then you might get a visible seam on the edges of your textures*/
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, _levels - 1);
+	_target = GL_TEXTURE_CUBE_MAP;
+	if(!baked){
+		_bytes = uncompressedBytes(_faces.size());
+	}
   }
 
-  Texture(std::string path){
+  Texture(std::string path, filter_t filter = ANISOTROPIC, float maxAnisotropy = 8.0f){
 	/*Generate a texture for all of the buildings
 	Note that we can generate a texture for each building object
 	but that will require more resources. 
 	In fact when tried, it works but the program will be very slow*/
 	glGenTextures(1, &_texture);
+	_bytes = 0;
 	glBindTexture(GL_TEXTURE_2D, _texture);
-	_data = stbi_load(path.c_str(), &_width, &_height, &_colorChannels, 0);
-	if (_data){
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, _data);
-		stbi_image_free(_data);
-	}else{
-		printf("Building texture failed to load.\n");
-		stbi_image_free(_data);
-		exit(1);
+	//Use the baked version when there is one, otherwise decode the image
+	if(!uploadBaked(path, GL_TEXTURE_2D)){
+		_levels = 1;
+		_data = loadImage(path, &_width, &_height, &_colorChannels, 0);
+		if (_data){
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, _data);
+			stbi_image_free(_data);
+			/*Build the mipmap chain on the GPU so distant facades sample
+			a level that matches their footprint instead of aliasing*/
+			if(glGenerateMipmap){
+				glGenerateMipmap(GL_TEXTURE_2D);
+				_levels = 1 + (int)floor(log2((double)std::max(_width, _height)));
+			}
+			_bytes = uncompressedBytes(1);
+		}else{
+			printf("Building texture failed to load.\n");
+			stbi_image_free(_data);
+			exit(1);
+		}
 	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _levels - 1);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	_target = GL_TEXTURE_2D;
+	setFilter(filter, maxAnisotropy);
 	glBindTexture(GL_TEXTURE_2D, 0);
   }
 
-  virtual ~Texture(){}
+  /*A 2D array texture with one layer per image, so any number of
+  facade styles can be sampled from a single binding. The layer is
+  picked in the shader with the third texture coordinate.
+  Every image must have the same size*/
+  Texture(const std::vector<std::string>& layers, filter_t filter = ANISOTROPIC, float maxAnisotropy = 8.0f){
+	glGenTextures(1, &_texture);
+	_bytes = 0;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+	//Baked layers are only used when every layer is baked in the same format
+	bool baked = true;
+	for(unsigned int i = 0; i < layers.size() && baked; i++){
+		baked = uploadBakedLayer(layers[i], i, layers.size());
+	}
+	if(!baked){
+		for(unsigned int i = 0; i < layers.size(); i++){
+			int width, height;
+			_data = loadImage(layers[i], &width, &height, &_colorChannels, 3);
+			if(!_data || (i > 0 && (width != _width || height != _height))){
+				printf("Facade texture %s failed to load or has the wrong size.\n", layers[i].c_str());
+				stbi_image_free(_data);
+				exit(1);
+			}
+			if(i == 0){
+				_width = width;
+				_height = height;
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, _width, _height, layers.size(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			}
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, _width, _height, 1, GL_RGB, GL_UNSIGNED_BYTE, _data);
+			stbi_image_free(_data);
+		}
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		_levels = 1 + (int)floor(log2((double)std::max(_width, _height)));
+		_bytes = uncompressedBytes(layers.size());
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, _levels - 1);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+	_target = GL_TEXTURE_2D_ARRAY;
+	setFilter(filter, maxAnisotropy);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  /*Changes how a 2D or array texture is sampled. Mipmapped modes
+  fall back to plain bilinear when the texture only has one level*/
+  void setFilter(filter_t filter, float maxAnisotropy = 8.0f){
+	glBindTexture(_target, _texture);
+	GLint minFilter = GL_NEAREST;
+	GLint magFilter = GL_NEAREST;
+	float anisotropy = 1.0f;
+	if(filter != NEAREST){
+		minFilter = _levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+		magFilter = GL_LINEAR;
+	}
+	if(filter == ANISOTROPIC && GLEW_EXT_texture_filter_anisotropic){
+		GLfloat supported = 1.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &supported);
+		anisotropy = std::min(maxAnisotropy, (float)supported);
+	}
+	glTexParameteri(_target, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(_target, GL_TEXTURE_MAG_FILTER, magFilter);
+	if(GLEW_EXT_texture_filter_anisotropic){
+		glTexParameterf(_target, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+	}
+	_filter = filter;
+  }
+
+  filter_t getFilter(){
+	return _filter;
+  }
+
+  //Textures are owned through TextureManager handles; this frees the GL memory
+  virtual ~Texture(){
+	glDeleteTextures(1, &_texture);
+  }
 
   unsigned int getTexture(){
 	return _texture;
   }
 
+  GLenum getTarget(){
+	return _target;
+  }
+
+  //Estimated video memory used by every face, layer and mipmap level
+  size_t getBytes(){
+	return _bytes;
+  }
+
+  int getWidth(){
+	return _width;
+  }
+
+  int getHeight(){
+	return _height;
+  }
+
 private:
   std::vector<std::string> _faces;//The inner faces of the skybox
   unsigned int _texture;//Skybox texture
@@ -96,4 +221,98 @@ private:
   int _width;//Texture's width and height
   int _height;
   int _colorChannels;//Corresponds to a texture's rgba
+  int _levels;//Number of mipmap levels uploaded
+  filter_t _filter;
+  GLenum _target;//GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP
+  GLenum _format;//Compressed format of baked array layers
+  size_t _bytes;//Estimated video memory
+
+  //Drivers pad RGB to 4 bytes per texel, so that is what we count
+  size_t uncompressedBytes(int images){
+	size_t bytes = 0;
+	int width = _width;
+	int height = _height;
+	for(int i = 0; i < _levels; i++){
+		bytes += (size_t)width * height * 4;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return bytes * images;
+  }
+
+  Texture(const Texture&);//Not copyable, the GL name has one owner
+  Texture& operator=(const Texture&);
+
+  /*Decodes an image straight out of a read-only mapping of the file,
+  so it is never copied into a stdio buffer first. Same results as stbi_load*/
+  static unsigned char* loadImage(const std::string& path, int* width, int* height, int* channels, int desired){
+	MappedFile file(path.c_str(), MappedFile::SEQUENTIAL);
+	if(!file.isOpen()){
+		return NULL;
+	}
+	return stbi_load_from_memory(file.data(), (int)file.size(), width, height, channels, desired);
+  }
+
+  /*Uploads the baked (pre-compressed) version of an image, see bake_textures.cpp.
+  The blocks go straight from the file mapping to the driver, with no decoding.
+  Returns false if there is no valid baked file or the GL can't use it*/
+  bool uploadBaked(const std::string& path, GLenum target){
+	if(!GLEW_EXT_texture_compression_s3tc){
+		return false;
+	}
+	MappedFile file(bakedTexturePath(path).c_str(), MappedFile::SEQUENTIAL);
+	if(!file.isOpen() || !validBakedTexture(file.data(), file.size())){
+		return false;
+	}
+	const BakedTextureHeader* header = (const BakedTextureHeader*)file.data();
+	const BakedTextureLevel* level = (const BakedTextureLevel*)(file.data() + sizeof(BakedTextureHeader));
+	for(unsigned int i = 0; i < header->levels; i++){
+		glCompressedTexImage2D(target, i, header->format,
+			level[i].width, level[i].height, 0,
+			level[i].size, file.data() + level[i].offset);
+		_bytes += level[i].size;
+	}
+	_width = header->width;
+	_height = header->height;
+	_colorChannels = 3;
+	_levels = header->levels;
+	return true;
+  }
+
+  /*Uploads one baked layer of an array texture. The first layer decides
+  the format, size and level count and allocates storage for all layers;
+  any later layer that doesn't match makes the whole array fall back*/
+  bool uploadBakedLayer(const std::string& path, unsigned int layer, unsigned int layers){
+	if(!GLEW_EXT_texture_compression_s3tc){
+		return false;
+	}
+	MappedFile file(bakedTexturePath(path).c_str(), MappedFile::SEQUENTIAL);
+	if(!file.isOpen() || !validBakedTexture(file.data(), file.size())){
+		return false;
+	}
+	const BakedTextureHeader* header = (const BakedTextureHeader*)file.data();
+	const BakedTextureLevel* level = (const BakedTextureLevel*)(file.data() + sizeof(BakedTextureHeader));
+	if(layer == 0){
+		_width = header->width;
+		_height = header->height;
+		_levels = header->levels;
+		_format = header->format;
+		for(unsigned int i = 0; i < header->levels; i++){
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, header->format,
+				level[i].width, level[i].height, layers, 0,
+				level[i].size * layers, NULL);
+			_bytes += (size_t)level[i].size * layers;
+		}
+	}else if(header->format != _format || (int)header->width != _width ||
+		(int)header->height != _height || (int)header->levels != _levels){
+		return false;
+	}
+	for(unsigned int i = 0; i < header->levels; i++){
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer,
+			level[i].width, level[i].height, 1, header->format,
+			level[i].size, file.data() + level[i].offset);
+	}
+	_colorChannels = 3;
+	return true;
+  }
 };
@@ -0,0 +1,107 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Shares textures between everything that draws with them.
+Each texture is loaded once per key (its path, or the list of paths for
+arrays and cubemaps) and handed out as a reference counted handle.
+The GL texture is deleted as soon as the last handle goes away, so
+regenerating the city never leaks or reloads textures still in use.
+*/
+
+typedef std::shared_ptr<Texture> TextureHandle;
+
+class TextureManager{
+public:
+  TextureManager(){}
+
+  virtual ~TextureManager(){}
+
+  TextureHandle acquire(const std::string& path, Texture::filter_t filter = Texture::ANISOTROPIC){
+	TextureHandle texture = find(path);
+	if(!texture){
+		texture = TextureHandle(new Texture(path, filter));
+		_textures[path] = texture;
+	}
+	return texture;
+  }
+
+  TextureHandle acquireArray(const std::vector<std::string>& layers, Texture::filter_t filter = Texture::ANISOTROPIC){
+	std::string key = "array:";
+	for(unsigned int i = 0; i < layers.size(); i++){
+		key += layers[i] + ";";
+	}
+	TextureHandle texture = find(key);
+	if(!texture){
+		texture = TextureHandle(new Texture(layers, filter));
+		_textures[key] = texture;
+	}
+	return texture;
+  }
+
+  //The skybox cubemap
+  TextureHandle acquireSkybox(){
+	TextureHandle texture = find("skybox");
+	if(!texture){
+		texture = TextureHandle(new Texture());
+		_textures["skybox"] = texture;
+	}
+	return texture;
+  }
+
+  //Video memory of every live texture, largest first
+  void report(){
+	std::vector<std::pair<size_t, std::string> > sizes;
+	size_t total = 0;
+	prune();
+	for(std::map<std::string, std::weak_ptr<Texture> >::iterator it = _textures.begin(); it != _textures.end(); ++it){
+		TextureHandle texture = it->second.lock();
+		sizes.push_back(std::make_pair(texture->getBytes(), it->first));
+		total += texture->getBytes();
+	}
+	std::sort(sizes.rbegin(), sizes.rend());
+	printf("Textures: %zu live, %.2f MB of video memory\n", sizes.size(), total / (1024.0 * 1024.0));
+	for(unsigned int i = 0; i < sizes.size(); i++){
+		TextureHandle texture = find(sizes[i].second);
+		printf("  %8.1f KB  %4dx%-4d  %ld handles  %s\n", sizes[i].first / 1024.0,
+			texture->getWidth(), texture->getHeight(),
+			texture.use_count() - 1, sizes[i].second.c_str());
+	}
+  }
+
+  size_t totalBytes(){
+	size_t total = 0;
+	prune();
+	for(std::map<std::string, std::weak_ptr<Texture> >::iterator it = _textures.begin(); it != _textures.end(); ++it){
+		total += it->second.lock()->getBytes();
+	}
+	return total;
+  }
+
+private:
+  /*The manager only keeps weak references so it never keeps a texture
+  alive by itself; the handles decide when it is released*/
+  std::map<std::string, std::weak_ptr<Texture> > _textures;
+
+  TextureHandle find(const std::string& key){
+	std::map<std::string, std::weak_ptr<Texture> >::iterator it = _textures.find(key);
+	if(it == _textures.end()){
+		return TextureHandle();
+	}
+	return it->second.lock();
+  }
+
+  //Forget textures whose last handle has gone away
+  void prune(){
+	std::map<std::string, std::weak_ptr<Texture> >::iterator it = _textures.begin();
+	while(it != _textures.end()){
+		if(it->second.expired()){
+			_textures.erase(it++);
+		}else{
+			++it;
+		}
+	}
+  }
+};
@@ -1,85 +1,155 @@
 class World{
 public:
-  World(): _size(196){
-	_XZ = new Plane(_size);//First init the plane
-	float skyboxVertices[] = {//Now init the skybox 
-		-1.0f,  1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		1.0f, -1.0f, -1.0f,
-		1.0f, -1.0f, -1.0f,
-		1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		1.0f, -1.0f, -1.0f,
-		1.0f, -1.0f,  1.0f,
-		1.0f,  1.0f,  1.0f,
-		1.0f,  1.0f,  1.0f,
-		1.0f,  1.0f, -1.0f,
-		1.0f, -1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		1.0f,  1.0f,  1.0f,
-		1.0f,  1.0f,  1.0f,
-		1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		-1.0f,  1.0f, -1.0f,
-		1.0f,  1.0f, -1.0f,
-		1.0f,  1.0f,  1.0f,
-		1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		1.0f, -1.0f, -1.0f,
-		1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		1.0f, -1.0f,  1.0f
-	};
-	glGenVertexArrays(1, &_VAO);//Create 1 VAO
-	glBindVertexArray(_VAO);//Then bind it
-	glGenBuffers(1, &_VBO);//Create 1 VBO
-	glBindBuffer(GL_ARRAY_BUFFER, _VBO);//Then bind that
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), 
-		&skyboxVertices, 
-		GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3,//How much data to get
-		GL_FLOAT,//data type
-		GL_FALSE,//Is the data normalized?
-		3 * sizeof(float),//How much data per row
-		(void*)0);//How much data I need to skip over
-
-	_skybox = new Texture();
+  //Opens cityFile (a .city file) if it is given, otherwise generates a city
+  World(const char* cityFile = NULL): _size(196), _XZ(NULL), _gpuDriven(true), _proceduralFacades(false), _stream(NULL){
+	//First init the plane
+	if(cityFile){
+		CityFile file(cityFile);
+		if(file.isOpen()){
+			_XZ = new Plane(file, _textures);
+		}else{
+			printf("%s is not a city file this version can open, generating a city instead.\n", cityFile);
+		}
+	}
+	if(!_XZ){
+		_XZ = new Plane(_size, _textures);
+	}
+	/*Now init the skybox. It is a full screen triangle made up in the
+	vertex shader, but drawing still needs a vertex array bound*/
+	glGenVertexArrays(1, &_VAO);
+
+	_skybox = _textures.acquireSkybox();
   }
         
   virtual ~World(){
 	glDeleteVertexArrays(1, &_VAO);
-	glDeleteBuffers(1, &_VBO);
 	delete _XZ;
   }
 
-  void drawLevel(){
-	_XZ->draw();
+  /*Replace the city with a freshly generated one. The new plane is built
+  before the old one is deleted so shared textures are reused, not reloaded*/
+  void regenerate(){
+	Plane* old = _XZ;
+	_XZ = new Plane(_size, _textures);
+	delete old;
+	//The new plane loaded the facade array if the old one had dropped it
+	_XZ->loadFacades(!_proceduralFacades, _textures);
   }
 
-  void drawSkybox(){
-	/*Makes sure each uniform sampler associates with the correct texture unit
-	glUniform1i(uSkybox_B, 0);*/
+  //Writes the city as it is now to a .city file, false if it can't
+  bool save(const char* path){
+	return _XZ->save(path);
+  }
+
+  //Print how much video memory each texture is using
+  void reportTextures(){
+	_textures.report();
+  }
+  size_t textureBytes(){
+	return _textures.totalBytes();
+  }
+  /*Draw the facades with shaders/facade.glsl (the shaders' proceduralFacades
+  must be set to match) and free their textures, or go back to the textures*/
+  void setProceduralFacades(bool procedural){
+	_proceduralFacades = procedural;
+	_XZ->loadFacades(!procedural, _textures);
+  }
+
+  void reportMesh(){
+	_XZ->reportMesh();
+  }
+
+  std::vector<PointLight> streetLamps(int count){
+	return _XZ->streetLamps(count);
+  }
+
+  const std::vector<Material>& materials(){
+	return _XZ->materials();
+  }
+
+  //Editing the live city, see Plane. Ids don't survive regenerate()
+  int addBuilding(const BuildingSpec& spec){
+	return _XZ->addBuilding(spec);
+  }
+
+  bool modifyBuilding(int id, const BuildingSpec& spec){
+	return _XZ->modifyBuilding(id, spec);
+  }
+
+  bool removeBuilding(int id){
+	return _XZ->removeBuilding(id);
+  }
+
+  void addBuildings(const std::vector<BuildingSpec>& specs, std::vector<int>& ids){
+	_XZ->addBuildings(specs, ids);
+  }
+
+  int modifyBuildings(const std::vector<int>& ids, const std::vector<BuildingSpec>& specs){
+	return _XZ->modifyBuildings(ids, specs);
+  }
+
+  int removeBuildings(const std::vector<int>& ids){
+	return _XZ->removeBuildings(ids);
+  }
 
-	/*Change depth function so depth test passes
-	when values are equal to depth buffer's content*/
-	glDepthFunc(GL_LEQUAL);
-	glBindVertexArray(_VAO);//skybox cube
+  bool building(int id, BuildingSpec& spec){
+	return _XZ->building(id, spec);
+  }
+
+  int pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance){
+	return _XZ->pick(origin, direction, maxDistance);
+  }
+
+  /*Measures edits on a separate city of about 100k buildings, generated
+  for it and thrown away after. Takes a few seconds, mostly generating*/
+  void benchmarkEdits(){
+	printf("Generating a city of about 100k buildings to edit...\n");
+	Plane large(BENCHMARK_SIZE, _textures);
+	large.benchmarkEdits(10000);
+  }
+
+  int drawShadowCasters(const Frustum& frustum){
+	return _XZ->drawShadowCasters(frustum, _stream);
+  }
+
+  glm::vec3 boundsMin(){
+	return _XZ->boundsMin();
+  }
+
+  glm::vec3 boundsMax(){
+	return _XZ->boundsMax();
+  }
+
+  //Draws the city, leaving out the buildings outside the frustum
+  void drawLevel(const Frustum& frustum){
+	_XZ->draw(frustum, _gpuDriven, _stream);
+  }
+
+  //Outlines of the buildings inside the frustum, for checking the culling
+  void addBounds(const Frustum& frustum, DebugLines& lines){
+	_XZ->addBounds(frustum, lines);
+  }
+
+  //Per frame space for the buildings culled on the CPU (NULL for none)
+  void setStreamBuffer(RingBuffer* stream){
+	_stream = stream;
+  }
+
+  /*Cull and draw the buildings on the GPU (when the context can) or on the
+  CPU. Returns whether the GPU does it now*/
+  bool setGpuDriven(bool enable){
+	_gpuDriven = enable;
+	return _gpuDriven && _XZ->gpuDriven();
+  }
+
+  void setTextureFilter(Texture::filter_t filter){
+	_XZ->setTextureFilter(filter);
+  }
+
+  /*Draw after everything else. The skybox sits exactly on the far plane,
+  so with the GL_LEQUAL depth test it only fills pixels nothing else covered*/
+  void drawSkybox(){
+	glBindVertexArray(_VAO);
 	/*Activate the texture unit first before binding.
 	This allows us to use multiple textures. 
 	If this is not called, the default will be: GL_TEXTURE0*/
@@ -87,15 +157,19 @@ public:
 	/*Bind the texture before drawing to the texture unit specified earlier. 
 	This also makes it available in the fragment shader as a sampler uniform*/
 	glBindTexture(GL_TEXTURE_CUBE_MAP, _skybox->getTexture());
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glBindVertexArray(0);
-	glDepthFunc(GL_LESS);//set depth function back to default
   }
         
 private:
+  enum{BENCHMARK_SIZE = 1338};//Plane size with about 100k buildings
+
+  TextureManager _textures;//Declared first so it outlives every handle
   int _size;//Size of the plane
   Plane* _XZ;//the XZ plane
   unsigned int _VAO;//The following private variables are for the skybox
-  unsigned int _VBO;
-  Texture* _skybox;
+  TextureHandle _skybox;
+  bool _gpuDriven;//Kept when the city is regenerated
+  bool _proceduralFacades;//So is this
+  RingBuffer* _stream;
 };
@@ -0,0 +1,285 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Offline texture baker. Decodes every image in a directory
+(textures/ by default), builds a full mipmap chain and compresses each
+level to BC1 (DXT1) blocks. The result is written next to the source
+image as a .ctex file (see BakedTexture.h) which the city maps and uploads
+with glCompressedTexImage2D instead of decoding the JPG/TGA at startup.
+
+Usage: bake_textures [directory | image ...]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "BakedTexture.h"
+
+struct Image{
+  int width;
+  int height;
+  std::vector<unsigned char> rgb;//Tightly packed, 3 bytes per texel
+};
+
+//Halve an image with a 2x2 box filter (odd edges reuse the last row/column)
+Image downsample(const Image& src){
+  Image dst;
+  dst.width = src.width > 1 ? src.width / 2 : 1;
+  dst.height = src.height > 1 ? src.height / 2 : 1;
+  dst.rgb.resize(dst.width * dst.height * 3);
+  for(int y = 0; y < dst.height; y++){
+    int y0 = std::min(y * 2, src.height - 1);
+    int y1 = std::min(y * 2 + 1, src.height - 1);
+    for(int x = 0; x < dst.width; x++){
+      int x0 = std::min(x * 2, src.width - 1);
+      int x1 = std::min(x * 2 + 1, src.width - 1);
+      for(int c = 0; c < 3; c++){
+        int sum = src.rgb[(y0 * src.width + x0) * 3 + c] +
+          src.rgb[(y0 * src.width + x1) * 3 + c] +
+          src.rgb[(y1 * src.width + x0) * 3 + c] +
+          src.rgb[(y1 * src.width + x1) * 3 + c];
+        dst.rgb[(y * dst.width + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+uint16_t packRGB565(const float* c){
+  int r = (int)(std::max(0.0f, std::min(255.0f, c[0])) * 31.0f / 255.0f + 0.5f);
+  int g = (int)(std::max(0.0f, std::min(255.0f, c[1])) * 63.0f / 255.0f + 0.5f);
+  int b = (int)(std::max(0.0f, std::min(255.0f, c[2])) * 31.0f / 255.0f + 0.5f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t v, float* c){
+  c[0] = ((v >> 11) & 31) * 255.0f / 31.0f;
+  c[1] = ((v >> 5) & 63) * 255.0f / 63.0f;
+  c[2] = (v & 31) * 255.0f / 31.0f;
+}
+
+/*Compress one 4x4 block of texels to 8 bytes of BC1.
+The endpoints are the extremes of the block along its principal axis
+(found with a few power iterations), pulled in slightly to reduce error,
+and every texel picks the nearest of the four palette entries*/
+void compressBlockBC1(const float texels[16][3], unsigned char* out){
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; i++){
+    for(int c = 0; c < 3; c++){
+      mean[c] += texels[i][c] / 16.0f;
+    }
+  }
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; i++){
+    float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+    cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+  }
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for(int iteration = 0; iteration < 4; iteration++){
+    float a[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+      cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    float length = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if(length < 1e-6f){
+      break;
+    }
+    for(int c = 0; c < 3; c++){
+      axis[c] = a[c] / length;
+    }
+  }
+  float minT = 1e9f;
+  float maxT = -1e9f;
+  for(int i = 0; i < 16; i++){
+    float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+  //Inset the endpoints by 1/16 of the range, as most BC1 encoders do
+  float inset = (maxT - minT) / 16.0f;
+  minT += inset;
+  maxT -= inset;
+  float end0[3];
+  float end1[3];
+  for(int c = 0; c < 3; c++){
+    end0[c] = mean[c] + axis[c] * maxT;
+    end1[c] = mean[c] + axis[c] * minT;
+  }
+  uint16_t c0 = packRGB565(end0);
+  uint16_t c1 = packRGB565(end1);
+  if(c0 < c1){
+    std::swap(c0, c1);
+  }
+  uint32_t indices = 0;
+  if(c0 != c1){//c0 > c1 selects the opaque four colour mode
+    float palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for(int c = 0; c < 3; c++){
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    for(int i = 0; i < 16; i++){
+      int best = 0;
+      float bestError = 1e30f;
+      for(int p = 0; p < 4; p++){
+        float dr = texels[i][0] - palette[p][0];
+        float dg = texels[i][1] - palette[p][1];
+        float db = texels[i][2] - palette[p][2];
+        float error = dr * dr + dg * dg + db * db;
+        if(error < bestError){
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= (uint32_t)best << (i * 2);
+    }
+  }
+  out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+  out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+  for(int i = 0; i < 4; i++){
+    out[4 + i] = (indices >> (i * 8)) & 0xFF;
+  }
+}
+
+std::vector<unsigned char> compressBC1(const Image& image){
+  int blocksX = (image.width + 3) / 4;
+  int blocksY = (image.height + 3) / 4;
+  std::vector<unsigned char> blocks(blocksX * blocksY * 8);
+  for(int by = 0; by < blocksY; by++){
+    for(int bx = 0; bx < blocksX; bx++){
+      float texels[16][3];
+      for(int i = 0; i < 16; i++){//Blocks hanging off the edge repeat the border texels
+        int x = std::min(bx * 4 + i % 4, image.width - 1);
+        int y = std::min(by * 4 + i / 4, image.height - 1);
+        for(int c = 0; c < 3; c++){
+          texels[i][c] = image.rgb[(y * image.width + x) * 3 + c];
+        }
+      }
+      compressBlockBC1(texels, &blocks[(by * blocksX + bx) * 8]);
+    }
+  }
+  return blocks;
+}
+
+bool bake(const std::string& path){
+  Image image;
+  int channels;
+  unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &channels, 3);
+  if(!data){
+    fprintf(stderr, "%s: %s\n", path.c_str(), stbi_failure_reason());
+    return false;
+  }
+  image.rgb.assign(data, data + image.width * image.height * 3);
+  stbi_image_free(data);
+
+  std::vector<std::vector<unsigned char> > levels;
+  std::vector<Image> mips;
+  mips.push_back(image);
+  while(mips.back().width > 1 || mips.back().height > 1){
+    mips.push_back(downsample(mips.back()));
+  }
+  for(size_t i = 0; i < mips.size(); i++){
+    levels.push_back(compressBC1(mips[i]));
+  }
+
+  BakedTextureHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BAKED_TEXTURE_MAGIC, 4);
+  header.version = BAKED_TEXTURE_VERSION;
+  header.format = BAKED_FORMAT_BC1;
+  header.width = image.width;
+  header.height = image.height;
+  header.levels = (uint32_t)levels.size();
+  header.blockBytes = 8;
+
+  std::vector<BakedTextureLevel> table(levels.size());
+  uint32_t offset = sizeof(BakedTextureHeader) + table.size() * sizeof(BakedTextureLevel);
+  for(size_t i = 0; i < levels.size(); i++){
+    offset = (offset + 15) & ~15u;
+    table[i].offset = offset;
+    table[i].size = (uint32_t)levels[i].size();
+    table[i].width = mips[i].width;
+    table[i].height = mips[i].height;
+    offset += table[i].size;
+  }
+
+  std::string outPath = bakedTexturePath(path);
+  FILE* out = fopen(outPath.c_str(), "wb");
+  if(!out){
+    fprintf(stderr, "%s: can't open for writing\n", outPath.c_str());
+    return false;
+  }
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(&table[0], sizeof(BakedTextureLevel), table.size(), out);
+  static const unsigned char padding[16] = {0};
+  for(size_t i = 0; i < levels.size(); i++){
+    long position = ftell(out);
+    fwrite(padding, 1, table[i].offset - position, out);
+    fwrite(&levels[i][0], 1, levels[i].size(), out);
+  }
+  bool ok = !ferror(out);
+  fclose(out);
+
+  size_t raw = image.width * image.height * 3;
+  printf("%s -> %s (%dx%d, %u levels, %zu KB uncompressed level 0, %u KB baked)\n",
+    path.c_str(), outPath.c_str(), image.width, image.height,
+    header.levels, raw / 1024, offset / 1024);
+  return ok;
+}
+
+bool isImage(const std::string& name){
+  const char* extensions[] = {".jpg", ".jpeg", ".tga", ".png", ".bmp"};
+  for(size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++){
+    size_t length = strlen(extensions[i]);
+    if(name.size() > length && name.compare(name.size() - length, length, extensions[i]) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+//Bake every image in a directory
+bool bakeDirectory(const std::string& directory){
+  DIR* dir = opendir(directory.c_str());
+  if(!dir){
+    return false;
+  }
+  bool ok = true;
+  struct dirent* entry;
+  while((entry = readdir(dir)) != NULL){
+    std::string name(entry->d_name);
+    if(isImage(name)){
+      ok = bake(directory + "/" + name) && ok;
+    }
+  }
+  closedir(dir);
+  return ok;
+}
+
+int main(int argc, char* argv[]){
+  bool ok = true;
+  if(argc < 2){
+    ok = bakeDirectory("textures");
+  }
+  for(int i = 1; i < argc; i++){
+    if(isImage(argv[i])){
+      ok = bake(argv[i]) && ok;
+    }else if(!bakeDirectory(argv[i])){
+      fprintf(stderr, "%s: not an image or a directory\n", argv[i]);
+      ok = false;
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
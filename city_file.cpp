@@ -0,0 +1,217 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Offline tool for saved cities (.city files, see CityFile.h).
+Converts them to and from a line based text form, which is easy to
+write from scripts or other tools, prints what is in one, and checks one
+by round tripping it through both forms.
+
+Usage: city_file info city.city
+       city_file verify city.city
+       city_file to-text city.city city.txt
+       city_file from-text city.txt city.city
+
+The text form is one line per item:
+	city <version> <plane size>
+	texture <path>
+	block <first> <count> <min x> <min y> <min z> <max x> <max y> <max z>
+	building <x> <z> <size> <height> <layer> <shape> <20 occlusion values 0-255>
+Floats are written with enough digits to come back exactly.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "CityFile.h"
+
+static double seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool writeText(const CityData& city, const char* path){
+  FILE* file = fopen(path, "w");
+  if(!file){
+    fprintf(stderr, "%s: can't open for writing\n", path);
+    return false;
+  }
+  fprintf(file, "city %d %u\n", CITY_FILE_VERSION, city.size);
+  for(size_t i = 0; i < city.textures.size(); i++){
+    fprintf(file, "texture %s\n", city.textures[i].c_str());
+  }
+  for(size_t i = 0; i < city.blocks.size(); i++){
+    const CityFileBlock& b = city.blocks[i];
+    fprintf(file, "block %u %u %.9g %.9g %.9g %.9g %.9g %.9g\n", b.first, b.count,
+      b.boundsMin[0], b.boundsMin[1], b.boundsMin[2], b.boundsMax[0], b.boundsMax[1], b.boundsMax[2]);
+  }
+  for(size_t i = 0; i < city.buildings(); i++){
+    fprintf(file, "building %.9g %.9g %.9g %.9g %u %u", city.x[i], city.z[i], city.buildingSize[i], city.height[i], city.layer[i],
+      city.shape[i]);
+    for(int c = 0; c < CITY_FILE_CORNERS; c++){
+      fprintf(file, " %u", city.occlusion[i * CITY_FILE_CORNERS + c]);
+    }
+    fprintf(file, "\n");
+  }
+  bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
+
+//Reads the text form a line at a time
+bool readText(const char* path, CityData& city){
+  FILE* file = fopen(path, "r");
+  if(!file){
+    fprintf(stderr, "%s: can't open\n", path);
+    return false;
+  }
+  city = CityData();
+  char line[1024];
+  int number = 0;
+  bool ok = true;
+  while(ok && fgets(line, sizeof(line), file)){
+    number++;
+    char* rest = line;
+    char* word = strtok_r(rest, " \t\r\n", &rest);
+    if(!word || word[0] == '#'){
+      continue;
+    }
+    if(strcmp(word, "city") == 0){
+      unsigned int version = 0;
+      ok = sscanf(rest, "%u %u", &version, &city.size) == 2 && version == CITY_FILE_VERSION;
+    }else if(strcmp(word, "texture") == 0){
+      char* name = strtok_r(rest, "\r\n", &rest);
+      ok = name && strlen(name) < sizeof(((CityFileTexture*)0)->path);
+      if(ok){
+        city.textures.push_back(name);
+      }
+    }else if(strcmp(word, "block") == 0){
+      CityFileBlock b;
+      ok = sscanf(rest, "%u %u %g %g %g %g %g %g", &b.first, &b.count, &b.boundsMin[0], &b.boundsMin[1], &b.boundsMin[2],
+        &b.boundsMax[0], &b.boundsMax[1], &b.boundsMax[2]) == 8;
+      city.blocks.push_back(b);
+    }else if(strcmp(word, "building") == 0){
+      float x, z, size, height;
+      unsigned int layer, shape;
+      int used = 0;
+      ok = sscanf(rest, "%g %g %g %g %u %u%n", &x, &z, &size, &height, &layer, &shape, &used) == 6;
+      city.x.push_back(x);
+      city.z.push_back(z);
+      city.buildingSize.push_back(size);
+      city.height.push_back(height);
+      city.layer.push_back(layer);
+      city.shape.push_back(shape);
+      rest += used;
+      for(int c = 0; ok && c < CITY_FILE_CORNERS; c++){
+        unsigned int open;
+        ok = sscanf(rest, "%u%n", &open, &used) == 1 && open <= 255;
+        rest += used;
+        city.occlusion.push_back(open);
+      }
+    }else{
+      ok = false;
+    }
+  }
+  fclose(file);
+  if(!ok){
+    fprintf(stderr, "%s:%d: can't read this line\n", path, number);
+  }
+  return ok;
+}
+
+bool info(const char* path){
+  double start = seconds();
+  CityFile city(path);
+  double ms = 1000.0 * (seconds() - start);
+  if(!city.isOpen()){
+    fprintf(stderr, "%s: not a city file this version can read\n", path);
+    return false;
+  }
+  const CityFileHeader& header = city.header();
+  printf("%s: version %u, plane size %u, %u buildings in %u blocks, %u textures, %.1f MB, mapped and checked in %.2f ms\n",
+    path, header.version, header.size, header.buildings, header.blocks, header.textures, header.fileSize / 1048576.0, ms);
+  for(uint32_t i = 0; i < header.textures; i++){
+    printf("  texture %u: %s\n", i, city.texture(i));
+  }
+  return true;
+}
+
+//Binary -> CityData -> binary must give the same bytes, and so must binary -> text -> binary
+bool verify(const char* path){
+  CityFile city(path);
+  if(!city.isOpen()){
+    fprintf(stderr, "%s: not a city file this version can read\n", path);
+    return false;
+  }
+  MappedFile original(path);
+  CityData data;
+  city.read(data);
+  std::vector<unsigned char> bytes;
+  serializeCity(data, bytes);
+  bool binary = bytes.size() == original.size() && memcmp(&bytes[0], original.data(), bytes.size()) == 0;
+  printf("%s: binary round trip %s\n", path, binary ? "identical" : "DIFFERENT");
+
+  std::string textPath = std::string(path) + ".verify.txt";
+  CityData fromText;
+  bool text = writeText(data, textPath.c_str()) && readText(textPath.c_str(), fromText);
+  remove(textPath.c_str());
+  if(text){
+    serializeCity(fromText, bytes);
+    text = bytes.size() == original.size() && memcmp(&bytes[0], original.data(), bytes.size()) == 0 &&
+      validCityFile(&bytes[0], bytes.size());
+  }
+  printf("%s: text round trip %s\n", path, text ? "identical" : "DIFFERENT");
+  return binary && text;
+}
+
+bool toText(const char* in, const char* out){
+  CityFile city(in);
+  if(!city.isOpen()){
+    fprintf(stderr, "%s: not a city file this version can read\n", in);
+    return false;
+  }
+  CityData data;
+  city.read(data);
+  return writeText(data, out);
+}
+
+bool fromText(const char* in, const char* out){
+  CityData data;
+  if(!readText(in, data)){
+    return false;
+  }
+  std::vector<unsigned char> bytes;
+  serializeCity(data, bytes);
+  if(!validCityFile(&bytes[0], bytes.size())){
+    fprintf(stderr, "%s: blocks must cover the buildings in order and layers must name a texture\n", in);
+    return false;
+  }
+  if(!writeCityFile(out, data)){
+    fprintf(stderr, "%s: can't write\n", out);
+    return false;
+  }
+  printf("%s -> %s (%zu buildings)\n", in, out, data.buildings());
+  return true;
+}
+
+int main(int argc, char* argv[]){
+  bool ok = false;
+  if(argc == 3 && strcmp(argv[1], "info") == 0){
+    ok = info(argv[2]);
+  }else if(argc == 3 && strcmp(argv[1], "verify") == 0){
+    ok = verify(argv[2]);
+  }else if(argc == 4 && strcmp(argv[1], "to-text") == 0){
+    ok = toText(argv[2], argv[3]);
+  }else if(argc == 4 && strcmp(argv[1], "from-text") == 0){
+    ok = fromText(argv[2], argv[3]);
+  }else{
+    fprintf(stderr, "Usage: %s info|verify city.city\n"
+      "       %s to-text city.city city.txt\n"
+      "       %s from-text city.txt city.city\n", argv[0], argv[0], argv[0]);
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,710 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Exports a saved city (.city, see CityFile.h) for other tools,
+as binary glTF 2.0 (.glb) or Wavefront OBJ (.obj, with a .mtl beside it).
+Everything the Plane draws is written: the ground blocks, the boundary
+lines and the buildings, with the same mesh and texture coordinates the
+city uses (Building::writeMesh) and a material per facade texture that
+refers to the city's image by its path.
+
+Usage: export_city city.city out.glb
+       export_city city.city out.obj
+
+The city is streamed in pieces of a few dozen blocks. Worker threads,
+one a core, each turn a piece into vertices (equal ones merged) and
+indices, or OBJ text, while the main thread writes finished pieces in
+order. Only a few pieces a thread are held at once and the pages of the
+city file are let go once their buildings are written, so the memory used
+doesn't grow with the city.
+
+In the .glb all the vertices share one interleaved buffer, written as the
+pieces come in. The indices of each material are collected in a
+temporary file and appended at the end; the JSON, whose size hardly
+depends on the city, goes in space kept for it at the start.
+Texture paths are written as saved, relative to where the city was run.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sys/resource.h>
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+#include "CityFile.h"
+#include "Building.h"
+
+enum{
+  BLOCKS_PER_PIECE = 64,
+  ROWS_PER_PIECE = 8,//Rows of ground blocks
+  PIECES_PER_THREAD = 4,//Finished or being made, waiting to be written
+  JSON_SPACE = 4096,//Kept for the glTF JSON, plus some for each texture
+  JSON_SPACE_PER_TEXTURE = 512
+};
+
+//Same as the Plane
+static const float GROUND_BLOCK = 10.0f;
+static const int GROUND_SPACING = 12;
+
+static double seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void appendf(std::string& text, const char* format, ...){
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  text.append(line, std::min(length, int(sizeof(line)) - 1));
+}
+
+/*Numbers equal values of N floats in the order they are first added.
+Values are compared bit for bit*/
+template<int N>
+class Dedup{
+public:
+  struct Value{
+    float v[N];
+  };
+
+  uint32_t add(const float* v){
+    Value value;
+    memcpy(value.v, v, sizeof(value.v));
+    std::pair<typename Index::iterator, bool> added = _index.insert(std::make_pair(value, uint32_t(_values.size())));
+    if(added.second){
+      _values.push_back(value);
+    }
+    return added.first->second;
+  }
+
+  //Keeps the memory for the next piece
+  void clear(){
+    _index.clear();
+    _values.clear();
+  }
+
+  const std::vector<Value>& values() const{
+    return _values;
+  }
+
+private:
+  struct Hash{
+    size_t operator()(const Value& value) const{
+      const unsigned char* bytes = (const unsigned char*)value.v;
+      uint64_t hash = 14695981039346656037ULL;//FNV-1a
+      for(size_t i = 0; i < sizeof(value.v); i++){
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+      return hash;
+    }
+  };
+
+  struct Equal{
+    bool operator()(const Value& a, const Value& b) const{
+      return memcmp(a.v, b.v, sizeof(a.v)) == 0;
+    }
+  };
+
+  typedef std::unordered_map<Value, uint32_t, Hash, Equal> Index;
+  Index _index;
+  std::vector<Value> _values;
+};
+
+
+//A vertex as the .glb stores it: position, normal, texture coordinate
+typedef Dedup<8>::Value GltfVertex;
+
+/*Part of the city turned into output. For glTF, indices are kept per
+stream: one for each facade texture, then the ground and the boundary
+lines, each numbered from the piece's first vertex*/
+struct Piece{
+  std::vector<GltfVertex> vertices;
+  std::vector<std::vector<uint32_t> > indices;
+  std::string text;//OBJ
+  uint32_t firstBlock;
+  uint32_t blocks;
+  size_t added;//Vertices before merging
+};
+
+//Splits the city into pieces and makes them, from any number of threads
+class Exporter{
+public:
+  Exporter(const CityFile& city, bool obj):
+    _city(city),
+    _obj(obj),
+    _textures(city.header().textures){
+    const CityFileHeader& header = city.header();
+    _buildingPieces = (header.blocks + BLOCKS_PER_PIECE - 1) / BLOCKS_PER_PIECE;
+    uint32_t rows = (header.size + GROUND_SPACING - 1) / GROUND_SPACING;
+    _groundPieces = (rows + ROWS_PER_PIECE - 1) / ROWS_PER_PIECE;
+  }
+
+  uint32_t groundStream() const{
+    return _textures;
+  }
+
+  uint32_t lineStream() const{
+    return _textures + 1;
+  }
+
+  uint32_t streams() const{
+    return _textures + 2;
+  }
+
+  //Building pieces, then the ground, then one for the boundary lines
+  uint32_t pieces() const{
+    return _buildingPieces + _groundPieces + 1;
+  }
+
+  //One thread's working memory, kept from piece to piece
+  struct Scratch{
+    Dedup<8> vertices;//glTF, merged over the piece
+    Dedup<3> positions;//OBJ, merged over a block
+    Dedup<2> texCoords;
+    Dedup<3> normals;
+    std::vector<std::vector<uint32_t> > faces;//OBJ position, texture coordinate and normal numbers of each stream
+  };
+
+  void make(uint32_t p, Piece& piece, Scratch& scratch) const{
+    piece.vertices.clear();
+    piece.indices.resize(streams());
+    for(uint32_t s = 0; s < streams(); s++){
+      piece.indices[s].clear();
+    }
+    piece.text.clear();
+    piece.firstBlock = piece.blocks = 0;
+    piece.added = 0;
+    scratch.vertices.clear();
+    scratch.faces.resize(streams());
+    if(p < _buildingPieces){
+      makeBuildings(p, piece, scratch);
+    }else if(p < _buildingPieces + _groundPieces){
+      makeGround(p - _buildingPieces, piece, scratch);
+      writeText("ground", piece, scratch);
+    }else{
+      makeLines(piece, scratch);
+      writeText("boundary", piece, scratch);
+    }
+    if(!_obj){
+      piece.vertices = scratch.vertices.values();
+    }
+  }
+
+private:
+  const CityFile& _city;
+  bool _obj;
+  uint32_t _textures;
+  uint32_t _buildingPieces;
+  uint32_t _groundPieces;
+
+  //A vertex's numbers: the glTF one, or the three OBJ ones
+  struct Corner{
+    uint32_t vertex;
+    uint32_t position;
+    uint32_t texCoord;
+    uint32_t normal;
+  };
+
+  void makeBuildings(uint32_t p, Piece& piece, Scratch& scratch) const{
+    const CityFileBlock* blocks = _city.blocks();
+    uint32_t first = p * BLOCKS_PER_PIECE;
+    uint32_t last = std::min<uint32_t>(first + BLOCKS_PER_PIECE, _city.header().blocks);
+    piece.firstBlock = first;
+    piece.blocks = last - first;
+    Building::Vertex vertices[Building::MAX_VERTICES];
+    GLuint indices[Building::MAX_INDICES];
+    Corner corners[Building::MAX_VERTICES];
+    for(uint32_t b = first; b < last; b++){
+      for(uint32_t i = blocks[b].first; i < blocks[b].first + blocks[b].count; i++){
+        uint32_t layer = _city.layer()[i];
+        Building building(_city.x()[i], _city.z()[i], _city.size()[i], _city.height()[i], layer, _city.shape()[i]);
+        building.writeMesh(vertices, indices);
+        for(int v = 0; v < building.vertexCount(); v++){
+          const Building::Vertex& vertex = vertices[v];
+          const float out[8] = {vertex.position[0], vertex.position[1], vertex.position[2],
+            vertex.normal[0], vertex.normal[1], vertex.normal[2], vertex.texCoord[0], vertex.texCoord[1]};
+          corners[v] = add(out, piece, scratch);
+        }
+        for(int t = 0; t < building.indexCount(); t += 3){
+          triangle(layer, corners[indices[t]], corners[indices[t + 1]], corners[indices[t + 2]], piece, scratch);
+        }
+      }
+      char group[32];
+      snprintf(group, sizeof(group), "block%u", b);
+      writeText(group, piece, scratch);
+    }
+  }
+
+  //Rows of the green blocks the buildings stand on
+  void makeGround(uint32_t p, Piece& piece, Scratch& scratch) const{
+    int size = _city.header().size;
+    int firstRow = p * ROWS_PER_PIECE * GROUND_SPACING;
+    int lastRow = std::min(size, firstRow + ROWS_PER_PIECE * GROUND_SPACING);
+    const float square[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+    for(int j = firstRow; j < lastRow; j += GROUND_SPACING){
+      for(int i = 0; i < size; i += GROUND_SPACING){
+        Corner corners[4];
+        for(int c = 0; c < 4; c++){
+          const float out[8] = {i + GROUND_BLOCK * square[c][0], 0.0f, -j - GROUND_BLOCK * square[c][1],
+            0.0f, 1.0f, 0.0f, square[c][0], square[c][1]};
+          corners[c] = add(out, piece, scratch);
+        }
+        triangle(groundStream(), corners[0], corners[1], corners[2], piece, scratch);
+        triangle(groundStream(), corners[0], corners[2], corners[3], piece, scratch);
+      }
+    }
+  }
+
+  //The four lines around the plane, where the Plane draws them
+  void makeLines(Piece& piece, Scratch& scratch) const{
+    float size = _city.header().size;
+    const float around[4][2] = {{-2.0f, 2.0f}, {-2.0f, -size - 8}, {size + 8, -size - 8}, {size + 8, 2.0f}};
+    for(int l = 0; l < 4; l++){
+      for(int e = 0; e < 2; e++){
+        const float* end = around[(l + e) % 4];
+        const float out[8] = {end[0], 0.0f, end[1], 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+        Corner corner = add(out, piece, scratch);
+        if(_obj){
+          scratch.faces[lineStream()].push_back(corner.position);
+        }else{
+          piece.indices[lineStream()].push_back(corner.vertex);
+        }
+      }
+    }
+  }
+
+  /*glTF merges whole vertices; OBJ numbers positions, texture
+  coordinates and normals separately*/
+  Corner add(const float* v, Piece& piece, Scratch& scratch) const{
+    Corner corner;
+    piece.added++;
+    if(!_obj){
+      corner.vertex = scratch.vertices.add(v);
+      return corner;
+    }
+    const float texCoord[2] = {v[6], 1.0f - v[7]};//OBJ counts up from the bottom of the image
+    corner.position = scratch.positions.add(v);
+    corner.texCoord = scratch.texCoords.add(texCoord);
+    corner.normal = scratch.normals.add(v + 3);
+    return corner;
+  }
+
+  void triangle(uint32_t stream, const Corner& a, const Corner& b, const Corner& c, Piece& piece, Scratch& scratch) const{
+    const Corner* corners[3] = {&a, &b, &c};
+    for(int i = 0; i < 3; i++){
+      if(_obj){
+        scratch.faces[stream].push_back(corners[i]->position);
+        scratch.faces[stream].push_back(corners[i]->texCoord);
+        scratch.faces[stream].push_back(corners[i]->normal);
+      }else{
+        piece.indices[stream].push_back(corners[i]->vertex);
+      }
+    }
+  }
+
+  /*OBJ: writes the values numbered since the last call, then the faces
+  and lines using them as a group. Faces count back from the last value
+  written (-1 is the last), so the text is the same wherever in the file
+  it ends up and pieces can be made in any order*/
+  void writeText(const char* group, Piece& piece, Scratch& scratch) const{
+    if(!_obj){
+      return;
+    }
+    const std::vector<Dedup<3>::Value>& positions = scratch.positions.values();
+    const std::vector<Dedup<2>::Value>& texCoords = scratch.texCoords.values();
+    const std::vector<Dedup<3>::Value>& normals = scratch.normals.values();
+    if(positions.empty()){
+      return;
+    }
+    for(size_t i = 0; i < positions.size(); i++){
+      appendf(piece.text, "v %.9g %.9g %.9g\n", positions[i].v[0], positions[i].v[1], positions[i].v[2]);
+    }
+    for(size_t i = 0; i < texCoords.size(); i++){
+      appendf(piece.text, "vt %.9g %.9g\n", texCoords[i].v[0], texCoords[i].v[1]);
+    }
+    for(size_t i = 0; i < normals.size(); i++){
+      appendf(piece.text, "vn %.9g %.9g %.9g\n", normals[i].v[0], normals[i].v[1], normals[i].v[2]);
+    }
+    appendf(piece.text, "g %s\n", group);
+    long p = positions.size(), t = texCoords.size(), n = normals.size();
+    for(uint32_t s = 0; s < streams(); s++){
+      const std::vector<uint32_t>& faces = scratch.faces[s];
+      if(faces.empty()){
+        continue;
+      }
+      if(s < _textures){
+        appendf(piece.text, "usemtl facade%u\n", s);
+      }else{
+        appendf(piece.text, "usemtl %s\n", s == groundStream() ? "ground" : "boundary");
+      }
+      if(s == lineStream()){
+        for(size_t i = 0; i < faces.size(); i += 2){
+          appendf(piece.text, "l %ld %ld\n", faces[i] - p, faces[i + 1] - p);
+        }
+        continue;
+      }
+      for(size_t i = 0; i < faces.size(); i += 9){
+        appendf(piece.text, "f %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld\n",
+          faces[i] - p, faces[i + 1] - t, faces[i + 2] - n,
+          faces[i + 3] - p, faces[i + 4] - t, faces[i + 5] - n,
+          faces[i + 6] - p, faces[i + 7] - t, faces[i + 8] - n);
+      }
+    }
+    for(uint32_t s = 0; s < streams(); s++){
+      scratch.faces[s].clear();
+    }
+    scratch.positions.clear();
+    scratch.texCoords.clear();
+    scratch.normals.clear();
+  }
+};
+
+//Where finished pieces go, in order
+class Writer{
+public:
+  virtual ~Writer(){}
+  virtual bool write(Piece& piece) = 0;
+  virtual bool finish() = 0;
+};
+
+class ObjWriter: public Writer{
+public:
+  ObjWriter(): _file(NULL){}
+
+  virtual ~ObjWriter(){
+    if(_file){
+      fclose(_file);
+    }
+  }
+
+  //Also writes the materials, to the same path ending in .mtl
+  bool open(const char* path, const CityFile& city){
+    std::string materials(path);
+    materials = materials.substr(0, materials.rfind('.')) + ".mtl";
+    FILE* mtl = fopen(materials.c_str(), "w");
+    if(!mtl){
+      fprintf(stderr, "%s: can't open for writing\n", materials.c_str());
+      return false;
+    }
+    for(uint32_t i = 0; i < city.header().textures; i++){
+      fprintf(mtl, "newmtl facade%u\nKd 1 1 1\nmap_Kd %s\n\n", i, city.texture(i));
+    }
+    fprintf(mtl, "newmtl ground\nKd 0 1 0\n\nnewmtl boundary\nKd 0 0 1\n");
+    bool ok = !ferror(mtl);
+    if(fclose(mtl) != 0 || !ok){
+      fprintf(stderr, "%s: can't write\n", materials.c_str());
+      return false;
+    }
+    _file = fopen(path, "w");
+    if(!_file){
+      fprintf(stderr, "%s: can't open for writing\n", path);
+      return false;
+    }
+    size_t slash = materials.rfind('/');
+    fprintf(_file, "# City of %u buildings, written by export_city\nmtllib %s\n", city.header().buildings,
+      materials.c_str() + (slash == std::string::npos ? 0 : slash + 1));
+    return true;
+  }
+
+  virtual bool write(Piece& piece){
+    return fwrite(piece.text.data(), 1, piece.text.size(), _file) == piece.text.size();
+  }
+
+  virtual bool finish(){
+    bool ok = !ferror(_file);
+    ok = fclose(_file) == 0 && ok;
+    _file = NULL;
+    return ok;
+  }
+
+private:
+  FILE* _file;
+};
+
+/*Binary glTF: a 12 byte header, the JSON chunk, then the binary chunk of
+all the vertices followed by the indices of each stream*/
+class GltfWriter: public Writer{
+public:
+  GltfWriter(const Exporter& exporter): _exporter(exporter), _file(NULL), _vertices(0){
+    _boundsMin[0] = _boundsMin[1] = _boundsMin[2] = 1e30f;
+    _boundsMax[0] = _boundsMax[1] = _boundsMax[2] = -1e30f;
+  }
+
+  virtual ~GltfWriter(){
+    if(_file){
+      fclose(_file);
+    }
+    for(size_t s = 0; s < _streams.size(); s++){
+      fclose(_streams[s]);
+    }
+  }
+
+  bool open(const char* path, const CityFile& city){
+    _city = &city;
+    _jsonSpace = JSON_SPACE + JSON_SPACE_PER_TEXTURE * city.header().textures;
+    _file = fopen(path, "wb");
+    if(!_file){
+      fprintf(stderr, "%s: can't open for writing\n", path);
+      return false;
+    }
+    for(uint32_t s = 0; s < _exporter.streams(); s++){
+      FILE* stream = tmpfile();
+      if(!stream){
+        fprintf(stderr, "can't make a temporary file\n");
+        return false;
+      }
+      _streams.push_back(stream);
+      _indices.push_back(0);
+    }
+    //Room for the header and the JSON, filled in by finish()
+    std::vector<char> space(dataStart(), 0);
+    return fwrite(&space[0], 1, space.size(), _file) == space.size();
+  }
+
+  virtual bool write(Piece& piece){
+    for(size_t i = 0; i < piece.vertices.size(); i++){
+      for(int a = 0; a < 3; a++){
+        _boundsMin[a] = std::min(_boundsMin[a], piece.vertices[i].v[a]);
+        _boundsMax[a] = std::max(_boundsMax[a], piece.vertices[i].v[a]);
+      }
+    }
+    bool ok = piece.vertices.empty() ||
+      fwrite(&piece.vertices[0], sizeof(GltfVertex), piece.vertices.size(), _file) == piece.vertices.size();
+    for(size_t s = 0; ok && s < _streams.size(); s++){
+      std::vector<uint32_t>& indices = piece.indices[s];
+      if(indices.empty()){
+        continue;
+      }
+      for(size_t i = 0; i < indices.size(); i++){
+        indices[i] += _vertices;
+      }
+      ok = fwrite(&indices[0], 4, indices.size(), _streams[s]) == indices.size();
+      _indices[s] += indices.size();
+    }
+    _vertices += piece.vertices.size();
+    return ok;
+  }
+
+  virtual bool finish(){
+    uint64_t binary = _vertices * sizeof(GltfVertex);
+    for(size_t s = 0; s < _streams.size(); s++){
+      binary += _indices[s] * 4;
+    }
+    uint64_t length = dataStart() + binary;
+    if(length > 0xffffffffULL){
+      fprintf(stderr, "too big for a .glb (%.1f GB), try .obj\n", length / 1073741824.0);
+      return false;
+    }
+    //Indices after the vertices
+    std::vector<char> copy(1 << 20);
+    bool ok = true;
+    for(size_t s = 0; ok && s < _streams.size(); s++){
+      rewind(_streams[s]);
+      size_t read;
+      while(ok && (read = fread(&copy[0], 1, copy.size(), _streams[s])) > 0){
+        ok = fwrite(&copy[0], 1, read, _file) == read;
+      }
+    }
+    std::string json = makeJson(binary);
+    if(json.size() > _jsonSpace){
+      fprintf(stderr, "glTF JSON needs %zu bytes, only %u were kept for it\n", json.size(), _jsonSpace);
+      return false;
+    }
+    json.resize(_jsonSpace, ' ');//The spec pads the JSON chunk with spaces
+    const uint32_t header[5] = {0x46546C67, 2, uint32_t(length), _jsonSpace, 0x4E4F534A};//"glTF", version, length, then the JSON chunk
+    const uint32_t binaryHeader[2] = {uint32_t(binary), 0x004E4942};//"BIN"
+    ok = ok && fseek(_file, 0, SEEK_SET) == 0 &&
+      fwrite(header, sizeof(header), 1, _file) == 1 &&
+      fwrite(json.data(), 1, json.size(), _file) == json.size() &&
+      fwrite(binaryHeader, sizeof(binaryHeader), 1, _file) == 1;
+    ok = !ferror(_file) && ok;
+    ok = fclose(_file) == 0 && ok;
+    _file = NULL;
+    return ok;
+  }
+
+private:
+  const Exporter& _exporter;
+  const CityFile* _city;
+  FILE* _file;
+  std::vector<FILE*> _streams;//Temporary files of indices
+  std::vector<uint64_t> _indices;
+  uint64_t _vertices;
+  float _boundsMin[3];
+  float _boundsMax[3];
+  uint32_t _jsonSpace;//A multiple of 4, as chunks must be
+
+  size_t dataStart() const{
+    return 12 + 8 + _jsonSpace + 8;
+  }
+
+  std::string makeJson(uint64_t binary) const{
+    std::string json;
+    appendf(json, "{\"asset\":{\"version\":\"2.0\",\"generator\":\"export_city\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+      "\"nodes\":[{\"mesh\":0,\"name\":\"city\"}],\"buffers\":[{\"byteLength\":%llu}],", (unsigned long long)binary);
+    //Buffer view 0 is the vertices, then one a stream that has any indices
+    appendf(json, "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"byteStride\":%zu,\"target\":34962}",
+      (unsigned long long)(_vertices * sizeof(GltfVertex)), sizeof(GltfVertex));
+    uint64_t offset = _vertices * sizeof(GltfVertex);
+    for(size_t s = 0; s < _streams.size(); s++){
+      if(_indices[s]){
+        appendf(json, ",{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}",
+          (unsigned long long)offset, (unsigned long long)(_indices[s] * 4));
+        offset += _indices[s] * 4;
+      }
+    }
+    appendf(json, "],\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\","
+      "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]}", (unsigned long long)_vertices,
+      _boundsMin[0], _boundsMin[1], _boundsMin[2], _boundsMax[0], _boundsMax[1], _boundsMax[2]);
+    appendf(json, ",{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"}", (unsigned long long)_vertices);
+    appendf(json, ",{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC2\"}", (unsigned long long)_vertices);
+    int view = 1;
+    for(size_t s = 0; s < _streams.size(); s++){
+      if(_indices[s]){
+        appendf(json, ",{\"bufferView\":%d,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}", view++, (unsigned long long)_indices[s]);
+      }
+    }
+    //A primitive a stream, with the stream's material
+    json += "],\"meshes\":[{\"primitives\":[";
+    int accessor = 3;
+    bool first = true;
+    for(size_t s = 0; s < _streams.size(); s++){
+      if(_indices[s]){
+        appendf(json, "%s{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":%d,\"material\":%zu,\"mode\":%d}",
+          first ? "" : ",", accessor++, s, s == _exporter.lineStream() ? 1 : 4);
+        first = false;
+      }
+    }
+    json += "]}],\"materials\":[";
+    uint32_t textures = _exporter.groundStream();
+    for(uint32_t i = 0; i < textures; i++){
+      appendf(json, "{\"name\":\"facade%u\",\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":%u},\"metallicFactor\":0}},", i, i);
+    }
+    json += "{\"name\":\"ground\",\"pbrMetallicRoughness\":{\"baseColorFactor\":[0,1,0,1],\"metallicFactor\":0}},"
+      "{\"name\":\"boundary\",\"pbrMetallicRoughness\":{\"baseColorFactor\":[0,0,1,1],\"metallicFactor\":0}}],";
+    //Facades repeat, like the city's GL_REPEAT
+    json += "\"samplers\":[{\"wrapS\":10497,\"wrapT\":10497}],\"textures\":[";
+    for(uint32_t i = 0; i < textures; i++){
+      appendf(json, "%s{\"sampler\":0,\"source\":%u}", i ? "," : "", i);
+    }
+    json += "],\"images\":[";
+    for(uint32_t i = 0; i < textures; i++){
+      json += i ? ",{\"uri\":\"" : "{\"uri\":\"";
+      for(const char* c = _city->texture(i); *c; c++){
+        if(*c == '"' || *c == '\\' || (unsigned char)*c < 0x20 || *c == ' ' || *c == '%'){
+          appendf(json, "%%%02X", (unsigned char)*c);//Escaped as a URI, which also keeps the JSON string simple
+        }else{
+          json += *c;
+        }
+      }
+      json += "\"}";
+    }
+    json += "]}";
+    return json;
+  }
+};
+
+/*Runs the exporter on every core and hands the pieces to the writer in
+order. A worker waits before starting a piece that is too far ahead of
+the writer, which bounds how many are in memory*/
+bool exportCity(CityFile& city, const Exporter& exporter, Writer& writer, size_t& added, size_t& kept){
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t window = threads * PIECES_PER_THREAD;
+  uint32_t pieces = exporter.pieces();
+  std::vector<Piece> slots(window);
+  std::vector<bool> done(window, false);
+  std::mutex lock;
+  std::condition_variable changed;
+  uint32_t written = 0;
+  bool failed = false;
+  std::atomic<uint32_t> next(0);
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < threads; t++){
+    workers.push_back(std::thread([&](){
+      Exporter::Scratch scratch;
+      for(uint32_t p = next++; p < pieces; p = next++){
+        {
+          std::unique_lock<std::mutex> wait(lock);
+          changed.wait(wait, [&](){ return p < written + window || failed; });
+          if(failed){
+            return;
+          }
+        }
+        exporter.make(p, slots[p % window], scratch);
+        std::lock_guard<std::mutex> finished(lock);
+        done[p % window] = true;
+        changed.notify_all();
+      }
+    }));
+  }
+  added = kept = 0;
+  for(uint32_t p = 0; p < pieces && !failed; p++){
+    {
+      std::unique_lock<std::mutex> wait(lock);
+      changed.wait(wait, [&](){ return done[p % window]; });
+    }
+    Piece& piece = slots[p % window];
+    bool ok = writer.write(piece);
+    added += piece.added;
+    kept += piece.vertices.size();
+    city.release(piece.firstBlock, piece.blocks);
+    std::lock_guard<std::mutex> free(lock);
+    failed = !ok;
+    done[p % window] = false;
+    written = p + 1;
+    changed.notify_all();
+  }
+  for(size_t t = 0; t < workers.size(); t++){
+    workers[t].join();
+  }
+  return !failed && writer.finish();
+}
+
+int main(int argc, char* argv[]){
+  const char* out = argc == 3 ? strrchr(argv[2], '.') : NULL;
+  bool obj = out && strcmp(out, ".obj") == 0;
+  if(!out || (!obj && strcmp(out, ".glb") != 0)){
+    fprintf(stderr, "Usage: %s city.city out.glb|out.obj\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  double start = seconds();
+  CityFile city(argv[1], MappedFile::SEQUENTIAL);
+  if(!city.isOpen()){
+    fprintf(stderr, "%s: not a city file this version can read\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  Exporter exporter(city, obj);
+  ObjWriter objWriter;
+  GltfWriter gltfWriter(exporter);
+  bool ok = obj ? objWriter.open(argv[2], city) : gltfWriter.open(argv[2], city);
+  size_t added = 0, kept = 0;
+  ok = ok && exportCity(city, exporter, obj ? (Writer&)objWriter : (Writer&)gltfWriter, added, kept);
+  if(!ok){
+    fprintf(stderr, "%s: can't write\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%s -> %s: %u buildings in %.2f s, peak memory %.1f MB\n", argv[1], argv[2], city.header().buildings,
+    seconds() - start, usage.ru_maxrss / 1024.0);
+  if(!obj){
+    printf("  %zu vertices, %zu before merging equal ones\n", kept, added);
+  }
+  return EXIT_SUCCESS;
+}
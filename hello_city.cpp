@@ -16,17 +16,45 @@ Desciption: Program which renders a city
 #include "GLFWApp.h"
 #include "GLSLShader.h"
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
 
 //Our Image loading library
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "MappedFile.h"
+#include "BakedTexture.h"
+#include "CityFile.h"
 #include "Texture.h"
+#include "TextureManager.h"
 
 #include "SpinningLight.h"
 #include "Camera.h"
+#include "Frustum.h"
+#include "RingBuffer.h"
+#include "DebugLines.h"
+#include "SpatialGrid.h"
+#include "Material.h"
+#include "ClusteredLights.h"
 #include "Building.h"
+#include "AmbientOcclusion.h"
+#include "BufferAllocator.h"
+//Counts every allocation, for the city mesh's startup output
+#define ALLOCATION_COUNT_IMPLEMENTATION
+#include "AllocationCount.h"
+#include "CityMesh.h"
 #include "Plane.h"
 #include "World.h"
+#include "GPUTimer.h"
+#include "ShadowMap.h"
+#include "LightingUniforms.h"
+#include "DeferredRenderer.h"
+#include "Atmosphere.h"
+#include "DayNightCycle.h"
 
 void msglVersion(void){
   fprintf(stderr, "OpenGL Version Information:\n");
@@ -38,6 +66,16 @@ void msglVersion(void){
 
 class CityApp : public GLFWApp{
 private:
+  //What the keys do, see initInput()
+  enum{
+	QUIT, RESET,
+	PAN_LEFT, PAN_RIGHT, FORWARD, BACKWARD, ASCEND, DESCEND, STRAFE_LEFT, STRAFE_RIGHT, LOOK_UP, LOOK_DOWN,
+	SUN_UP, SUN_DOWN, SUN_LEFT, SUN_RIGHT,
+	CYCLE_FILTER, REGENERATE, REPORT_TEXTURES, TOGGLE_SHADOWS, CYCLE_LAMPS, TOGGLE_TIMINGS,
+	CYCLE_FRAME_CAP, CYCLE_SYNC, TOGGLE_DEFERRED, TOGGLE_GPU_CULLING, TOGGLE_BOUNDS, TOGGLE_SKY, TOGGLE_DAY_NIGHT, BENCHMARK,
+	TOGGLE_FACADES, ADD_BUILDING, REMOVE_BUILDING, RAISE_BUILDING, LOWER_BUILDING, BENCHMARK_EDITS, SAVE_CITY
+  };
+
   Camera camera;
   SpinningLight light0;
   World* city;
@@ -50,17 +88,69 @@ private:
   unsigned int uModelViewMatrix_A;
   unsigned int uProjectionMatrix_A;
   unsigned int uNormalMatrix_A;
-  unsigned int uLight0_position_A;
-  unsigned int uLight0_color_A;
-  glm::mat4 modelViewMatrix_B;
+  unsigned int uProceduralFacades_A;
+  LightingUniforms lighting_A;//Sun, shadows and street lamps
+  glm::mat4 inverseViewProjection_B;
 
   GLSLProgram shaderProgram_B;
-  unsigned int uModelViewMatrix_B;
-  unsigned int uProjectionMatrix_B;
+  unsigned int uInverseViewProjection_B;
+
+  Atmosphere* sky;
+  DayNightCycle dayNight;//Drives light0 and the sky over time
+  bool proceduralSky;//Otherwise the skybox cubemap is drawn
+  bool proceduralFacades;//Otherwise the buildings sample the facade textures
+
+  CascadedShadowMap* shadows;
+  bool shadowsEnabled;
+  ClusteredLights* lights;//Street lamps
+  int lampSetting;//Index into lampCounts()
+  DeferredRenderer* deferred;
+  bool deferredShading;//Otherwise the city is shaded while it is drawn (forward)
+  bool gpuCulling;//Buildings culled by a compute shader and drawn indirectly (OpenGL 4.3)
+
+  //Performance measurement
+  GPUTimer cityTimer;//GPU time spent drawing the city
+  GPUTimer shadowTimer;//GPU time spent re-rendering shadow cascades
+  GPUTimer skyboxTimer;
+  Texture::filter_t buildingFilter;
+  bool showTimings;
+  double lastFrameTime;
+  double frameTimeTotal;
+  int frameCount;
+  int frameCapSetting;//Index into frameCaps()
+  int syncSetting;//Index into syncModes()
+  RingBuffer* stream;//Per frame data for the GPU, NULL without OpenGL 4.4
+  DebugLines* debugLines;
+  bool showBounds;//Outline the buildings that pass the camera's frustum test
+  //Forward vs. deferred sweep over lamp counts, started with the K key
+  int benchmarkStep;//-1 when no sweep is running
+  bool benchmarkWarmedUp;
+  std::vector<double> benchmarkMs;
+  const char* cityFile;//Opened instead of generating a city, from the command line
 
 public:
   CityApp(int argc, char* argv[]):GLFWApp(argc, argv, 
-	std::string("CPSC 486-02 Final Project: City by David Tu").c_str(), 600, 600){}
+	std::string("CPSC 486-02 Final Project: City by David Tu").c_str(), 600, 600,
+	3, 0),//GLSL 1.30 for the facade array texture
+	city(nullptr),
+	sky(nullptr),
+	shadows(nullptr),
+	lights(nullptr),
+	deferred(nullptr),
+	stream(nullptr),
+	debugLines(nullptr),
+	cityFile(argc > 1 ? argv[1] : nullptr){}
+
+  //Runs before GLFWApp destroys the context, so the city's GL objects are freed cleanly
+  virtual ~CityApp(){
+	delete debugLines;
+	delete stream;
+	delete deferred;
+	delete lights;
+	delete shadows;
+	delete sky;
+	delete city;
+  }
 
   void initCamera(){
 	//Set the camera in this position
@@ -82,6 +172,7 @@ public:
 	VertexShader vertexShader_A(vertexShaderSource_A);
 	shaderProgram_A.attach(vertexShader_A);
 	shaderProgram_A.attach(fragmentShader_A);
+	shaderProgram_A.bindAttribLocation(Building::ORIGIN_ATTRIBUTE, "origin");//Read by shaders/packed_vertex.glsl
 	shaderProgram_A.link();
 	shaderProgram_A.activate();
 	printf("Shader program A built from %s and %s.\n", vertexShaderSource_A, fragmentShaderSource_A);
@@ -111,14 +202,215 @@ public:
 	uModelViewMatrix_A = glGetUniformLocation(shaderProgram_A.id(), "modelViewMatrix");
 	uProjectionMatrix_A = glGetUniformLocation(shaderProgram_A.id(), "projectionMatrix");
 	uNormalMatrix_A = glGetUniformLocation(shaderProgram_A.id(), "normalMatrix");
-	uLight0_position_A = glGetUniformLocation(shaderProgram_A.id(), "light0_position");
-	uLight0_color_A = glGetUniformLocation(shaderProgram_A.id(), "light0_color");
-	uModelViewMatrix_B = glGetUniformLocation(shaderProgram_B.id(), "modelViewMatrix_B");
-	uProjectionMatrix_B = glGetUniformLocation(shaderProgram_B.id(), "projectionMatrix_B");
+	uProceduralFacades_A = glGetUniformLocation(shaderProgram_A.id(), "proceduralFacades");
+	//Facades are sampled from texture unit 0, the lighting textures come after it
+	shaderProgram_A.activate();
+	glUniform1i(glGetUniformLocation(shaderProgram_A.id(), "building"), 0);
+	lighting_A.locate(shaderProgram_A.id());
+	uInverseViewProjection_B = glGetUniformLocation(shaderProgram_B.id(), "inverseViewProjection_B");
   }
 
   void initWorld(){
-	city = new World();
+	city = new World(cityFile);
+	buildingFilter = Texture::ANISOTROPIC;
+	proceduralFacades = false;
+	gpuCulling = city->setGpuDriven(true);
+	printf("Buildings culled and drawn %s.\n", gpuCulling ? "on the GPU (multi-draw-indirect)" : "on the CPU");
+  }
+
+  void initSky(){
+	sky = new Atmosphere();
+	dayNight = DayNightCycle();
+	proceduralSky = true;
+  }
+
+  void initShadows(){
+	shadows = new CascadedShadowMap();
+	shadowsEnabled = true;
+  }
+
+  //Street lamp counts to cycle through with the L key, for benchmarking
+  static int lampCounts(int setting){
+	const int counts[] = {1000, 10000, 50000, 0};
+	return counts[setting % 4];
+  }
+
+  void initPointLights(){
+	lights = new ClusteredLights();
+	lampSetting = 0;
+	lights->setLights(city->streetLamps(lampCounts(lampSetting)));
+  }
+
+  //Light tables, culled building lists and debug lines are streamed through one ring buffer
+  void initStream(){
+	if(RingBuffer::supported()){
+		stream = new RingBuffer(4 * 1024 * 1024);
+	}
+	lights->setStreamBuffer(stream);
+	city->setStreamBuffer(stream);
+	debugLines = new DebugLines();
+	showBounds = false;
+  }
+
+  void initDeferred(){
+	deferred = new DeferredRenderer();
+	deferredShading = false;
+	benchmarkStep = -1;
+  }
+
+  //Both lighting programs get the city's material table
+  void uploadMaterials(){
+	shaderProgram_A.activate();
+	lighting_A.setMaterials(city->materials());
+	deferred->setMaterials(city->materials());
+  }
+
+  //Held keys move the camera and the sun; the rest act once per press
+  void initInput(){
+	InputMap& keys = input();
+	keys.clear();
+	keys.bind('Q', QUIT, InputMap::PRESSED);
+	keys.bind('R', RESET, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_LEFT, PAN_LEFT);
+	keys.bind(GLFW_KEY_RIGHT, PAN_RIGHT);
+	keys.bind(GLFW_KEY_UP, FORWARD);
+	keys.bind(GLFW_KEY_DOWN, BACKWARD);
+	keys.bind('W', ASCEND);
+	keys.bind('S', DESCEND);
+	keys.bind('A', STRAFE_LEFT);
+	keys.bind('D', STRAFE_RIGHT);
+	keys.bind('X', LOOK_UP);
+	keys.bind('Y', LOOK_DOWN);
+	keys.bind('H', SUN_UP);
+	keys.bind('G', SUN_DOWN);
+	keys.bind('J', SUN_LEFT);
+	keys.bind('N', SUN_RIGHT);
+	keys.bind('F', CYCLE_FILTER, InputMap::PRESSED);
+	keys.bind('C', REGENERATE, InputMap::PRESSED);
+	keys.bind('V', REPORT_TEXTURES, InputMap::PRESSED);
+	keys.bind('O', TOGGLE_SHADOWS, InputMap::PRESSED);
+	keys.bind('L', CYCLE_LAMPS, InputMap::PRESSED);
+	keys.bind('T', TOGGLE_TIMINGS, InputMap::PRESSED);
+	keys.bind('Z', CYCLE_FRAME_CAP, InputMap::PRESSED);
+	keys.bind('E', CYCLE_SYNC, InputMap::PRESSED);
+	keys.bind('M', TOGGLE_DEFERRED, InputMap::PRESSED);
+	keys.bind('I', TOGGLE_GPU_CULLING, InputMap::PRESSED);
+	keys.bind('B', TOGGLE_BOUNDS, InputMap::PRESSED);
+	keys.bind('P', TOGGLE_SKY, InputMap::PRESSED);
+	keys.bind('U', TOGGLE_DAY_NIGHT, InputMap::PRESSED);
+	keys.bind('K', BENCHMARK, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_TAB, TOGGLE_FACADES, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_INSERT, ADD_BUILDING, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_DELETE, REMOVE_BUILDING, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_PAGE_UP, RAISE_BUILDING, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_PAGE_DOWN, LOWER_BUILDING, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_END, BENCHMARK_EDITS, InputMap::PRESSED);
+	keys.bind(GLFW_KEY_HOME, SAVE_CITY, InputMap::PRESSED);
+  }
+
+  void initTimers(){
+	cityTimer = GPUTimer("City pass");
+	shadowTimer = GPUTimer("Shadow pass");
+	skyboxTimer = GPUTimer("Skybox pass");
+	showTimings = false;
+	lastFrameTime = glfwGetTime();
+	frameTimeTotal = 0.0;
+	frameCount = 0;
+	frameCapSetting = 0;
+	syncSetting = 0;
+  }
+
+  static int frameCaps(int setting){
+	const int caps[] = {0, 30, 60, 144};
+	return caps[setting % 4];
+  }
+
+  static syncmode_t syncModes(int setting){
+	const syncmode_t modes[] = {VSYNC, ASYNC, ADAPTIVE};
+	return modes[setting % 3];
+  }
+
+  //Prints the average frame and city pass times once the GPU timer has a full window
+  void reportTimings(){
+	double now = glfwGetTime();
+	frameTimeTotal += now - lastFrameTime;
+	frameCount++;
+	lastFrameTime = now;
+	if(showTimings && cityTimer.report()){
+		const char* filters[] = {"nearest", "trilinear", "anisotropic"};
+		printf("Frame: %.3f ms CPU (building textures: %s, %s shading)\n",
+			1000.0 * frameTimeTotal / frameCount, filters[buildingFilter], deferredShading ? "deferred" : "forward");
+		shadowTimer.report();
+		skyboxTimer.report();
+		shadows->report();
+		lights->report();
+		city->reportMesh();
+		if(stream){
+			stream->report();
+		}
+		pacer().report();
+		frameTimeTotal = 0.0;
+		frameCount = 0;
+	}
+  }
+
+  /*Lamp counts of the forward vs. deferred sweep. Each count is measured
+  with both paths, one GPU timer window each after a window to settle*/
+  static int benchmarkLamps(int step){
+	const int counts[] = {0, 1000, 5000, 10000, 25000, 50000, 100000};
+	return counts[step / 2];
+  }
+
+  static int benchmarkSteps(){
+	return 7 * 2;
+  }
+
+  void startBenchmark(){
+	benchmarkStep = 0;
+	benchmarkMs.assign(benchmarkSteps(), 0.0);
+	setBenchmarkStep();
+	printf("Measuring forward and deferred shading, keep the camera still...\n");
+  }
+
+  void setBenchmarkStep(){
+	lights->setLights(city->streetLamps(benchmarkLamps(benchmarkStep)));
+	deferredShading = benchmarkStep % 2 == 1;
+	benchmarkWarmedUp = false;
+	cityTimer.reset();
+  }
+
+  //Called every frame while a sweep runs, advances it whenever the city timer has a new window
+  void stepBenchmark(){
+	if(benchmarkStep < 0 || !cityTimer.report()){
+		return;
+	}
+	if(!benchmarkWarmedUp){
+		//The first window still holds frames from the previous setting
+		benchmarkWarmedUp = true;
+		return;
+	}
+	benchmarkMs[benchmarkStep] = cityTimer.averageMs();
+	benchmarkStep++;
+	if(benchmarkStep < benchmarkSteps()){
+		setBenchmarkStep();
+		return;
+	}
+	printf("%10s %12s %12s\n", "Lamps", "Forward ms", "Deferred ms");
+	int crossover = -1;
+	for(int i = 0; i < benchmarkSteps(); i += 2){
+		printf("%10d %12.3f %12.3f\n", benchmarkLamps(i), benchmarkMs[i], benchmarkMs[i + 1]);
+		if(crossover < 0 && benchmarkMs[i + 1] < benchmarkMs[i]){
+			crossover = benchmarkLamps(i);
+		}
+	}
+	if(crossover < 0){
+		printf("Forward shading was faster at every lamp count.\n");
+	}else{
+		printf("Deferred shading is faster from %d lamps.\n", crossover);
+	}
+	benchmarkStep = -1;
+	deferredShading = false;
+	lights->setLights(city->streetLamps(lampCounts(lampSetting)));
   }
 
   bool begin(){
@@ -127,9 +419,18 @@ public:
 	initLights();
 	initShaders();
 	initWorld();
+	initSky();
+	initShadows();
+	initPointLights();
+	initStream();
+	initDeferred();
+	uploadMaterials();
+	initTimers();
+	initInput();
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	//LEQUAL so the skybox, drawn last at exactly the far plane, fills whatever is still clear
+	glDepthFunc(GL_LEQUAL);
 	msglVersion();    
 	return !msglError();
   }
@@ -143,79 +444,301 @@ public:
 	glUniformMatrix4fv(uModelViewMatrix_A, 1, false, glm::value_ptr(modelViewMatrix));    
 	glUniformMatrix4fv(uProjectionMatrix_A, 1, false, glm::value_ptr(projectionMatrix));
 	glUniformMatrix4fv(uNormalMatrix_A, 1, false, glm::value_ptr(normalMatrix));
-	glUniform4fv(uLight0_position_A, 1, glm::value_ptr(_light0));
-	glUniform4fv(uLight0_color_A, 1, glm::value_ptr(light0.color()));
+	std::tuple<int, int> w = windowSize();
+	lighting_A.activate(_light0, light0.color(), shadows, shadowsEnabled, lights, std::get<0>(w), std::get<1>(w));
   }
 
   void activateUniforms_B(){
-	glUniformMatrix4fv(uModelViewMatrix_B, 1, false, glm::value_ptr(modelViewMatrix_B));
-	//Projection matricies are the same for the skybox and the city
-	glUniformMatrix4fv(uProjectionMatrix_B, 1, false, glm::value_ptr(projectionMatrix));
+	glUniformMatrix4fv(uInverseViewProjection_B, 1, false, glm::value_ptr(inverseViewProjection_B));
+  }
+
+  /*Everything that moves happens here, in fixed steps of dt seconds
+  (see GLFWApp::operator()), so speeds don't depend on the frame rate*/
+  bool update(double dt){
+	camera.saveState();
+	dayNight.update(dt, light0, sky);
+
+	InputMap::actions_t actions = input().actions();
+	if(actions[QUIT]){
+		end();
+	}
+	if(actions[RESET]){
+		initLights();
+		initCamera();
+		printf("Lights and camera reinitialized.\n");
+	}
+	//Every held movement applies, so moving forward while strafing works
+	if(actions[PAN_LEFT]){
+		camera.panCameraLeft(dt);
+	}
+	if(actions[PAN_RIGHT]){
+		camera.panCameraRight(dt);
+	}
+	if(actions[FORWARD]){
+		camera.moveForwards(dt);
+	}
+	if(actions[BACKWARD]){
+		camera.moveBackwards(dt);
+	}
+	if(actions[ASCEND]){
+		camera.ascend(dt);
+	}
+	if(actions[DESCEND]){
+		camera.descend(dt);
+	}
+	if(actions[STRAFE_LEFT]){
+		camera.sideStepLeft(dt);
+	}
+	if(actions[STRAFE_RIGHT]){
+		camera.sideStepRight(dt);
+	}
+	if(actions[LOOK_UP]){
+		camera.rotateCameraUp(dt);
+	}
+	if(actions[LOOK_DOWN]){
+		camera.rotateCameraDown(dt);
+	}
+	//Mouse-look while the left button is held
+	if(mouseButtonFlags() & MOUSE_BUTTON_LEFT){
+		const float radiansPerPixel = 0.003f;
+		camera.look(-input().motionX() * radiansPerPixel, -input().motionY() * radiansPerPixel);
+	}
+	if(actions[SUN_UP]){
+		light0.rotateUp(dt);
+	}
+	if(actions[SUN_DOWN]){
+		light0.rotateDown(dt);
+	}
+	if(actions[SUN_LEFT]){
+		light0.rotateLeft(dt);
+	}
+	if(actions[SUN_RIGHT]){
+		light0.rotateRight(dt);
+	}
+	if(actions[CYCLE_FILTER]){
+		//Cycle nearest -> trilinear -> anisotropic to compare their cost
+		buildingFilter = Texture::filter_t((buildingFilter + 1) % 3);
+		city->setTextureFilter(buildingFilter);
+	}
+	if(actions[REGENERATE]){
+		city->regenerate();
+		uploadMaterials();
+		shadows->invalidate();
+		lights->setLights(city->streetLamps(lampCounts(lampSetting)));
+		printf("City regenerated.\n");
+	}
+	if(actions[REPORT_TEXTURES]){
+		city->reportTextures();
+	}
+	if(actions[TOGGLE_SHADOWS]){
+		shadowsEnabled = !shadowsEnabled;
+		shadows->invalidate();
+	}
+	if(actions[CYCLE_LAMPS]){
+		lampSetting++;
+		lights->setLights(city->streetLamps(lampCounts(lampSetting)));
+		printf("%zu street lamps.\n", lights->lightCount());
+	}
+	if(actions[TOGGLE_TIMINGS]){
+		showTimings = !showTimings;
+		cityTimer.reset();
+		pacer().reset();
+		frameTimeTotal = 0.0;
+		frameCount = 0;
+	}
+	if(actions[CYCLE_FRAME_CAP]){
+		frameCapSetting++;
+		pacer().targetFps(frameCaps(frameCapSetting));
+		printf("Frame rate cap: %d fps (0 is none).\n", frameCaps(frameCapSetting));
+	}
+	if(actions[CYCLE_SYNC]){
+		const char* names[] = {"vsync", "no sync", "adaptive sync"};
+		syncSetting++;
+		sync(syncModes(syncSetting));
+		printf("Swapping with %s.\n", names[syncSetting % 3]);
+	}
+	if(actions[TOGGLE_DEFERRED]){
+		deferredShading = !deferredShading;
+		cityTimer.reset();
+		printf("%s shading.\n", deferredShading ? "Deferred" : "Forward");
+	}
+	if(actions[TOGGLE_GPU_CULLING]){
+		gpuCulling = !gpuCulling;
+		bool onGpu = city->setGpuDriven(gpuCulling);
+		cityTimer.reset();
+		printf("Buildings culled and drawn %s.\n", onGpu ? "on the GPU (multi-draw-indirect)" : "on the CPU");
+	}
+	if(actions[TOGGLE_BOUNDS]){
+		showBounds = !showBounds;
+	}
+	if(actions[TOGGLE_SKY]){
+		proceduralSky = !proceduralSky;
+	}
+	if(actions[TOGGLE_FACADES]){
+		proceduralFacades = !proceduralFacades;
+		city->setProceduralFacades(proceduralFacades);
+		if(!proceduralFacades){
+			city->setTextureFilter(buildingFilter);//The facade array was loaded again with the default filter
+		}
+		shaderProgram_A.activate();
+		glUniform1i(uProceduralFacades_A, proceduralFacades);
+		deferred->setProceduralFacades(proceduralFacades);
+		cityTimer.reset();
+		printf("%s facades, textures now use %.1f MB.\n", proceduralFacades ? "Procedural" : "Textured",
+			city->textureBytes() / 1048576.0);
+	}
+	if(actions[TOGGLE_DAY_NIGHT]){
+		dayNight.toggle();
+		printf("Day/night cycle %s at %.2f of the day.\n", dayNight.isRunning() ? "running" : "paused", dayNight.timeOfDay());
+	}
+	if(actions[BENCHMARK] && benchmarkStep < 0){
+		startBenchmark();
+	}
+	if(actions[ADD_BUILDING]){
+		addBuilding();
+	}
+	if(actions[REMOVE_BUILDING]){
+		int id = city->pick(camera.getPosition(), camera.getForward(), 1000.0f);
+		if(city->removeBuilding(id)){
+			shadows->invalidate();
+			printf("Building %d removed.\n", id);
+		}
+	}
+	if(actions[RAISE_BUILDING]){
+		resizeBuilding(1.0f);
+	}
+	if(actions[LOWER_BUILDING]){
+		resizeBuilding(-1.0f);
+	}
+	if(actions[BENCHMARK_EDITS]){
+		city->benchmarkEdits();
+	}
+	if(actions[SAVE_CITY]){
+		if(city->save(savedCity())){
+			printf("City saved to %s (open it with: hello_city %s).\n", savedCity(), savedCity());
+		}else{
+			printf("Could not write %s.\n", savedCity());
+		}
+	}
+	return true;
+  }
+
+  static const char* savedCity(){
+	return "saved" CITY_FILE_EXTENSION;
+  }
+
+  //Puts a building where the middle of the view meets the ground, on the 2 unit grid the city uses
+  void addBuilding(){
+	glm::vec3 eye = camera.getPosition();
+	glm::vec3 forward = camera.getForward();
+	if(forward.y >= 0.0f || eye.y <= 0.0f){
+		printf("Look down at the ground to add a building.\n");
+		return;
+	}
+	glm::vec3 ground = eye - forward * (eye.y / forward.y);
+	BuildingSpec spec;
+	spec.x = 2.0f * floor(ground.x * 0.5f + 0.5f);
+	spec.z = 2.0f * floor(ground.z * 0.5f + 0.5f);
+	spec.size = 1.0f;
+	spec.height = rand() % 5 + 1;
+	spec.layer = rand() % 2;
+	spec.shape = 0;
+	int id = city->addBuilding(spec);
+	if(id < 0){
+		printf("The ground there is too far away to add a building.\n");
+		return;
+	}
+	shadows->invalidate();
+	printf("Building %d added at (%.0f, %.0f).\n", id, spec.x, spec.z);
+  }
+
+  //Makes the building in the middle of the view taller or shorter
+  void resizeBuilding(float change){
+	int id = city->pick(camera.getPosition(), camera.getForward(), 1000.0f);
+	BuildingSpec spec;
+	if(!city->building(id, spec)){
+		return;
+	}
+	spec.height = std::max(1.0f, spec.height + change);
+	city->modifyBuilding(id, spec);
+	shadows->invalidate();
   }
 
   bool render(){
 	glm::vec4 _light0;//This will be the new transformed light position
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+	//The camera part way between the last two update steps, so motion stays smooth
+	glm::mat4 view = camera.getViewMatrix(interpolation());
 	std::tuple<int, int> w = windowSize();
 	double ratio = double(std::get<0>(w))/double(std::get<1>(w));
 	projectionMatrix = glm::perspective(double(camera.getFovy()), ratio, 0.1, 1000.0);
+	if(stream){
+		stream->beginFrame();
+	}
+
+	/*Bring the shadow cascades up to date first. Only cascades whose
+	cache is stale are re-rendered, usually none of them*/
+	if(shadowsEnabled){
+		shadowTimer.begin();
+		shadows->update(view, camera.getFovy(), ratio, 0.1f,
+			light0.center() - glm::vec3(light0.position()),
+			city->boundsMin(), city->boundsMax(), city);
+		shadowTimer.end();
+		glViewport(0, 0, std::get<0>(w), std::get<1>(w));
+	}
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	//Bin the point lights into this frame's clusters
+	lights->update(view, camera.getFovy(), ratio, 0.1f);
 
 	/*Position the light.
 	Just multiply the light position by the viewMatrix since 
 	it's modelMatrix is untransformed anyway (view * (model = 1) * lightPos)*/
-	_light0 = camera.getViewMatrix() * light0.position();
+	_light0 = view * light0.position();
 
 	glm::mat4 model = glm::mat4();//Load the Identity matrix
-	modelViewMatrix = camera.getViewMatrix() * model;
+	modelViewMatrix = view * model;
 	normalMatrix = glm::inverseTranspose(modelViewMatrix);
-	shaderProgram_A.activate();
-	activateUniforms_A(_light0);
-	city->drawLevel();
-
-	//Remove translation from the view matrix so that the skybox won't translate
-	modelViewMatrix_B = glm::mat4(glm::mat3(camera.getViewMatrix()));
-	shaderProgram_B.activate();
-	activateUniforms_B();
-	city->drawSkybox();
+	cityTimer.begin();
+	if(deferredShading){
+		deferred->geometryPass(city, modelViewMatrix, projectionMatrix, normalMatrix, std::get<0>(w), std::get<1>(w));
+		deferred->lightingPass(view, projectionMatrix, _light0, light0.color(),
+			shadows, shadowsEnabled, lights);
+	}else{
+		shaderProgram_A.activate();
+		activateUniforms_A(_light0);
+		city->drawLevel(Frustum(projectionMatrix * modelViewMatrix));
+	}
+	cityTimer.end();
 
-	if(isKeyPressed('Q')){
-		end();      
-	}else if(isKeyPressed('R')){
-		initLights();
-		initCamera();
-		printf("Lights and camera reinitialized.\n");
-	}else if(isKeyPressed(GLFW_KEY_LEFT)){
-		camera.panCameraLeft();
-	}else if(isKeyPressed(GLFW_KEY_RIGHT)){
-		camera.panCameraRight();
-	}else if(isKeyPressed(GLFW_KEY_UP)){
-		camera.moveForwards();
-	}else if(isKeyPressed(GLFW_KEY_DOWN)){
-		camera.moveBackwards();
-	}else if(isKeyPressed('W')){
-		camera.ascend();
-	}else if(isKeyPressed('S')){
-		camera.descend();
-	}else if(isKeyPressed('A')){
-		camera.sideStepLeft();
-	}else if(isKeyPressed('D')){
-		camera.sideStepRight();
-	}else if(isKeyPressed('X')){
-		camera.rotateCameraUp();
-	}else if(isKeyPressed('Y')){
-		camera.rotateCameraDown();
-	}else if(isKeyPressed('H')){
-		light0.rotateUp();
-	}else if(isKeyPressed('G')){
-		light0.rotateDown();
-	}else if(isKeyPressed('J')){
-		light0.rotateLeft();
-	}else if(isKeyPressed('N')){
-		light0.rotateRight();
+	/*Remove translation from the view matrix so that the skybox won't translate.
+	Projection matricies are the same for the skybox and the city*/
+	inverseViewProjection_B = glm::inverse(projectionMatrix * glm::mat4(glm::mat3(view)));
+	skyboxTimer.begin();
+	if(proceduralSky){
+		/*While the cycle is paused the sky follows light0, which
+		can then be moved by hand with H, G, J and N*/
+		glm::vec3 sun = dayNight.isRunning() ? dayNight.sunDirection() : glm::vec3(light0.position()) - light0.center();
+		sky->draw(inverseViewProjection_B, sun);
+	}else{
+		shaderProgram_B.activate();
+		activateUniforms_B();
+		city->drawSkybox();
+	}
+	skyboxTimer.end();
+	if(showBounds){
+		city->addBounds(Frustum(projectionMatrix * view), *debugLines);
+		debugLines->draw(projectionMatrix * view, stream);
+	}
+	if(stream){
+		stream->endFrame();
+	}
+	if(benchmarkStep >= 0){
+		stepBenchmark();
+	}else{
+		reportTimings();
 	}
 	return !msglError();
-  }   
+  }
 };
 
 int main(int argc, char* argv[]){
@@ -0,0 +1,1103 @@
+/*
+Name: David Tu
+Email: david.tu2@csu.fullerton.edu
+
+Class: CPSC 486-02
+Assignment: Final Project
+Desciption: Imports real building footprints and heights from a local
+GeoJSON or OpenStreetMap XML extract into a .city file (see CityFile.h),
+which hello_city opens like any saved city and draws and culls like a
+generated one.
+
+Usage: import_city buildings.geojson city.city [metres per unit]
+       import_city buildings.osm city.city [metres per unit]
+
+GeoJSON: a FeatureCollection; every Polygon or MultiPolygon feature is a
+building. OSM: every closed way tagged building. The height is taken
+from a height property or tag, else building:levels (3 m a level), else
+3 levels. Coordinates are projected onto a plane touching the earth at
+the first point in the file, then shifted so the city starts at the
+origin like the generated one. A unit of the city is 8 m by default
+(a 12 unit block is about a real city block).
+
+Each footprint is rasterized into cells and covered with the largest
+square, axis aligned boxes that fit inside it; holes and separate parts
+of a footprint are left open. The file can also hold turned and L shaped
+buildings (see Building::makeShape), which would fit many footprints in
+one building each, but the importer doesn't try them yet, so a footprint
+can take many boxes.
+
+The input is memory mapped and never parsed as a whole: the main thread
+cuts it into chunks of whole features (or elements), a few MB each, and
+one worker a core parses each chunk in place and turns its footprints
+into boxes. Pages of the input are let go once their chunk is done, and
+the boxes go on to a temporary file, so memory holds a few chunks, not
+the input or the boxes. The city file is then written a band of
+buildings at a time from that file (see writeCity()). OSM ways
+only name their nodes, so the file is read three times: for the nodes
+that building ways use, for those nodes' positions, and for the ways.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <sys/resource.h>
+
+#include "CityFile.h"
+
+enum{
+  CHUNK_BYTES = 4 << 20,
+  CHUNKS_PER_THREAD = 2,//Cut ahead of the workers
+  MAX_CELLS = 256,//Across a footprint; bigger ones get bigger cells
+  SPILL_BOXES = 1 << 16,//Read back from the spill file at a time
+  BAND_BUILDINGS = 1 << 20//Buildings of the city file made at a time, 44 MB of columns
+};
+
+static const double EARTH_RADIUS = 6371008.8;//Metres
+static const double METRES_PER_LEVEL = 3.0;
+static const double DEFAULT_LEVELS = 3.0;
+static const double DEFAULT_METRES_PER_UNIT = 8.0;
+static const double CELLS_PER_UNIT = 2.0;
+static const float BLOCK_SIZE = 12.0f;//Blocks of the file, as Plane::save() makes them
+
+static double seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Metres east and north of the first point
+struct Point{
+  float x;
+  float y;
+};
+
+//A box in metres
+struct Box{
+  float x;
+  float y;
+  float size;//Half the width
+  float height;
+};
+
+//Equirectangular, which is close enough over a city
+struct Projection{
+  double lon0;
+  double lat0;
+  double metresPerDegreeX;
+  double metresPerDegreeY;
+
+  void setOrigin(double lon, double lat){
+    lon0 = lon;
+    lat0 = lat;
+    metresPerDegreeY = EARTH_RADIUS * M_PI / 180.0;
+    metresPerDegreeX = metresPerDegreeY * cos(lat * M_PI / 180.0);
+  }
+
+  Point operator()(double lon, double lat) const{
+    Point p = {float((lon - lon0) * metresPerDegreeX), float((lat - lat0) * metresPerDegreeY)};
+    return p;
+  }
+};
+
+//A range of the input
+struct Chunk{
+  const char* begin;
+  const char* end;
+};
+
+//One thread's working memory, kept from footprint to footprint
+struct Scratch{
+  std::vector<std::vector<Point> > rings;
+  size_t ringCount;
+  bool ringOpen;
+  std::vector<float> crossings;
+  std::vector<unsigned char> cells;//1 inside, 2 covered by a box
+  std::vector<int64_t> refs;//OSM nodes of a way
+
+  Scratch(): ringCount(0), ringOpen(false){}
+
+  void clear(){
+    ringCount = 0;
+    ringOpen = false;
+  }
+
+  void add(const Point& p){
+    if(!ringOpen){
+      if(rings.size() <= ringCount){
+        rings.resize(ringCount + 1);
+      }
+      rings[ringCount].clear();
+      ringOpen = true;
+    }
+    rings[ringCount].push_back(p);
+  }
+
+  //Keeps the ring just added if it has an inside
+  void closeRing(){
+    if(ringOpen && rings[ringCount].size() >= 3){
+      ringCount++;
+    }
+    ringOpen = false;
+  }
+};
+
+/*Covers a footprint (the rings in scratch, inside by the even-odd rule)
+with square boxes: rasterizes it at cell centres, then from each cell
+not yet covered grows the largest square of uncovered inside cells*/
+void extrude(Scratch& scratch, double cell, float height, std::vector<Box>& boxes){
+  if(scratch.ringCount == 0){
+    return;
+  }
+  Point low = scratch.rings[0][0], high = low;
+  double area = 0.0, cx = 0.0, cy = 0.0;
+  for(size_t r = 0; r < scratch.ringCount; r++){
+    const std::vector<Point>& ring = scratch.rings[r];
+    for(size_t i = 0; i < ring.size(); i++){
+      low.x = std::min(low.x, ring[i].x);
+      low.y = std::min(low.y, ring[i].y);
+      high.x = std::max(high.x, ring[i].x);
+      high.y = std::max(high.y, ring[i].y);
+      const Point& next = ring[(i + 1) % ring.size()];
+      double cross = double(ring[i].x) * next.y - double(next.x) * ring[i].y;
+      area += cross;
+      cx += (ring[i].x + next.x) * cross;
+      cy += (ring[i].y + next.y) * cross;
+    }
+  }
+  cell = std::max(cell, std::max(high.x - low.x, high.y - low.y) / double(MAX_CELLS));
+  int columns = std::max(1, int(ceil((high.x - low.x) / cell)));
+  int rows = std::max(1, int(ceil((high.y - low.y) / cell)));
+  scratch.cells.assign(columns * rows, 0);
+  int inside = 0;
+  for(int j = 0; j < rows; j++){
+    //Where the edges cross the row through the cell centres
+    float y = low.y + (j + 0.5) * cell;
+    scratch.crossings.clear();
+    for(size_t r = 0; r < scratch.ringCount; r++){
+      const std::vector<Point>& ring = scratch.rings[r];
+      for(size_t i = 0; i < ring.size(); i++){
+        const Point& a = ring[i];
+        const Point& b = ring[(i + 1) % ring.size()];
+        if((a.y <= y) != (b.y <= y)){
+          scratch.crossings.push_back(a.x + (y - a.y) / (b.y - a.y) * (b.x - a.x));
+        }
+      }
+    }
+    std::sort(scratch.crossings.begin(), scratch.crossings.end());
+    for(size_t c = 0; c + 1 < scratch.crossings.size(); c += 2){
+      int first = std::max(0, int(ceil((scratch.crossings[c] - low.x) / cell - 0.5)));
+      int last = std::min(columns - 1, int(floor((scratch.crossings[c + 1] - low.x) / cell - 0.5)));
+      for(int i = first; i <= last; i++){
+        scratch.cells[i + j * columns] = 1;
+        inside++;
+      }
+    }
+  }
+  if(inside == 0){
+    //Smaller than a cell: one box of the same area, at the centroid
+    area *= 0.5;
+    if(fabs(area) < 1e-6){
+      return;
+    }
+    Box box = {float(cx / (6.0 * area)), float(cy / (6.0 * area)), float(sqrt(fabs(area)) * 0.5), height};
+    if(box.x < low.x || box.x > high.x || box.y < low.y || box.y > high.y){
+      box.x = (low.x + high.x) * 0.5f;//Holes wound the same way as the outside
+      box.y = (low.y + high.y) * 0.5f;
+    }
+    boxes.push_back(box);
+    return;
+  }
+  unsigned char* cells = &scratch.cells[0];
+  for(int j = 0; j < rows; j++){
+    for(int i = 0; i < columns; i++){
+      if(cells[i + j * columns] != 1){
+        continue;
+      }
+      //Grow while the next row and column of the square are free
+      int size = 1;
+      for(bool grows = true; grows && i + size < columns && j + size < rows; ){
+        for(int k = 0; grows && k <= size; k++){
+          grows = cells[i + size + (j + k) * columns] == 1 && cells[i + k + (j + size) * columns] == 1;
+        }
+        size += grows;
+      }
+      for(int b = j; b < j + size; b++){
+        memset(cells + i + b * columns, 2, size);
+      }
+      Box box = {float(low.x + (i + size * 0.5) * cell), float(low.y + (j + size * 0.5) * cell), float(size * cell * 0.5), height};
+      boxes.push_back(box);
+    }
+  }
+}
+
+//Heights given as numbers or as text such as "12 m"
+double heightOf(double height, double levels){
+  if(height > 0.0){
+    return height;
+  }
+  return (levels > 0.0 ? levels : DEFAULT_LEVELS) * METRES_PER_LEVEL;
+}
+
+/*Reads JSON in place, only as far as asked. Anything not wanted is
+skipped over without being stored*/
+class JsonReader{
+public:
+  JsonReader(const char* begin, const char* end): _p(begin), _end(end), _ok(true){}
+
+  bool ok() const{
+    return _ok;
+  }
+
+  const char* position() const{
+    return _p;
+  }
+
+  char peek(){
+    space();
+    return _p < _end ? *_p : 0;
+  }
+
+  //Takes c if it is next
+  bool take(char c){
+    if(peek() == c){
+      _p++;
+      return true;
+    }
+    return false;
+  }
+
+  bool expect(char c){
+    if(!take(c)){
+      _ok = false;
+    }
+    return _ok;
+  }
+
+  //A string, escapes left in; [begin, end) is inside the quotes
+  bool string(const char*& begin, const char*& end){
+    begin = end = _p;
+    if(!expect('"')){
+      return false;
+    }
+    begin = _p;
+    while(_p < _end && *_p != '"'){
+      _p += *_p == '\\' ? 2 : 1;
+    }
+    end = std::min(_p, _end);
+    _ok = _p < _end;
+    _p++;
+    return _ok;
+  }
+
+  bool isString(const char* begin, const char* end, const char* text){
+    return size_t(end - begin) == strlen(text) && memcmp(begin, text, end - begin) == 0;
+  }
+
+  //A number, or a string holding one; 0 for anything else, which is skipped
+  double number(){
+    char c = peek();
+    if(c == '"'){
+      const char* begin;
+      const char* end;
+      string(begin, end);
+      return parse(begin, end);
+    }
+    if(c == '-' || (c >= '0' && c <= '9')){
+      const char* begin = _p;
+      while(_p < _end && *_p && strchr("+-.0123456789eE", *_p)){
+        _p++;
+      }
+      return parse(begin, _p);
+    }
+    skip();
+    return 0.0;
+  }
+
+  //Skips a whole value of any kind
+  void skip(){
+    char c = peek();
+    if(c == '"'){
+      const char* begin;
+      const char* end;
+      string(begin, end);
+    }else if(c == '{' || c == '['){
+      int depth = 0;
+      do{
+        if(*_p == '"'){
+          const char* begin;
+          const char* end;
+          string(begin, end);
+          continue;
+        }
+        depth += (*_p == '{' || *_p == '[') - (*_p == '}' || *_p == ']');
+        _p++;
+      }while(_ok && depth > 0 && _p < _end);
+      _ok = _ok && depth == 0;
+    }else{
+      //true, false, null or a number
+      while(_p < _end && !strchr(",}] \t\r\n", *_p)){
+        _p++;
+      }
+    }
+  }
+
+private:
+  const char* _p;
+  const char* _end;
+  bool _ok;
+
+  void space(){
+    while(_p < _end && (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t')){
+      _p++;
+    }
+  }
+
+  static double parse(const char* begin, const char* end){
+    char text[64];
+    size_t length = std::min<size_t>(end - begin, sizeof(text) - 1);
+    memcpy(text, begin, length);
+    text[length] = 0;
+    return atof(text);
+  }
+};
+
+/*GeoJSON coordinates at any depth. Positions go into the current ring
+and every array of positions is a ring. Returns how deep the array was
+(1 for a position), or 0 if it couldn't be read*/
+int readCoordinates(JsonReader& json, const Projection& projection, Scratch& scratch){
+  if(!json.expect('[')){
+    return 0;
+  }
+  char c = json.peek();
+  if(c == '-' || (c >= '0' && c <= '9')){
+    double lon = json.number();
+    double lat = json.expect(',') ? json.number() : 0.0;
+    while(json.take(',')){
+      json.number();//Altitude
+    }
+    scratch.add(projection(lon, lat));
+    return json.expect(']') ? 1 : 0;
+  }
+  int depth = 2;
+  for(bool first = true; json.ok() && !json.take(']'); first = false){
+    if(!first && !json.expect(',')){
+      return 0;
+    }
+    depth = readCoordinates(json, projection, scratch) + 1;
+  }
+  if(depth == 2){
+    scratch.closeRing();
+  }
+  return json.ok() ? depth : 0;
+}
+
+//A GeoJSON Feature. Returns false, leaving no rings, if it isn't a polygon
+bool readFeature(JsonReader& json, const Projection& projection, Scratch& scratch, double& height){
+  scratch.clear();
+  double metres = 0.0, levels = 0.0;
+  bool polygon = false;
+  if(!json.expect('{')){
+    return false;
+  }
+  for(bool first = true; json.ok() && !json.take('}'); first = false){
+    const char* key;
+    const char* keyEnd;
+    if((!first && !json.expect(',')) || !json.string(key, keyEnd) || !json.expect(':')){
+      return false;
+    }
+    if(json.isString(key, keyEnd, "geometry") && json.peek() == '{'){
+      json.take('{');
+      for(bool firstKey = true; json.ok() && !json.take('}'); firstKey = false){
+        const char* name;
+        const char* nameEnd;
+        if((!firstKey && !json.expect(',')) || !json.string(name, nameEnd) || !json.expect(':')){
+          return false;
+        }
+        if(json.isString(name, nameEnd, "coordinates")){
+          readCoordinates(json, projection, scratch);
+        }else if(json.isString(name, nameEnd, "type") && json.peek() == '"'){
+          const char* type;
+          const char* typeEnd;
+          json.string(type, typeEnd);
+          polygon = json.isString(type, typeEnd, "Polygon") || json.isString(type, typeEnd, "MultiPolygon");
+        }else{
+          json.skip();
+        }
+      }
+    }else if(json.isString(key, keyEnd, "properties") && json.peek() == '{'){
+      json.take('{');
+      for(bool firstKey = true; json.ok() && !json.take('}'); firstKey = false){
+        const char* name;
+        const char* nameEnd;
+        if((!firstKey && !json.expect(',')) || !json.string(name, nameEnd) || !json.expect(':')){
+          return false;
+        }
+        if(json.isString(name, nameEnd, "height")){
+          metres = json.number();
+        }else if(json.isString(name, nameEnd, "building:levels") || json.isString(name, nameEnd, "levels")){
+          levels = json.number();
+        }else{
+          json.skip();
+        }
+      }
+    }else{
+      json.skip();
+    }
+  }
+  if(!polygon || !json.ok()){
+    scratch.clear();
+    return false;
+  }
+  height = heightOf(metres, levels);
+  return true;
+}
+
+/*One XML element's start tag, read in place: its name and the
+attributes wanted, up to the > that ends it*/
+struct XmlTag{
+  const char* name;
+  size_t nameLength;
+  bool closing;//</name>
+  bool empty;//<name/>
+
+  bool is(const char* text) const{
+    return nameLength == strlen(text) && memcmp(name, text, nameLength) == 0;
+  }
+};
+
+//Finds the next tag from p, returning where it ends, or NULL if there is none
+const char* nextTag(const char* p, const char* end, XmlTag& tag){
+  for(;;){
+    p = (const char*)memchr(p, '<', end - p);
+    if(!p || p + 1 >= end){
+      return NULL;
+    }
+    p++;
+    if(*p == '?' || *p == '!'){
+      continue;//Declaration or comment
+    }
+    tag.closing = *p == '/';
+    p += tag.closing;
+    tag.name = p;
+    while(p < end && !strchr(" \t\r\n/>", *p)){
+      p++;
+    }
+    tag.nameLength = p - tag.name;
+    //The end of the tag; attribute values can't hold a >
+    const char* close = (const char*)memchr(p, '>', end - p);
+    if(!close){
+      return NULL;
+    }
+    tag.empty = close[-1] == '/';
+    return close + 1;
+  }
+}
+
+//The value of an attribute of the tag starting at name and ending before end, or NULL
+const char* attribute(const char* p, const char* end, const char* name, const char*& valueEnd){
+  size_t length = strlen(name);
+  while(p < end){
+    while(p < end && !strchr(" \t\r\n", *p)){
+      p++;
+    }
+    while(p < end && strchr(" \t\r\n", *p)){
+      p++;
+    }
+    const char* key = p;
+    while(p < end && *p != '=' && !strchr(" \t\r\n/>", *p)){
+      p++;
+    }
+    if(p >= end || *p != '=' || p + 1 >= end){
+      return NULL;
+    }
+    char quote = p[1];
+    const char* value = p + 2;
+    valueEnd = (const char*)memchr(value, quote, end - value);
+    if(!valueEnd){
+      return NULL;
+    }
+    if(size_t(p - key) == length && memcmp(key, name, length) == 0){
+      return value;
+    }
+    p = valueEnd + 1;
+  }
+  return NULL;
+}
+
+double numberAttribute(const char* tag, const char* end, const char* name){
+  const char* valueEnd;
+  const char* value = attribute(tag, end, name, valueEnd);
+  if(!value){
+    return 0.0;
+  }
+  char text[64];
+  size_t length = std::min<size_t>(valueEnd - value, sizeof(text) - 1);
+  memcpy(text, value, length);
+  text[length] = 0;
+  return atof(text);
+}
+
+int64_t idAttribute(const char* tag, const char* end, const char* name){
+  const char* valueEnd;
+  const char* value = attribute(tag, end, name, valueEnd);
+  return value ? strtoll(value, NULL, 10) : 0;
+}
+
+bool attributeIs(const char* tag, const char* end, const char* name, const char* text){
+  const char* valueEnd;
+  const char* value = attribute(tag, end, name, valueEnd);
+  return value && size_t(valueEnd - value) == strlen(text) && memcmp(value, text, valueEnd - value) == 0;
+}
+
+/*An OSM way starting after its start tag: its node refs, whether it is a
+building, and its height. Returns where it ends*/
+const char* readWay(const char* p, const char* end, Scratch& scratch, bool& building, double& height){
+  scratch.refs.clear();
+  building = false;
+  double metres = 0.0, levels = 0.0;
+  XmlTag tag;
+  const char* next;
+  while((next = nextTag(p, end, tag)) != NULL){
+    if(tag.closing && tag.is("way")){
+      height = heightOf(metres, levels);
+      return next;
+    }
+    if(tag.is("nd")){
+      scratch.refs.push_back(idAttribute(tag.name, next, "ref"));
+    }else if(tag.is("tag")){
+      if(attributeIs(tag.name, next, "k", "building")){
+        building = !attributeIs(tag.name, next, "v", "no");
+      }else if(attributeIs(tag.name, next, "k", "height")){
+        metres = numberAttribute(tag.name, next, "v");
+      }else if(attributeIs(tag.name, next, "k", "building:levels")){
+        levels = numberAttribute(tag.name, next, "v");
+      }
+    }
+    p = next;
+  }
+  return end;
+}
+
+/*Hands chunks to a worker a core as cut() makes them, a few ahead at most,
+and lets go of each chunk's pages once it has been worked on*/
+void forEachChunk(MappedFile& input, std::function<bool(Chunk&)> cut,
+  std::function<void(const Chunk&, size_t, Scratch&)> work){
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::deque<std::pair<Chunk, size_t> > queue;
+  std::mutex lock;
+  std::condition_variable changed;
+  bool done = false;
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < threads; t++){
+    workers.push_back(std::thread([&](){
+      Scratch scratch;
+      for(;;){
+        std::pair<Chunk, size_t> chunk;
+        {
+          std::unique_lock<std::mutex> wait(lock);
+          changed.wait(wait, [&](){ return !queue.empty() || done; });
+          if(queue.empty()){
+            return;
+          }
+          chunk = queue.front();
+          queue.pop_front();
+          changed.notify_all();
+        }
+        work(chunk.first, chunk.second, scratch);
+        input.release(chunk.first.begin - (const char*)input.data(), chunk.first.end - chunk.first.begin);
+      }
+    }));
+  }
+  Chunk chunk;
+  for(size_t number = 0; cut(chunk); number++){
+    std::unique_lock<std::mutex> wait(lock);
+    changed.wait(wait, [&](){ return queue.size() < threads * CHUNKS_PER_THREAD; });
+    queue.push_back(std::make_pair(chunk, number));
+    changed.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> finished(lock);
+    done = true;
+    changed.notify_all();
+  }
+  for(size_t t = 0; t < workers.size(); t++){
+    workers[t].join();
+  }
+}
+
+/*Reads footprints into boxes. As chunks finish their boxes are spilled
+to a temporary file in input order, so the city comes out the same
+however the work was shared, and only the chunks that finish early wait
+in memory for the ones before them*/
+class Importer{
+public:
+  Importer(const MappedFile& input, double metresPerUnit):
+    _begin((const char*)input.data()),
+    _end((const char*)input.data() + input.size()),
+    _cell(metresPerUnit / CELLS_PER_UNIT),
+    _footprints(0),
+    _skipped(0),
+    _spill(tmpfile()),
+    _spilled(0),
+    _spillOk(_spill != NULL),
+    _nextChunk(0){
+    low[0] = low[1] = 1e30f;
+    high[0] = high[1] = -1e30f;
+  }
+
+  ~Importer(){
+    if(_spill){
+      fclose(_spill);
+    }
+  }
+
+  //Box around every box spilled, in metres
+  float low[2];
+  float high[2];
+
+  size_t footprints() const{
+    return _footprints;
+  }
+
+  size_t boxes() const{
+    return _spilled;
+  }
+
+  //False if the spill file couldn't be made or written
+  bool spillOk() const{
+    return _spillOk;
+  }
+
+  /*Reads every spilled box back in order, a few at a time, calling
+  visit(box) for each. Can be called again for another pass*/
+  template<class Visit>
+  bool forEachBox(Visit visit){
+    std::vector<Box> boxes(SPILL_BOXES);
+    _spillOk = _spillOk && fflush(_spill) == 0 && fseeko(_spill, 0, SEEK_SET) == 0;
+    for(size_t left = _spilled; _spillOk && left; ){
+      size_t count = std::min<size_t>(left, SPILL_BOXES);
+      _spillOk = fread(&boxes[0], sizeof(Box), count, _spill) == count;
+      for(size_t i = 0; _spillOk && i < count; i++){
+        visit(boxes[i]);
+      }
+      left -= count;
+    }
+    return _spillOk;
+  }
+
+  size_t skipped() const{
+    return _skipped;
+  }
+
+  bool geoJson(MappedFile& input){
+    //The origin is the first position in the file
+    const char* coordinates = find(_begin, "\"coordinates\"");
+    if(!coordinates){
+      fprintf(stderr, "no coordinates found\n");
+      return false;
+    }
+    JsonReader origin(coordinates + 13, _end);
+    origin.expect(':');
+    while(origin.take('[')){}
+    double lon = origin.number();
+    origin.expect(',');
+    _projection.setOrigin(lon, origin.number());
+
+    //Features are found with the same reader, skipping over each one
+    JsonReader json(_begin, _end);
+    if(!json.expect('{')){
+      fprintf(stderr, "not a GeoJSON FeatureCollection\n");
+      return false;
+    }
+    bool found = false;
+    for(bool first = true; !found && json.ok() && !json.take('}'); first = false){
+      const char* key;
+      const char* keyEnd;
+      if((!first && !json.expect(',')) || !json.string(key, keyEnd) || !json.expect(':')){
+        break;
+      }
+      found = json.isString(key, keyEnd, "features") && json.take('[');
+      if(!found){
+        json.skip();
+      }
+    }
+    if(!found){
+      fprintf(stderr, "no features array found\n");
+      return false;
+    }
+    bool last = false;
+    forEachChunk(input, [&](Chunk& chunk){
+      chunk.begin = json.position();
+      while(!last && json.ok() && json.position() - chunk.begin < CHUNK_BYTES){
+        json.skip();
+        last = !json.take(',');
+      }
+      chunk.end = json.position();
+      return chunk.end > chunk.begin && json.ok();
+    }, [&](const Chunk& chunk, size_t number, Scratch& scratch){
+      JsonReader features(chunk.begin, chunk.end);
+      std::vector<Box> made;
+      size_t footprints = 0, skipped = 0;
+      for(features.take(','); features.ok() && features.peek() == '{'; features.take(',')){
+        double height;
+        if(readFeature(features, _projection, scratch, height)){
+          extrude(scratch, _cell, height, made);
+          footprints++;
+        }else{
+          skipped++;
+        }
+      }
+      keep(number, made, footprints, skipped);
+    });
+    if(!json.ok()){
+      fprintf(stderr, "GeoJSON can't be read past byte %zu\n", size_t(json.position() - _begin));
+    }
+    return json.ok();
+  }
+
+  bool osm(MappedFile& input){
+    const char* node = find(_begin, "<node");
+    if(!node){
+      fprintf(stderr, "no nodes found\n");
+      return false;
+    }
+    const char* nodeEnd = (const char*)memchr(node, '>', _end - node);
+    _projection.setOrigin(numberAttribute(node, nodeEnd, "lon"), numberAttribute(node, nodeEnd, "lat"));
+
+    //The nodes building ways use, and where the nodes and the ways are
+    std::vector<int64_t> needed;
+    std::mutex neededLock;
+    const char* lastNode = _begin;
+    const char* firstWay = _end;
+    const char* cursor = _begin;
+    forEachChunk(input, [&](Chunk& chunk){ return cutXml(cursor, chunk); },
+      [&](const Chunk& chunk, size_t, Scratch& scratch){
+      std::vector<int64_t> refs;
+      const char* chunkLastNode = _begin;
+      const char* chunkFirstWay = _end;
+      XmlTag tag;
+      for(const char* p = chunk.begin; (p = nextTag(p, chunk.end, tag)) != NULL; ){
+        if(tag.closing){
+          continue;
+        }
+        if(tag.is("node")){
+          chunkLastNode = p;
+        }else if(tag.is("way") && !tag.empty){
+          chunkFirstWay = std::min(chunkFirstWay, tag.name - 1);
+          bool building;
+          double height;
+          p = readWay(p, chunk.end, scratch, building, height);
+          if(building){
+            refs.insert(refs.end(), scratch.refs.begin(), scratch.refs.end());
+          }
+        }
+      }
+      std::lock_guard<std::mutex> merge(neededLock);
+      needed.insert(needed.end(), refs.begin(), refs.end());
+      lastNode = std::max(lastNode, chunkLastNode);
+      firstWay = std::min(firstWay, chunkFirstWay);
+    });
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+    //Their positions. Every id is once in needed, so threads never write the same one
+    Point missing = {NAN, NAN};
+    std::vector<Point> positions(needed.size(), missing);
+    cursor = _begin;
+    const char* nodesEnd = lastNode;
+    forEachChunk(input, [&](Chunk& chunk){ return cutXml(cursor, chunk, nodesEnd); },
+      [&](const Chunk& chunk, size_t, Scratch&){
+      XmlTag tag;
+      for(const char* p = chunk.begin; (p = nextTag(p, chunk.end, tag)) != NULL; ){
+        if(!tag.closing && tag.is("node")){
+          int64_t id = idAttribute(tag.name, p, "id");
+          std::vector<int64_t>::const_iterator it = std::lower_bound(needed.begin(), needed.end(), id);
+          if(it != needed.end() && *it == id){
+            positions[it - needed.begin()] = _projection(numberAttribute(tag.name, p, "lon"), numberAttribute(tag.name, p, "lat"));
+          }
+        }
+      }
+    });
+
+    //And the ways
+    cursor = firstWay;
+    forEachChunk(input, [&](Chunk& chunk){ return cutXml(cursor, chunk); },
+      [&](const Chunk& chunk, size_t number, Scratch& scratch){
+      std::vector<Box> made;
+      size_t footprints = 0, skipped = 0;
+      XmlTag tag;
+      for(const char* p = chunk.begin; (p = nextTag(p, chunk.end, tag)) != NULL; ){
+        if(tag.closing || !tag.is("way") || tag.empty){
+          continue;
+        }
+        bool building;
+        double height;
+        p = readWay(p, chunk.end, scratch, building, height);
+        if(!building){
+          continue;
+        }
+        scratch.clear();
+        bool closed = scratch.refs.size() >= 4 && scratch.refs.front() == scratch.refs.back();
+        for(size_t i = 0; closed && i + 1 < scratch.refs.size(); i++){
+          std::vector<int64_t>::const_iterator it = std::lower_bound(needed.begin(), needed.end(), scratch.refs[i]);
+          closed = it != needed.end() && *it == scratch.refs[i] && !std::isnan(positions[it - needed.begin()].x);
+          if(closed){
+            scratch.add(positions[it - needed.begin()]);
+          }
+        }
+        scratch.closeRing();
+        if(closed){
+          extrude(scratch, _cell, height, made);
+          footprints++;
+        }else{
+          skipped++;
+        }
+      }
+      keep(number, made, footprints, skipped);
+    });
+    return true;
+  }
+
+private:
+  const char* _begin;
+  const char* _end;
+  double _cell;//Metres
+  Projection _projection;
+  size_t _footprints;
+  size_t _skipped;
+  FILE* _spill;//Every box made so far, in input order
+  size_t _spilled;
+  bool _spillOk;
+  std::map<size_t, std::vector<Box> > _waiting;//Chunks done before the ones ahead of them, by chunk number
+  size_t _nextChunk;//The next to be spilled
+  std::mutex _keepLock;
+
+  const char* find(const char* from, const char* text){
+    size_t length = strlen(text);
+    for(const char* p = from; (p = (const char*)memchr(p, text[0], _end - p)) != NULL && p + length <= _end; p++){
+      if(memcmp(p, text, length) == 0){
+        return p;
+      }
+    }
+    return NULL;
+  }
+
+  /*Cuts OSM XML after about CHUNK_BYTES, before the next node, way or
+  relation, which can't start inside another one*/
+  bool cutXml(const char*& cursor, Chunk& chunk, const char* stop = NULL){
+    const char* end = stop ? stop : _end;
+    if(cursor >= end){
+      return false;
+    }
+    chunk.begin = cursor;
+    const char* p = cursor + std::min<size_t>(CHUNK_BYTES, end - cursor);
+    XmlTag tag;
+    const char* next;
+    while(p < end && (next = nextTag(p, end, tag)) != NULL){
+      if(!tag.closing && (tag.is("node") || tag.is("way") || tag.is("relation"))){
+        end = tag.name - 1;
+        break;
+      }
+      p = next;
+    }
+    chunk.end = end;
+    cursor = end;
+    return true;
+  }
+
+  void keep(size_t number, std::vector<Box>& made, size_t footprints, size_t skipped){
+    std::lock_guard<std::mutex> merge(_keepLock);
+    _waiting[number].swap(made);
+    _footprints += footprints;
+    _skipped += skipped;
+    while(!_waiting.empty() && _waiting.begin()->first == _nextChunk){
+      const std::vector<Box>& boxes = _waiting.begin()->second;
+      for(size_t i = 0; i < boxes.size(); i++){
+        low[0] = std::min(low[0], boxes[i].x - boxes[i].size);
+        low[1] = std::min(low[1], boxes[i].y - boxes[i].size);
+        high[0] = std::max(high[0], boxes[i].x + boxes[i].size);
+        high[1] = std::max(high[1], boxes[i].y + boxes[i].size);
+      }
+      _spillOk = _spillOk && (boxes.empty() || fwrite(&boxes[0], sizeof(Box), boxes.size(), _spill) == boxes.size());
+      _spilled += boxes.size();
+      _waiting.erase(_waiting.begin());
+      _nextChunk++;
+    }
+  }
+};
+
+/*Lays the spilled boxes out like a generated city: in x from 0 and z
+from 0 down, in blocks of BLOCK_SIZE stored one after another, and
+writes them to path. Memory holds a count for each block of the plane
+and BAND_BUILDINGS buildings at a time, not the whole city: each band of
+the file is filled by reading every box back and keeping the ones that
+land in it*/
+bool writeCity(Importer& importer, double metresPerUnit, const char* path, CityFileHeader& written){
+  size_t count = importer.boxes();
+  if(count > UINT32_MAX){
+    fprintf(stderr, "%zu boxes are more than a city file holds\n", count);
+    return false;
+  }
+  const float* low = importer.low;
+  const float* high = importer.high;
+  const float margin = 2.0f;//Units between the city and the edge of the plane
+  float scale = 1.0f / metresPerUnit;
+  float width = (high[0] - low[0]) * scale + 2.0f * margin;
+  float depth = (high[1] - low[1]) * scale + 2.0f * margin;
+  std::vector<std::string> textures;
+  textures.push_back("textures/building.jpg");
+  textures.push_back("textures/building2.jpg");
+  int columns = int(width / BLOCK_SIZE) + 1;
+  int rows = int(depth / BLOCK_SIZE) + 1;
+  struct Placed{
+    float x;
+    float z;
+    int block;
+  };
+  //Where a box goes, as the unit x and z of its centre and its block
+  auto place = [&](const Box& box) -> Placed{
+    Placed p;
+    p.x = (box.x - low[0]) * scale + margin;
+    p.z = -((box.y - low[1]) * scale + margin);
+    p.block = std::min(columns - 1, int(p.x / BLOCK_SIZE)) + std::min(rows - 1, int(-p.z / BLOCK_SIZE)) * columns;
+    return p;
+  };
+
+  //Counting sort into blocks, keeping the order within each
+  std::vector<uint32_t> start(columns * rows + 1, 0);
+  if(!importer.forEachBox([&](const Box& box){ start[place(box).block + 1]++; })){
+    fprintf(stderr, "can't read the boxes back from the temporary file\n");
+    return false;
+  }
+  uint32_t blocks = 0;
+  for(size_t b = 1; b < start.size(); b++){
+    blocks += start[b] != 0;
+    start[b] += start[b - 1];
+  }
+  CityFileWriter writer(path, count ? uint32_t(ceil(std::max(width, depth))) : 0, textures, count, blocks);
+  written = writer.header();
+
+  //The file a band at a time. next is where each block's next box goes
+  std::vector<uint32_t> next(start.size());
+  CityData band;
+  CityFileBlock block;
+  size_t cell = 0;//Of the block being filled in
+  for(size_t first = 0; first < count; first += BAND_BUILDINGS){
+    size_t last = std::min(count, first + BAND_BUILDINGS);
+    band.x.resize(last - first);
+    band.z.resize(last - first);
+    band.buildingSize.resize(last - first);
+    band.height.resize(last - first);
+    band.layer.resize(last - first);
+    band.shape.assign(last - first, 0);//Plain squares for now, see extrude()
+    band.occlusion.assign((last - first) * CITY_FILE_CORNERS, 255);//Not baked: fully open
+    next.assign(start.begin(), start.end());
+    bool read = importer.forEachBox([&](const Box& box){
+      Placed p = place(box);
+      uint32_t at = next[p.block]++;
+      if(at < first || at >= last){
+        return;
+      }
+      at -= first;
+      band.x[at] = p.x;
+      band.z[at] = p.z;
+      band.buildingSize[at] = box.size * scale;
+      band.height[at] = box.height * scale;
+      //Facades picked by where the box is, so they don't depend on the input order
+      uint32_t hash = uint32_t(int32_t(floor(box.x))) * 73856093u ^ uint32_t(int32_t(floor(box.y))) * 19349663u;
+      band.layer[at] = (hash >> 4) % textures.size();
+    });
+    if(!read){
+      fprintf(stderr, "can't read the boxes back from the temporary file\n");
+      return false;
+    }
+    //The blocks this band finishes. One running on into the next band is finished there
+    band.blocks.clear();
+    for(; cell + 1 < start.size() && start[cell] < last; cell++){
+      if(start[cell] == start[cell + 1]){
+        continue;
+      }
+      if(start[cell] >= first){
+        block.first = start[cell];
+        block.count = start[cell + 1] - start[cell];
+        for(int a = 0; a < 3; a++){
+          block.boundsMin[a] = 1e30f;
+          block.boundsMax[a] = -1e30f;
+        }
+        block.boundsMin[1] = 0.0f;
+      }
+      for(uint32_t i = std::max<uint32_t>(start[cell], first) - first; i < std::min<uint32_t>(start[cell + 1], last) - first; i++){
+        block.boundsMin[0] = std::min(block.boundsMin[0], band.x[i] - band.buildingSize[i]);
+        block.boundsMin[2] = std::min(block.boundsMin[2], band.z[i] - band.buildingSize[i]);
+        block.boundsMax[0] = std::max(block.boundsMax[0], band.x[i] + band.buildingSize[i]);
+        block.boundsMax[1] = std::max(block.boundsMax[1], band.height[i]);
+        block.boundsMax[2] = std::max(block.boundsMax[2], band.z[i] + band.buildingSize[i]);
+      }
+      if(start[cell + 1] > last){
+        break;
+      }
+      band.blocks.push_back(block);
+    }
+    writer.addBlocks(band.blocks.empty() ? NULL : &band.blocks[0], band.blocks.size());
+    writer.addBuildings(band);
+  }
+  if(!writer.close()){
+    fprintf(stderr, "%s: can't write\n", path);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]){
+  const char* extension = argc >= 3 ? strrchr(argv[1], '.') : NULL;
+  double metresPerUnit = argc == 4 ? atof(argv[3]) : DEFAULT_METRES_PER_UNIT;
+  if(!extension || argc > 4 || metresPerUnit <= 0.0){
+    fprintf(stderr, "Usage: %s buildings.geojson|buildings.osm city.city [metres per unit]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  double start = seconds();
+  MappedFile input(argv[1], MappedFile::SEQUENTIAL);
+  if(!input.isOpen()){
+    fprintf(stderr, "%s: can't open\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  Importer importer(input, metresPerUnit);
+  bool osm = strcmp(extension, ".osm") == 0 || strcmp(extension, ".xml") == 0;
+  if(!(osm ? importer.osm(input) : importer.geoJson(input))){
+    fprintf(stderr, "%s: can't import\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  double parsed = seconds();
+  if(!importer.spillOk()){
+    fprintf(stderr, "can't write the boxes to a temporary file\n");
+    return EXIT_FAILURE;
+  }
+  if(importer.boxes() == 0){
+    fprintf(stderr, "%s: no buildings found\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  CityFileHeader city;
+  if(!writeCity(importer, metresPerUnit, argv[2], city)){
+    return EXIT_FAILURE;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%s -> %s: %zu footprints (%zu skipped) as %zu boxes in %zu blocks, plane size %u\n",
+    argv[1], argv[2], importer.footprints(), importer.skipped(), size_t(city.buildings), size_t(city.blocks), city.size);
+  printf("  %.1f MB read in %.2f s (%.0f MB/s on %u threads), %.2f s total, peak memory %.1f MB\n",
+    input.size() / 1048576.0, parsed - start, input.size() / 1048576.0 / (parsed - start),
+    std::max(1u, std::thread::hardware_concurrency()), seconds() - start, usage.ru_maxrss / 1024.0);
+  return EXIT_SUCCESS;
+}
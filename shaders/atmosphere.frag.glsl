@@ -0,0 +1,51 @@
+# version 130
+//Procedural sky from the scattering tables of Atmosphere.h.
+//Uses skybox.vert.glsl, so TexCoords is the world space view ray.
+uniform sampler3D rayleighTable;
+uniform sampler3D mieTable;
+uniform vec3 sunDirection;//Towards the sun, normalized
+uniform vec3 sunColor;//Sunlight left after crossing the atmosphere to the camera
+uniform float sunIntensity;
+
+varying vec3 TexCoords;
+
+//Must match the table sizes in Atmosphere.h
+const vec3 TABLE_SIZE = vec3(16.0, 64.0, 64.0);//Azimuth, view, sun
+const float PI = 3.14159265;
+const float MIE_G = 0.76;
+
+//Table coordinates of Atmosphere::azimuthCosine(), viewCosine() and sunCosine()
+vec3 TableCoord(const in vec3 view){
+  float mu = view.y;
+  float x = sign(mu) * sqrt(abs(mu));
+  vec2 viewFlat = view.xz;
+  vec2 sunFlat = sunDirection.xz;
+  float azimuth = 1.0;
+  if(length(viewFlat) > 1e-4 && length(sunFlat) > 1e-4){
+    azimuth = dot(normalize(viewFlat), normalize(sunFlat));
+  }
+  vec3 u = vec3(azimuth * 0.5 + 0.5, x * 0.5 + 0.5, clamp((sunDirection.y + 0.3) / 1.3, 0.0, 1.0));
+  //Texel centres, so 0 and 1 land on the first and last entries
+  return (u * (TABLE_SIZE - 1.0) + 0.5) / TABLE_SIZE;
+}
+
+void main (void){
+  vec3 view = normalize(TexCoords);
+  float nu = dot(view, sunDirection);
+  vec3 coord = TableCoord(view);
+  vec3 rayleigh = texture(rayleighTable, coord).rgb;
+  vec3 mie = texture(mieTable, coord).rgb;
+
+  float rayleighPhase = 3.0 / (16.0 * PI) * (1.0 + nu * nu);
+  float g2 = MIE_G * MIE_G;
+  float miePhase = 3.0 / (8.0 * PI) * (1.0 - g2) * (1.0 + nu * nu)
+    / ((2.0 + g2) * pow(1.0 + g2 - 2.0 * MIE_G * nu, 1.5));
+  vec3 color = sunIntensity * (rayleigh * rayleighPhase + mie * miePhase);
+
+  //Sun disk, about half a degree across, and a faint night sky
+  color += sunColor * sunIntensity * smoothstep(0.99996, 0.99999, nu) * step(0.0, view.y);
+  color += vec3(0.002, 0.003, 0.008);
+
+  //Simple exposure so the bright day sky doesn't clip
+  gl_FragColor = vec4(vec3(1.0) - exp(-2.0 * color), 1.0);
+}
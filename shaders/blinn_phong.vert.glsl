@@ -1,16 +1,30 @@
-# version 120
+# version 130
 //These are passed in from the CPU program
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
+uniform mat4 normalMatrix;
 
 //These are variables that we wish to send to our fragment shader
 //In later versions of GLSL, these are 'out' variables.
-varying vec3 myNormal;
-varying vec4 myVertex;
+//Everything the lighting needs is transformed here once per vertex
+//instead of once per fragment.
+varying vec3 myPosition;//View space
+varying vec3 myNormal;//View space, unnormalized after interpolation
+varying vec4 myVertex;//World space, for the shadow lookup
+varying float myOcclusion;//Baked ambient occlusion, 1 is fully open
+flat out uint mySeed;//Of the building's procedural facade (see facade.glsl). Integers need flat out, not varying
+
+#include "packed_vertex.glsl"
 
 void main() {
-  gl_Position = projectionMatrix * modelViewMatrix * gl_Vertex;
-  myNormal = gl_Normal;
-  myVertex = gl_Vertex;
-  gl_TexCoord[0] = gl_MultiTexCoord0;
+  vec4 vertex = UnpackPosition();
+  vec4 position = modelViewMatrix * vertex;
+  gl_Position = projectionMatrix * position;
+  myPosition = position.xyz / position.w;
+  myNormal = (normalMatrix * vec4(gl_Normal, 0.0)).xyz;
+  myVertex = vertex;
+  myOcclusion = gl_Color.a;
+  uvec3 seed = uvec3(gl_Color.rgb * 255.0 + 0.5);
+  mySeed = seed.r | (seed.g << 8u) | (seed.b << 16u);
+  gl_TexCoord[0] = UnpackTexCoord();
 }
@@ -0,0 +1,68 @@
+# version 430
+//Frustum culls every building and writes the draw commands for the survivors.
+//One invocation per building.
+layout(local_size_x = 64) in;
+
+struct DrawRecord{
+  vec4 boundsMin;
+  vec4 boundsMax;
+  uint count;//Indices of the building's mesh
+  uint firstIndex;
+  uint baseVertex;
+  uint vertexCount;//Only used on the CPU
+};
+
+//Laid out like DrawElementsIndirectCommand
+struct Command{
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  uint baseVertex;
+  uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Records{
+  DrawRecord records[];
+};
+
+layout(std430, binding = 1) writeonly buffer Commands{
+  Command commands[];
+};
+
+layout(std430, binding = 2) buffer Count{
+  uint drawCount;
+};
+
+uniform vec4 planes[6];//xyz is the inward normal, w the offset
+uniform uint buildings;
+//Pack the visible buildings' commands at the front and count them,
+//otherwise every building keeps its slot and hidden ones draw 0 instances
+uniform bool compact;
+
+//Same test as Frustum::intersects, only the corner furthest along each normal
+bool visible(vec3 boxMin, vec3 boxMax){
+  for(int i = 0; i < 6; i++){
+    vec3 corner = mix(boxMin, boxMax, step(0.0, planes[i].xyz));
+    if(dot(planes[i].xyz, corner) + planes[i].w < 0.0){
+      return false;
+    }
+  }
+  return true;
+}
+
+void main(){
+  uint id = gl_GlobalInvocationID.x;
+  if(id >= buildings){
+    return;
+  }
+  DrawRecord record = records[id];
+  bool inside = visible(record.boundsMin.xyz, record.boundsMax.xyz);
+  if(compact){
+    if(inside){
+      uint slot = atomicAdd(drawCount, 1u);
+      commands[slot] = Command(record.count, 1u, record.firstIndex, record.baseVertex, id);
+    }
+  }else{
+    commands[id] = Command(record.count, inside ? 1u : 0u, record.firstIndex, record.baseVertex, id);
+  }
+}
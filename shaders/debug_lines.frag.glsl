@@ -0,0 +1,6 @@
+# version 130
+varying vec4 myColor;
+
+void main (void){
+  gl_FragColor = myColor;
+}
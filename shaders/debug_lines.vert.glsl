@@ -0,0 +1,10 @@
+# version 130
+//Debug lines are already in world space
+uniform mat4 viewProjection;
+
+varying vec4 myColor;
+
+void main() {
+  gl_Position = viewProjection * gl_Vertex;
+  myColor = gl_Color;
+}
@@ -0,0 +1,33 @@
+# version 130
+//Lighting pass of the deferred path: shades every covered pixel of the
+//G-buffer once, with the same code the forward path uses per fragment.
+uniform sampler2D albedoBuffer;
+uniform sampler2D normalBuffer;
+uniform sampler2D depthBuffer;
+uniform mat4 inverseProjectionMatrix;
+uniform mat4 inverseViewMatrix;
+
+#include "lighting.glsl"
+
+void main (void){
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(depthBuffer, pixel, 0).r;
+  if(depth == 1.0){
+    //Nothing was drawn here, leave it to the skybox
+    discard;
+  }
+  //Rebuild the view space position from the depth buffer
+  vec3 ndc = vec3(gl_FragCoord.xy / viewportSize, depth) * 2.0 - 1.0;
+  vec4 _mypos = inverseProjectionMatrix * vec4(ndc, 1.0);
+  vec3 mypos = _mypos.xyz / _mypos.w;
+  vec3 normal = normalize(texelFetch(normalBuffer, pixel, 0).xyz * 2.0 - 1.0);
+  vec4 albedo = texelFetch(albedoBuffer, pixel, 0);
+  int bits = int(albedo.a * 255.0 + 0.5);
+  int material = bits % 8;
+  float occlusion = float(bits / 8) / 31.0;
+  albedo.a = 1.0;
+
+  gl_FragColor = ShadeFragment(mypos, normal, inverseViewMatrix * vec4(mypos, 1.0), albedo, material, occlusion);
+  //Keep the depth so the skybox is still hidden behind the city
+  gl_FragDepth = depth;
+}
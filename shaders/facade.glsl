@@ -0,0 +1,57 @@
+//Procedural facades, drawn instead of the facade textures when proceduralFacades
+//is set. Shared by blinn_phong.frag.glsl and gbuffer.frag.glsl, pulled in with #include.
+//Nothing is sampled: the window grid, the frames and which windows are lit all
+//come from hashing the building's seed (see Building::seed()) and the window.
+
+uniform bool proceduralFacades;
+const float FLOORS_PER_UNIT = 3.0;//Rows of windows a unit of height. Columns come from Building.h
+
+uint FacadeHash(uint x){
+  x ^= x >> 16u;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15u;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16u;
+  return x;
+}
+
+//Evenly spread in [0, 1), a different number for each salt
+float FacadeRandom(const in uint seed, const in uint salt){
+  return float(FacadeHash(seed ^ FacadeHash(salt)) >> 8u) / 16777216.0;
+}
+
+//How much of a pixel aa wide at x falls inside a box from -size to size
+float FacadeCoverage(const in float x, const in float size, const in float aa){
+  return clamp((size - x) / aa + 0.5, 0.0, 1.0);
+}
+
+//Albedo of the facade at a window column (negative on roofs) and height (world y)
+vec3 ProceduralFacade(const in float column, const in float height, const in uint seed){
+  vec2 cell = vec2(column, height * FLOORS_PER_UNIT);
+  //Pixels across a window, taken before any branching so the derivatives are defined
+  vec2 aa = max(fwidth(cell), vec2(0.0001));
+
+  //The building's style
+  vec3 wall = mix(vec3(0.06, 0.06, 0.07), vec3(0.32, 0.28, 0.24), FacadeRandom(seed, 1u));
+  if(column < 0.0){
+    return wall * 0.7;//Roof
+  }
+  vec3 frame = wall * 0.5 + vec3(0.12);
+  vec3 glass = mix(vec3(0.02, 0.03, 0.05), vec3(0.06, 0.08, 0.1), FacadeRandom(seed, 2u));
+  vec3 light = mix(vec3(1.0, 0.78, 0.42), vec3(0.8, 0.88, 1.0), FacadeRandom(seed, 3u));
+  vec2 window = vec2(mix(0.45, 0.8, FacadeRandom(seed, 4u)), mix(0.45, 0.75, FacadeRandom(seed, 5u)));
+  float lit = mix(0.1, 0.55, FacadeRandom(seed, 6u));//Share of the windows with the lights on
+
+  //This window
+  vec2 index = floor(cell);
+  vec2 offset = abs(cell - index - 0.5);
+  uint number = FacadeHash(seed ^ FacadeHash(uint(index.x) + (uint(index.y) << 10u)));
+  vec3 pane = FacadeRandom(number, 7u) < lit ? light * mix(0.55, 1.0, FacadeRandom(number, 8u)) : glass;
+  float inPane = FacadeCoverage(offset.x, 0.5 * window.x, aa.x) * FacadeCoverage(offset.y, 0.5 * window.y, aa.y);
+  float inFrame = FacadeCoverage(offset.x, 0.5 * window.x + 0.06, aa.x) * FacadeCoverage(offset.y, 0.5 * window.y + 0.06, aa.y);
+  vec3 color = mix(mix(wall, frame, inFrame), pane, inPane);
+
+  //Once a pixel covers about a window the grid would only alias, so fade to the facade's average
+  vec3 average = mix(wall, mix(glass, light * 0.78, lit), window.x * window.y);
+  return mix(color, average, clamp(2.0 * max(aa.x, aa.y) - 0.5, 0.0, 1.0));
+}
@@ -0,0 +1,29 @@
+# version 130
+//Geometry pass of the deferred path: stores what lighting needs per pixel.
+//Uses blinn_phong.vert.glsl as its vertex shader.
+varying vec3 myPosition;
+varying vec3 myNormal;
+varying vec4 myVertex;
+varying float myOcclusion;
+flat in uint mySeed;
+
+uniform sampler2DArray building;//One layer per facade style
+
+#include "facade.glsl"
+
+void main (void){
+  vec3 normal = normalize(myNormal);
+  //Attachment 0 is RGBA8 albedo with the material number (low 3 bits) and
+  //the ambient occlusion (high 5 bits) packed into alpha,
+  //attachment 1 is the view space normal packed into RGB10_A2
+  vec3 albedo;
+  if(proceduralFacades){
+    albedo = ProceduralFacade(gl_TexCoord[0].q, myVertex.y, mySeed);
+  }else{
+    albedo = texture(building, gl_TexCoord[0].stp).rgb;
+  }
+  float material = clamp(floor(gl_TexCoord[0].p + 0.5), 0.0, 7.0);
+  float occlusion = floor(clamp(myOcclusion, 0.0, 1.0) * 31.0 + 0.5);
+  gl_FragData[0] = vec4(albedo, (material + occlusion * 8.0) / 255.0);
+  gl_FragData[1] = vec4(normal * 0.5 + 0.5, 0.0);
+}
@@ -0,0 +1,118 @@
+//Lighting shared by the forward (blinn_phong.frag.glsl) and the deferred
+//(deferred_lighting.frag.glsl) paths. Pulled in with #include, see GLSLShader.h
+//All positions and directions are in view space unless they say otherwise.
+
+uniform vec3 light0_position;//Already divided by w on the CPU
+uniform vec4 light0_color;
+uniform sampler2DArrayShadow shadowMap;//One layer per cascade
+uniform mat4 shadowMatrices[3];//World space to each cascade's shadow map space
+uniform vec3 cascadeSplits;//View space distance where each cascade ends
+uniform bool shadowsEnabled;
+
+//Clustered point lights, see ClusteredLights.h
+uniform usampler2D clusterTable;//Per cluster: first index, light count
+uniform usampler2D lightIndices;//Light numbers grouped by cluster
+uniform sampler2D lightData;//Per light: view position + radius, color
+uniform vec4 clusterParameters;//First slice depth, slice scale, tiles in x, tiles in y
+uniform vec2 viewportSize;
+const int CLUSTER_SLICES = 24;
+const int DATA_WIDTH = 1024;
+
+//Per material: ambient, diffuse, specular rgb + shininess. See Material.h
+const int MAX_MATERIALS = 8;
+uniform vec4 materials[MAX_MATERIALS * 3];
+
+vec4 ComputeLight (const in vec3 direction, const in vec4 lightcolor, const in vec3 normal, const in vec3 halfvec, const in vec4 mydiffuse, const in vec4 myspecular, const in float myshininess){
+  float nDotL = dot(normal, direction);
+  vec4 lambert = mydiffuse * lightcolor * max (nDotL, 0.0);
+
+  float nDotH = dot(normal, halfvec);
+  vec4 phong = myspecular * lightcolor * pow (max(nDotH, 0.0), myshininess);
+
+  vec4 retval = lambert + phong;
+  return retval;
+}       
+
+//1.0 where the fragment sees the light, 0.0 where a building blocks it
+float ShadowFactor(const in vec3 mypos, const in vec4 worldpos){
+  float depth = -mypos.z;
+  if(!shadowsEnabled || depth >= cascadeSplits.z){
+    return 1.0;
+  }
+  int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : 2);
+  vec4 coord = shadowMatrices[cascade] * worldpos;
+
+  //Four bilinear depth comparisons, i.e. 4x4 texels of PCF
+  vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+  float lit = 0.0;
+  for(float y = -1.0; y <= 1.0; y += 2.0){
+    for(float x = -1.0; x <= 1.0; x += 2.0){
+      lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+    }
+  }
+  return lit * 0.25;
+}
+
+ivec2 DataCoord(const in int index){
+  return ivec2(index % DATA_WIDTH, index / DATA_WIDTH);
+}
+
+//Which cluster this fragment falls in; matches ClusteredLights::update()
+int ClusterIndex(const in float depth){
+  ivec2 tiles = ivec2(clusterParameters.zw);
+  ivec2 tile = clamp(ivec2(gl_FragCoord.xy / viewportSize * clusterParameters.zw), ivec2(0), tiles - 1);
+  int slice = 0;
+  if(depth > clusterParameters.x){
+    slice = min(CLUSTER_SLICES - 1, int(log(depth / clusterParameters.x) * clusterParameters.y));
+  }
+  return tile.x + tiles.x * (tile.y + tiles.y * slice);
+}
+
+//Sum of every point light in this fragment's cluster
+vec4 PointLights(const in vec3 mypos, const in vec3 normal, const in vec3 eyedirn, const in vec4 mydiffuse, const in vec4 myspecular, const in float myshininess){
+  vec4 sum = vec4(0.0);
+  uvec2 cluster = texelFetch(clusterTable, DataCoord(ClusterIndex(-mypos.z)), 0).rg;
+  for(uint i = 0u; i < cluster.y; i++){
+    int light = int(texelFetch(lightIndices, DataCoord(int(cluster.x + i)), 0).r);
+    vec4 positionRadius = texelFetch(lightData, DataCoord(light * 2), 0);
+    vec4 color = texelFetch(lightData, DataCoord(light * 2 + 1), 0);
+    vec3 toLight = positionRadius.xyz - mypos;
+    float distance = length(toLight);
+    //Smooth window so the light reaches exactly zero at its radius
+    float falloff = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = falloff * falloff / (1.0 + distance * distance);
+    vec3 direction = toLight / distance;
+    vec3 halfvec = normalize(direction + eyedirn);
+    sum += attenuation * ComputeLight(direction, vec4(color.rgb, 1.0), normal, halfvec, mydiffuse, myspecular, myshininess);
+  }
+  return sum;
+}
+
+//Full Blinn-Phong shading of one surface point with the given texture colour.
+//normal must be normalized; occlusion is the baked ambient occlusion, 1 when open
+vec4 ShadeFragment(const in vec3 mypos, const in vec3 normal, const in vec4 worldpos, const in vec4 albedo,
+  const in int material, const in float occlusion){
+  int m = clamp(material, 0, MAX_MATERIALS - 1) * 3;
+  vec4 ambient = vec4(materials[m].rgb * occlusion, 1.0);
+  vec4 diffuse = vec4(materials[m + 1].rgb, 1.0);
+  vec4 specular = vec4(materials[m + 2].rgb, 1.0);
+  float shininess = materials[m + 2].w;
+
+  //They eye is always at (0,0,0) looking down -z axis 
+  const vec3 eyepos = vec3(0,0,0);
+  vec3 eyedirn = normalize(eyepos - mypos);
+
+  //Light 0, point
+  vec3 direction0 = normalize (light0_position - mypos);
+  vec3 half0 = normalize(direction0 + eyedirn); 
+  vec4 color0 = ComputeLight(direction0, light0_color, normal, half0, diffuse, specular, shininess);
+  color0 *= ShadowFactor(mypos, worldpos);
+  color0 += PointLights(mypos, normal, eyedirn, diffuse, specular, shininess);
+
+  //No textures, just light:
+  //return ambient + color0;
+  //textures only:
+  //return albedo;
+  //Textures and light:
+  return (ambient + color0) * albedo;
+}
@@ -0,0 +1,17 @@
+//Unpacks the city mesh's vertices, see Building::PackedVertex.
+//Pulled in with #include by the vertex shaders that draw buildings.
+
+//Where the building's positions count from (xyz) and the size of a step (w).
+//Bound to Building::ORIGIN_ATTRIBUTE before linking
+attribute vec4 origin;
+const float TEXCOORD_STEP = 1.0 / 4096.0;//1 / Building::TEXCOORD_STEPS
+
+//World space position
+vec4 UnpackPosition(){
+  return vec4(origin.xyz + gl_Vertex.xyz * origin.w, 1.0);
+}
+
+//Facade s and t, layer and window column
+vec4 UnpackTexCoord(){
+  return gl_MultiTexCoord0 * vec4(TEXCOORD_STEP, TEXCOORD_STEP, 1.0, 1.0);
+}
@@ -0,0 +1,5 @@
+# version 130
+//Only depth is written, there is no colour attachment
+
+void main (void){
+}
@@ -0,0 +1,9 @@
+# version 130
+//Transforms buildings into one cascade of the shadow map
+uniform mat4 lightViewProjection;
+
+#include "packed_vertex.glsl"
+
+void main() {
+  gl_Position = lightViewProjection * UnpackPosition();
+}
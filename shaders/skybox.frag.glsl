@@ -1,8 +1,8 @@
-# version 120
+# version 130
 uniform samplerCube skybox;//built-in data for texture
 
 varying vec3 TexCoords;
 
 void main (void){
-  gl_FragColor = textureCube(skybox, TexCoords);
+  gl_FragColor = texture(skybox, TexCoords);
 }
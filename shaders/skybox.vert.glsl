@@ -1,11 +1,15 @@
-# version 120
-uniform mat4 modelViewMatrix_B;
-uniform mat4 projectionMatrix_B;
+# version 130
+//The skybox is one triangle covering the screen at the far plane, so it
+//only shows where the depth buffer is still clear. Each pixel's view ray
+//is rebuilt from the inverse of the rotation-only view projection.
+uniform mat4 inverseViewProjection_B;
 
 varying vec3 TexCoords;
 
 void main() {
-  vec4 position = projectionMatrix_B * modelViewMatrix_B * gl_Vertex;
-  gl_Position = position.xyww;//To trick the depth testing. Will always pass whenever there's no object in front of my skybox
-  TexCoords = gl_Vertex.xyz;
+  //gl_VertexID 0, 1, 2 become (-1,-1), (3,-1), (-1,3)
+  vec2 corner = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;
+  gl_Position = vec4(corner, 1.0, 1.0);//Depth is exactly 1
+  vec4 ray = inverseViewProjection_B * gl_Position;
+  TexCoords = ray.xyz / ray.w;
 }